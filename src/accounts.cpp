@@ -0,0 +1,164 @@
+/*
+ *  SPDX-License-Identifier: BSD-2-Clause
+ *  SPDX-License-File: LICENSE
+ *
+ * Copyright 2019 Adriaan de Groot <groot@kde.org>
+ */
+
+#include "accounts.h"
+
+#include "quatbot.h"
+#include "recorder.h"
+
+#include <QDebug>
+#include <QFile>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QUrl>
+
+namespace QuatBot
+{
+static QStringList strings(const QJsonValue& v)
+{
+    QStringList l;
+    for (const auto& s : v.toArray())
+    {
+        if (!s.toString().isEmpty())
+        {
+            l << s.toString();
+        }
+    }
+    return l;
+}
+
+bool AccountConfig::load(const QString& fileName, QVector<AccountConfig>& accounts)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        qWarning() << "Can't read accounts from" << fileName << file.errorString();
+        return false;
+    }
+    QJsonParseError error;
+    const QJsonDocument doc = QJsonDocument::fromJson(file.readAll(), &error);
+    if (doc.isNull())
+    {
+        qWarning() << "Can't read accounts from" << fileName << error.errorString();
+        return false;
+    }
+
+    const QJsonArray list = doc.object().value(QStringLiteral("accounts")).toArray();
+    for (const auto& a : list)
+    {
+        const QJsonObject o = a.toObject();
+        AccountConfig config;
+        config.user = o.value(QStringLiteral("user")).toString();
+        config.password = o.value(QStringLiteral("password")).toString();
+        config.homeserver = o.value(QStringLiteral("homeserver")).toString();
+        config.rooms = strings(o.value(QStringLiteral("rooms")));
+        config.operators = strings(o.value(QStringLiteral("operators")));
+        if (config.user.isEmpty() || config.rooms.isEmpty())
+        {
+            qWarning() << "Each account in" << fileName << "needs a user and at least one room.";
+            return false;
+        }
+        accounts.append(config);
+    }
+    if (list.isEmpty())
+    {
+        qWarning() << "There are no accounts in" << fileName;
+        return false;
+    }
+    return true;
+}
+
+bool AccountConfig::uniqueRooms(const QVector<AccountConfig>& accounts)
+{
+    QHash<QString, QString> users;  // by room
+    for (const auto& a : accounts)
+    {
+        for (const auto& r : a.rooms)
+        {
+            auto it = users.constFind(r);
+            if (it != users.constEnd())
+            {
+                qWarning() << "Room" << r << "is listed for" << it.value() << "and" << a.user;
+                return false;
+            }
+            users.insert(r, a.user);
+        }
+    }
+    return true;
+}
+
+Account::Account(const AccountConfig& config)
+    : QObject()
+    , m_config(config)
+{
+    Bot::setStandalone(false);
+    connect(&m_conn, &QMatrixClient::Connection::connected, this, &Account::connected);
+    connect(&m_conn,
+            &QMatrixClient::Connection::loginError,
+            this,
+            [this]()
+            {
+                qWarning() << "Could not log in as" << m_config.user;
+                finished();
+            });
+}
+
+Account::~Account() {}
+
+bool Account::record(const QString& fileName)
+{
+    m_recorder = std::make_unique<SyncRecorder>(m_conn, fileName);
+    return m_recorder->isOpen();
+}
+
+void Account::connectToServer()
+{
+    if (!m_config.homeserver.isEmpty())
+    {
+        // Skips the server discovery, e.g. for a test server
+        m_conn.setHomeserver(QUrl::fromUserInput(m_config.homeserver));
+    }
+    m_conn.connectToServer(m_config.user, m_config.password, m_config.deviceName);
+}
+
+void Account::connected()
+{
+    qDebug() << "Connected to" << m_conn.homeserver() << "as" << m_conn.userId();
+    m_conn.setLazyLoading(false);
+    m_conn.syncLoop();
+    for (const auto& r : m_config.rooms)
+    {
+        // Gets cleaned up by itself, e.g. if it can't join
+        auto* bot = new Bot(m_conn, r, m_config.operators);
+        m_bots++;
+        connect(bot,
+                &QObject::destroyed,
+                this,
+                [this]()
+                {
+                    if (--m_bots == 0)
+                    {
+                        qWarning() << "No rooms left for" << m_conn.userId();
+                        finished();
+                    }
+                });
+    }
+}
+
+void Account::finished()
+{
+    if (m_finished)
+    {
+        auto f = std::move(m_finished);
+        m_finished = nullptr;
+        f();
+    }
+}
+
+}  // namespace QuatBot
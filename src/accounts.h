@@ -0,0 +1,97 @@
+/*
+ *  SPDX-License-Identifier: BSD-2-Clause
+ *  SPDX-License-File: LICENSE
+ *
+ * Copyright 2019 Adriaan de Groot <groot@kde.org>
+ */
+
+#ifndef QUATBOT_ACCOUNTS_H
+#define QUATBOT_ACCOUNTS_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include <connection.h>
+
+#include <functional>
+#include <memory>
+
+namespace QuatBot
+{
+class SyncRecorder;
+
+/// @brief How to log in to one Matrix account, and which rooms it follows
+struct AccountConfig
+{
+    QString user;
+    QString password;  ///< empty to ask for it
+    QString homeserver;  ///< empty to discover it from the user id
+    QString deviceName = QStringLiteral("quatbot");
+    QStringList rooms;
+    QStringList operators;
+
+    /** @brief Reads accounts from the JSON file @p fileName
+     *
+     * The file holds an object with an "accounts" array; each account
+     * is an object with "user", "rooms" and, optionally, "password",
+     * "homeserver" and "operators":
+     * ```
+     * { "accounts": [ { "user": "@bot:example.org", "rooms": [ "#a:example.org" ] } ] }
+     * ```
+     * Returns false, after a warning, if the file can't be read.
+     */
+    static bool load(const QString& fileName, QVector<AccountConfig>& accounts);
+    /** @brief Checks that no room is listed twice in @p accounts
+     *
+     * Two bots for one room would share its cookie-jar files and
+     * metrics. Returns false, after a warning, if a room is.
+     */
+    static bool uniqueRooms(const QVector<AccountConfig>& accounts);
+};
+
+/** @brief One Matrix account, with a bot for each of its rooms
+ *
+ * Any number of accounts can run in one process. Each has its own
+ * connection and sync loop, and everything else is shared: the event
+ * loop (and worker threads), the timer wheel, interned user ids, the
+ * fortune database and the metrics.
+ *
+ * The bots are not standalone (see Bot::setStandalone()): a room that
+ * can't be joined, or a bot told to `~quit`, only takes that bot away.
+ */
+class Account : public QObject
+{
+public:
+    explicit Account(const AccountConfig& config);
+    virtual ~Account() override;
+
+    /// @brief Records the events this account receives to @p fileName; false if it can't be written
+    bool record(const QString& fileName);
+    /// @brief Logs in; once connected, starts syncing and creates the bots
+    void connectToServer();
+    /** @brief Calls @p f once this account is done
+     *
+     * That is, when logging in fails, or when the last of its bots
+     * is gone.
+     */
+    void setFinished(std::function<void()> f) { m_finished = std::move(f); }
+
+    const AccountConfig& config() const { return m_config; }
+    Quotient::Connection& connection() { return m_conn; }
+
+private:
+    void connected();
+    void finished();
+
+    AccountConfig m_config;
+    Quotient::Connection m_conn;
+    std::unique_ptr<SyncRecorder> m_recorder;
+    std::function<void()> m_finished;
+    int m_bots = 0;  ///< still alive
+};
+
+}  // namespace QuatBot
+
+#endif
@@ -0,0 +1,58 @@
+/*
+ *  SPDX-License-Identifier: BSD-2-Clause
+ *  SPDX-License-File: LICENSE
+ *
+ * Copyright 2019 Adriaan de Groot <groot@kde.org>
+ */
+
+#include "alloccount.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// Count every heap allocation in the process
+static std::atomic<quint64> allocations { 0 };
+
+void* operator new(std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1))
+    {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+namespace QuatBot
+{
+quint64 allocationCount()
+{
+    return allocations.load(std::memory_order_relaxed);
+}
+}  // namespace QuatBot
@@ -0,0 +1,23 @@
+/*
+ *  SPDX-License-Identifier: BSD-2-Clause
+ *  SPDX-License-File: LICENSE
+ *
+ * Copyright 2019 Adriaan de Groot <groot@kde.org>
+ */
+
+#ifndef QUATBOT_ALLOCCOUNT_H
+#define QUATBOT_ALLOCCOUNT_H
+
+#include <QtGlobal>
+
+namespace QuatBot
+{
+/** @brief Number of heap allocations so far in this process
+ *
+ * This only counts when alloccount.cpp, which replaces the global
+ * operator new, is linked into the executable (qb-bench and qb-replay).
+ */
+quint64 allocationCount();
+}  // namespace QuatBot
+
+#endif
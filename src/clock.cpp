@@ -0,0 +1,56 @@
+/*
+ *  SPDX-License-Identifier: BSD-2-Clause
+ *  SPDX-License-File: LICENSE
+ *
+ * Copyright 2019 Adriaan de Groot <groot@kde.org>
+ */
+
+#include "clock.h"
+
+#include "timerwheel.h"
+
+namespace QuatBot
+{
+static Clock* systemClock()
+{
+    static SystemClock* clock = new SystemClock;
+    return clock;
+}
+
+static Clock* currentClock = nullptr;
+
+Clock::~Clock() {}
+
+Clock* Clock::instance()
+{
+    return currentClock ? currentClock : systemClock();
+}
+
+void Clock::setInstance(Clock* clock)
+{
+    currentClock = clock;
+}
+
+SystemClock::SystemClock()
+{
+    m_clock.start();
+}
+
+VirtualClock::VirtualClock(const QDateTime& start)
+    : m_epoch(start.toMSecsSinceEpoch())
+{
+}
+
+void VirtualClock::advance(qint64 msec)
+{
+    auto* wheel = TimerWheel::instance();
+    const qint64 target = m_elapsed + qMax<qint64>(msec, 0);
+    for (qint64 due = wheel->nextDue(); due >= 0 && due <= target; due = wheel->nextDue())
+    {
+        m_elapsed = qMax(m_elapsed, due);
+        wheel->tick();
+    }
+    m_elapsed = target;
+}
+
+}  // namespace QuatBot
@@ -0,0 +1,98 @@
+/*
+ *  SPDX-License-Identifier: BSD-2-Clause
+ *  SPDX-License-File: LICENSE
+ *
+ * Copyright 2019 Adriaan de Groot <groot@kde.org>
+ */
+
+#ifndef QUATBOT_CLOCK_H
+#define QUATBOT_CLOCK_H
+
+#include <QDate>
+#include <QDateTime>
+#include <QElapsedTimer>
+
+namespace QuatBot
+{
+/** @brief Where the bot gets the time from
+ *
+ * Everything in the bot that depends on the time asks the clock:
+ * the TimerWheel (and so all reminders, refills and fallbacks), the
+ * times in status messages, the names of meeting logs. Normally that
+ * is the SystemClock. Simulations install a VirtualClock and move it
+ * forward themselves, so that a meeting with all its reminders takes
+ * only as long as handling its messages does.
+ *
+ * Measurements (metrics, traces, lag and latency) always use real
+ * time, since they are about how long the bot itself takes.
+ */
+class Clock
+{
+public:
+    virtual ~Clock();
+
+    /// @brief Monotonic milliseconds, from some arbitrary start
+    virtual qint64 elapsed() const = 0;
+    /// @brief Milliseconds since the epoch
+    virtual qint64 msecsSinceEpoch() const = 0;
+    /// @brief Is time only moved forward by hand? (see VirtualClock)
+    virtual bool isVirtual() const { return false; }
+
+    QDateTime currentDateTimeUtc() const { return QDateTime::fromMSecsSinceEpoch(msecsSinceEpoch(), Qt::UTC); }
+    QDateTime currentDateTime() const { return QDateTime::fromMSecsSinceEpoch(msecsSinceEpoch()); }
+    QDate currentDate() const { return currentDateTime().date(); }
+
+    /// @brief The clock of the bot, the system clock unless setInstance() was called
+    static Clock* instance();
+    /** @brief Makes @p clock the clock of the bot (@c nullptr is the system clock)
+     *
+     * Do this before any timers are scheduled, since the TimerWheel
+     * counts in the clock's elapsed() time. The caller keeps
+     * ownership of @p clock.
+     */
+    static void setInstance(Clock* clock);
+};
+
+/// @brief Real time
+class SystemClock : public Clock
+{
+public:
+    SystemClock();
+
+    qint64 elapsed() const override { return m_clock.elapsed(); }
+    qint64 msecsSinceEpoch() const override { return QDateTime::currentMSecsSinceEpoch(); }
+
+private:
+    QElapsedTimer m_clock;
+};
+
+/** @brief Time that only moves when told to
+ *
+ * The TimerWheel does not use a QTimer with a virtual clock;
+ * instead, advance() runs the timers as they come due.
+ */
+class VirtualClock : public Clock
+{
+public:
+    /// @brief A clock that starts at @p start (by default, a Monday morning)
+    explicit VirtualClock(const QDateTime& start = QDateTime(QDate(2019, 1, 7), QTime(9, 0), Qt::UTC));
+
+    qint64 elapsed() const override { return m_elapsed; }
+    qint64 msecsSinceEpoch() const override { return m_epoch + m_elapsed; }
+    bool isVirtual() const override { return true; }
+
+    /** @brief Moves the clock forward by @p msec milliseconds
+     *
+     * Timers that come due on the way run at their own time (to
+     * the resolution of the TimerWheel), so the timers they start
+     * are relative to that.
+     */
+    void advance(qint64 msec);
+
+private:
+    qint64 m_epoch;
+    qint64 m_elapsed = 0;
+};
+
+}  // namespace QuatBot
+#endif
@@ -7,18 +7,76 @@
 
 #include "coffee.h"
 
+#include "clock.h"
+#include "timerwheel.h"
+#include "trace.h"
+#include "userid.h"
+
+#include <QCoreApplication>
 #include <QDataStream>
 #include <QDateTime>
 #include <QDebug>
 #include <QDir>
-#include <QMap>
+#include <QFile>
+#include <QFuture>
 #include <QRegularExpression>
+#include <QSet>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
 #include <QStandardPaths>
-#include <QTimer>
+#include <QVector>
+#include <QtConcurrent>
+#include <QtEndian>
+
+#include <cstring>
+#include <set>
+#include <unordered_map>
 
 namespace
 {
 static constexpr const qint32 MAGIC = 0xcafe;
+static constexpr const qint32 JOURNAL_VERSION = 1;
+/// Compact the journal after (at least) this many records
+static constexpr const int MIN_JOURNAL_RECORDS = 256;
+
+static const QString JOURNAL_SUFFIX = QStringLiteral(".journal");
+static const QString JOURNAL_OLD_SUFFIX = QStringLiteral(".journal.old");
+
+/* Version 3 of the save-file is meant to be memory-mapped. All values
+ * are big-endian, like the QDataStream-based versions. The header is:
+ *
+ *  - qint32 MAGIC
+ *  - qint32 version (3)
+ *  - qint64 when, msecs since epoch
+ *  - quint32 number of records
+ *  - quint32 size of the names-blob
+ *  - 8 bytes reserved
+ *
+ * Then follow the records, sorted by user-id (as UTF-8, bytewise):
+ *
+ *  - quint32 offset of the user-id in the names-blob
+ *  - quint32 length of the user-id
+ *  - qint32 coffee, tea, cookie, eaten
+ *
+ * Then follows the names-blob, which holds the UTF-8 user-ids.
+ */
+static constexpr const int V3_HEADER_SIZE = 32;
+/// ~coffee stats lists at most this many users
+static constexpr const int MAX_STATS_USERS = 25;
+static constexpr const int V3_RECORD_SIZE = 24;
+
+/// @brief Compares user-id @p key with @p name (which is @p length bytes)
+int compare_name(const QByteArray& key, const char* name, quint32 length)
+{
+    const quint32 keyLength = quint32(key.size());
+    const int c = memcmp(key.constData(), name, qMin(keyLength, length));
+    if (c != 0)
+    {
+        return c;
+    }
+    return keyLength < length ? -1 : (keyLength > length ? 1 : 0);
+}
 
 void check_trailer(QDataStream& d)
 {
@@ -63,33 +121,173 @@ class CoffeeStats
 {
 public:
     CoffeeStats() {}
-    CoffeeStats(const QString& u)
+    explicit CoffeeStats(UserId u)
         : m_user(u)
     {
     }
 
-    QString m_user;
+    UserId m_user;
     int m_coffee = 0;
     int m_tea = 0;
     int m_cookie = 0;
     int m_cookieEated = 0;
 };
 
+/** @brief Users ordered by one of their CoffeeStats counters
+ *
+ * The order is kept up-to-date as counters change (see update()),
+ * so the top of the board is available without sorting anything.
+ * The board holds pointers to the stats, which must stay put.
+ * Users with a zero counter are not on the board.
+ */
+class Leaderboard
+{
+public:
+    using Counter = int CoffeeStats::*;
+
+    explicit Leaderboard(Counter c)
+        : m_counter(c)
+    {
+    }
+
+    /// @brief Re-order @p u after its counter has changed
+    void update(const CoffeeStats& u)
+    {
+        const int value = u.*m_counter;
+        auto it = m_values.find(&u);
+        if (it != m_values.end())
+        {
+            if (it->second == value)
+            {
+                return;
+            }
+            m_order.erase(Entry { it->second, &u });
+            m_values.erase(it);
+        }
+        if (value > 0)
+        {
+            m_values.emplace(&u, value);
+            m_order.insert(Entry { value, &u });
+        }
+    }
+
+    /// @brief The first @p k users, formatted as "user (count)"
+    QStringList top(int k) const
+    {
+        QStringList l;
+        for (auto it = m_order.cbegin(); (it != m_order.cend()) && (k > 0); ++it, --k)
+        {
+            l << QString("%1 (%2)").arg(it->stats->m_user.toString()).arg(it->value);
+        }
+        return l;
+    }
+
+private:
+    struct Entry
+    {
+        int value;
+        const CoffeeStats* stats;
+
+        /// Highest value first, then alphabetical
+        bool operator<(const Entry& other) const
+        {
+            if (value != other.value)
+            {
+                return value > other.value;
+            }
+            return stats->m_user.toString() < other.stats->m_user.toString();
+        }
+    };
+
+    Counter m_counter;
+    std::set<Entry> m_order;
+    std::unordered_map<const CoffeeStats*, int> m_values;  // value as it is in m_order
+};
+
+/// @brief Sends the stats for (at most MAX_STATS_USERS of) @p users to the room
+static void report_stats(Bot* bot, const QList<CoffeeStats>& users)
+{
+    for (int i = 0; (i < users.count()) && (i < MAX_STATS_USERS); ++i)
+    {
+        const auto& u = users[i];
+        QStringList info { u.m_user.toString() };
+        if (u.m_coffee > 0)
+        {
+            info << OptionalAnd {} << QString("has had %1 cups of coffee").arg(u.m_coffee);
+        }
+        if (u.m_tea > 0)
+        {
+            info << OptionalAnd {} << QString("has had %1 cups of tea").arg(u.m_tea);
+        }
+        if (u.m_cookie > 0)
+        {
+            info << OptionalAnd {} << QString("has %1 cookies").arg(u.m_cookie);
+        }
+        if (u.m_cookieEated > 0)
+        {
+            info << OptionalAnd {} << QString("has eaten %1 cookies").arg(u.m_cookieEated);
+        }
+        info << ".";
+        bot->message(info);
+    }
+    if (users.count() > MAX_STATS_USERS)
+    {
+        bot->message(
+            QString("And %1 more. Use ~coffee top to see who drinks the most.").arg(users.count() - MAX_STATS_USERS));
+    }
+}
+
+/** @brief Storage for the cookie-jar and the coffee stats of one room
+ *
+ * The Coffee module only talks to this interface. There are two
+ * implementations: FileJar keeps everything for the room in memory
+ * (saving to a file per room), while SharedJar uses a database
+ * shared by all the rooms in the process.
+ */
 class Coffee::Private
 {
-    /// @brief Remember to save state on return from a function
+public:
+    virtual ~Private();
+
+    /// @brief Number of cookies in the jar
+    virtual int cookies() const = 0;
+    /// @brief Give @p user a coffee; returns their coffee count
+    virtual int coffee(UserId user) = 0;
+    /// @brief Give @p user some tea; returns their tea count
+    virtual int tea(UserId user) = 0;
+    /// @brief Give @p user a cookie from the jar; returns true on success
+    virtual bool giveCookie(UserId user) = 0;
+    /// @brief Give @p other one of @p user 's cookies; returns true on success
+    virtual bool transferCookie(UserId user, UserId other) = 0;
+    /// @brief @p user eats a cookie; returns true on success
+    virtual bool eatCookie(UserId user) = 0;
+
+    /// @brief Sends the stats of the users in the room to the room
+    virtual void stats(Bot* bot) = 0;
+    /// @brief Lists the top @p k coffee drinkers, tea drinkers and cookie owners
+    virtual void top(Bot* bot, int k) = 0;
+};
+
+Coffee::Private::~Private() {}
+
+/// @brief Cookie-jar and stats for one room, saved in a file per room
+class FileJar : public Coffee::Private
+{
+    /// @brief Remember to journal the changes to @p u on return from a function
     struct AutoSave
     {
-        AutoSave(Private* p)
+        AutoSave(FileJar* p, const CoffeeStats& u)
             : m_p(p)
+            , m_u(u)
         {
         }
-        ~AutoSave() { m_p->save(); }
-        Private* m_p;
+        ~AutoSave() { m_p->changed(m_u); }
+        FileJar* m_p;
+        const CoffeeStats& m_u;
     };
 
 public:
-    Private(const QString& roomName)
+    FileJar(const QString& roomName)
         : m_saveFileName(
             [](QString s)
             {
@@ -97,68 +295,78 @@ public:
                 return QString("cookiejar-%1").arg(s);
             }(roomName))
     {
-        QObject::connect(&m_refill, &QTimer::timeout, [this]() { this->addCookie(); });
         m_refill.start(3579100);  // every hour, -ish
         load();
     }
 
-    void stats(Bot* bot)
+    ~FileJar() override
     {
-        const auto roomUsers = bot->userIds();
-        for (const auto& u : m_stats)
+        m_snapshot.waitForFinished();
+        m_journal.close();
+    }
+
+    void stats(Bot* bot) override
+    {
+        materialize();
+
+        // Only users that are in the room, sorted
+        QList<CoffeeStats> here;
+        for (const auto& id : bot->userIds())
         {
-            if (!roomUsers.contains(u.m_user))
-            {
-                // We have data on a user, but they are no longer in the room
-                continue;
-            }
-            QStringList info { u.m_user };
-            if (u.m_coffee > 0)
+            // Everyone with stats has been interned by materialize()
+            const auto it = m_stats.find(UserId::lookup(id));
+            if (it != m_stats.end())
             {
-                info << OptionalAnd {} << QString("has had %1 cups of coffee").arg(u.m_coffee);
+                here.append(it->second);
             }
-            if (u.m_tea > 0)
-            {
-                info << OptionalAnd {} << QString("has had %1 cups of tea").arg(u.m_tea);
-            }
-            if (u.m_cookie > 0)
-            {
-                info << OptionalAnd {} << QString("has %1 cookies").arg(u.m_cookie);
-            }
-            if (u.m_cookieEated > 0)
+        }
+        std::sort(here.begin(),
+                  here.end(),
+                  [](const CoffeeStats& a, const CoffeeStats& b)
+                  { return a.m_user.toString() < b.m_user.toString(); });
+
+        report_stats(bot, here);
+    }
+
+    void top(Bot* bot, int k) override
+    {
+        if (!m_indexed)
+        {
+            materialize();
+            for (const auto& [id, u] : m_stats)
             {
-                info << OptionalAnd {} << QString("has eaten %1 cookies").arg(u.m_cookieEated);
+                updateLeaderboards(u);
             }
-            info << ".";
-            bot->message(info);
+            m_indexed = true;
         }
+
+        bot->message(QStringList { "Coffee:" } << m_coffeeBoard.top(k));
+        bot->message(QStringList { "Tea:" } << m_teaBoard.top(k));
+        bot->message(QStringList { "Cookies:" } << m_cookieBoard.top(k));
     }
 
-    int cookies() const { return m_cookiejar; }
+    int cookies() const override { return m_cookiejar; }
 
-    /// @brief Give @p user a coffee; returns their coffee count
-    int coffee(const QString& user)
+    int coffee(UserId user) override
     {
-        AutoSave a(this);
         auto& c = find(user);
+        AutoSave a(this, c);
         return ++c.m_coffee;
     }
 
-    /// @brief Give @p user some tea; returns their tea count
-    int tea(const QString& user)
+    int tea(UserId user) override
     {
-        AutoSave a(this);
         auto& c = find(user);
+        AutoSave a(this, c);
         return ++c.m_tea;
     }
 
-    /// @brief Give @p user a cookie from the jar; returns true on success
-    bool giveCookie(const QString& user)
+    bool giveCookie(UserId user) override
     {
         if (m_cookiejar > 0)
         {
-            AutoSave a(this);
             auto& c = find(user);
+            AutoSave a(this, c);
             m_cookiejar--;
             c.m_cookie++;
             return true;
@@ -166,8 +374,7 @@ public:
         return false;
     }
 
-    /// @brief Give @p other one of @p user 's cookies; returns true on success
-    bool transferCookie(const QString& user, const QString& other)
+    bool transferCookie(UserId user, UserId other) override
     {
         auto& u = find(user);
         auto& o = find(other);
@@ -180,7 +387,8 @@ public:
         {
             if (u.m_cookie > 0)
             {
-                AutoSave a(this);
+                AutoSave a(this, u);
+                AutoSave b(this, o);
                 u.m_cookie--;
                 o.m_cookie++;
                 return true;
@@ -189,13 +397,12 @@ public:
         }
     }
 
-    /// @brief @p user eats a cookie; returns true on success
-    bool eatCookie(const QString& user)
+    bool eatCookie(UserId user) override
     {
         auto& u = find(user);
         if (u.m_cookie > 0)
         {
-            AutoSave a(this);
+            AutoSave a(this, u);
             u.m_cookie--;
             u.m_cookieEated++;
             return true;
@@ -209,7 +416,205 @@ public:
                          m_saveFileName);
     }
 
-    void save() const
+    /** @brief Writes a full snapshot of the stats, and removes the journals
+     *
+     * This is done synchronously, and is only needed at startup; while
+     * running, the journal is compacted in the background by compact().
+     */
+    void save()
+    {
+        QUATBOT_TRACE("FileJar::save");
+        QDir dataDir;
+        if (!findDataDir(dataDir))
+        {
+            return;
+        }
+
+        const QByteArray snapshot = saveVCurrent();
+        m_journal.close();
+        m_journalRecords = 0;
+        if (writeSnapshot(dataDir.absolutePath(), m_saveFileName, snapshot))
+        {
+            dataDir.remove(m_saveFileName + JOURNAL_SUFFIX);
+        }
+    }
+
+    void load()
+    {
+        const auto [dataDirName, saveFileName] = dataLocation();
+        QFile saveFile(dataDirName + "/" + saveFileName);
+        qDebug() << "Loading coffee stats from" << saveFile.fileName();
+        if (saveFile.exists() && saveFile.open(QIODevice::ReadOnly))
+        {
+            QDataStream d(&saveFile);
+            qint32 magic;
+            QDateTime when;
+            d >> magic;
+            if (magic != MAGIC)
+            {
+                qWarning() << "Save file" << saveFile.fileName() << "corrupt.";
+                return;
+            }
+            d >> magic;
+            if (magic == 3)
+            {
+                saveFile.close();
+                loadV3(saveFile.fileName());
+            }
+            else
+            {
+                d >> when;
+                qDebug() << "Loading save file v" << magic << "from" << when.toString();
+                switch (magic)
+                {
+                case 1:
+                    loadV1(d);
+                    break;
+                case 2:
+                    loadV2(d);
+                    break;
+                default:
+                    qWarning() << "Save file has unknown version" << magic;
+                }
+            }
+        }
+
+        // A compaction may have been interrupted, leaving the old journal
+        int replayed = replay(dataDirName + "/" + saveFileName + JOURNAL_OLD_SUFFIX);
+        replayed += replay(dataDirName + "/" + saveFileName + JOURNAL_SUFFIX);
+        if (replayed > 0)
+        {
+            qDebug() << "Replayed" << replayed << "coffee journal records.";
+            save();
+        }
+    }
+
+private:
+    /** @brief Stats for @p user, creating them if needed
+     *
+     * Users that have not changed since loading a v3 save-file are
+     * looked up in the mapped file, and copied into m_stats.
+     */
+    CoffeeStats& find(UserId user)
+    {
+        auto it = m_stats.find(user);
+        if (it == m_stats.end())
+        {
+            CoffeeStats u(user);
+            const int index = findMapped(user.toString().toUtf8());
+            if (index >= 0)
+            {
+                readMapped(index, u);
+            }
+            it = m_stats.emplace(user, u).first;
+        }
+        return it->second;
+    }
+
+    /** @brief Copies all the users from the mapped save-file into m_stats
+     *
+     * This is needed before going over all the users; after
+     * that, the mapped file is not used any more.
+     */
+    void materialize()
+    {
+        for (quint32 i = 0; i < m_mappedCount; ++i)
+        {
+            const QByteArray name = mappedName(int(i));
+            if (name.isEmpty())
+            {
+                continue;
+            }
+            const UserId user(QString::fromUtf8(name));
+            if (m_stats.count(user) == 0)  // The user may have changed already
+            {
+                CoffeeStats u(user);
+                readMapped(int(i), u);
+                m_stats.emplace(user, u);
+            }
+        }
+        m_mappedCount = 0;
+    }
+
+    /// @brief Called after @p u has changed
+    void changed(const CoffeeStats& u)
+    {
+        QUATBOT_TRACE("FileJar::changed");
+        journal(u);
+        if (m_indexed)
+        {
+            updateLeaderboards(u);
+        }
+    }
+
+    void updateLeaderboards(const CoffeeStats& u)
+    {
+        m_coffeeBoard.update(u);
+        m_teaBoard.update(u);
+        m_cookieBoard.update(u);
+    }
+
+    /// @brief Index of @p user in the mapped save-file, or -1
+    int findMapped(const QByteArray& user) const
+    {
+        quint32 low = 0;
+        quint32 high = m_mappedCount;
+        while (low < high)
+        {
+            const quint32 mid = low + (high - low) / 2;
+            const uchar* record = m_records + mid * V3_RECORD_SIZE;
+            const quint32 offset = qFromBigEndian<quint32>(record);
+            const quint32 length = qFromBigEndian<quint32>(record + 4);
+            if (quint64(offset) + length > m_namesSize)
+            {
+                qWarning() << "Save file record" << mid << "corrupt.";
+                return -1;
+            }
+            const int c = compare_name(user, m_names + offset, length);
+            if (c == 0)
+            {
+                return int(mid);
+            }
+            if (c < 0)
+            {
+                high = mid;
+            }
+            else
+            {
+                low = mid + 1;
+            }
+        }
+        return -1;
+    }
+
+    /// @brief User id (in UTF-8) of the record at @p index in the mapped save-file; empty if corrupt
+    QByteArray mappedName(int index) const
+    {
+        const uchar* record = m_records + index * V3_RECORD_SIZE;
+        const quint32 offset = qFromBigEndian<quint32>(record);
+        const quint32 length = qFromBigEndian<quint32>(record + 4);
+        if (quint64(offset) + length > m_namesSize)
+        {
+            return QByteArray();
+        }
+        return QByteArray(m_names + offset, int(length));
+    }
+
+    /// @brief Copies the counters of the record at @p index in the mapped save-file into @p u
+    void readMapped(int index, CoffeeStats& u) const
+    {
+        const uchar* record = m_records + index * V3_RECORD_SIZE;
+        u.m_coffee = qFromBigEndian<qint32>(record + 8);
+        u.m_tea = qFromBigEndian<qint32>(record + 12);
+        u.m_cookie = qFromBigEndian<qint32>(record + 16);
+        u.m_cookieEated = qFromBigEndian<qint32>(record + 20);
+    }
+
+    /// @brief (Over-)estimate of the number of users with stats
+    int userCount() const { return int(m_mappedCount + m_stats.size()); }
+
+    /// @brief Finds (and creates) the data directory; returns false if there is none
+    bool findDataDir(QDir& dataDir) const
     {
         const auto [dataDirName, saveFileName] = dataLocation();
 
@@ -221,10 +626,10 @@ public:
                 qWarning() << "Could no find an AppData location.";
                 warned = true;
             }
-            return;
+            return false;
         }
 
-        QDir dataDir(dataDirName);
+        dataDir = QDir(dataDirName);
         if (!dataDir.exists())
         {
             dataDir.mkdir(dataDirName);
@@ -237,68 +642,187 @@ public:
                 qWarning() << "Could not create AppData location" << dataDirName;
                 warned = true;
             }
-            return;
+            return false;
         }
+        return true;
+    }
 
-        if (dataDir.exists(saveFileName))
+    /** @brief Appends the current stats of @p u to the journal
+     *
+     * The journal holds complete stats for one user per record, so
+     * replaying it is just overwriting the stats from the snapshot
+     * in order. When the journal gets long, it is compacted.
+     */
+    void journal(const CoffeeStats& u)
+    {
+        if (!m_journal.isOpen())
         {
-            // The cookie-jar isn't *SO* important that I'm going to do
-            // a lot of error-handling here.
-            dataDir.rename(saveFileName, saveFileName + QStringLiteral(".old"));
+            QDir dataDir;
+            if (!findDataDir(dataDir))
+            {
+                return;
+            }
+            m_journal.setFileName(dataDir.absoluteFilePath(m_saveFileName + JOURNAL_SUFFIX));
+            if (!m_journal.open(QIODevice::WriteOnly | QIODevice::Append))
+            {
+                qWarning() << "Could not open journal" << m_journal.fileName();
+                return;
+            }
+            if (m_journal.size() == 0)
+            {
+                QDataStream d(&m_journal);
+                d << qint32(MAGIC) << qint32(JOURNAL_VERSION);
+            }
         }
 
-        QFile saveFile(dataDir.absolutePath() + "/" + saveFileName);
-        if (!saveFile.open(QIODevice::WriteOnly))
+        QDataStream d(&m_journal);
+        d << u.m_user.toString() << qint32(u.m_coffee) << qint32(u.m_tea) << qint32(u.m_cookie)
+          << qint32(u.m_cookieEated);
+        m_journal.flush();
+
+        // Compacting costs O(users), so do it once every O(users) records
+        if (++m_journalRecords > qMax(MIN_JOURNAL_RECORDS, userCount()))
         {
-            qWarning() << "Could not create save-file" << saveFile.fileName();
+            compact();
+        }
+    }
+
+    /** @brief Starts writing a snapshot in the background
+     *
+     * The records written so far are in the snapshot, so the journal
+     * is moved aside and a new one is started. Once the snapshot is
+     * written, the old journal is removed; until then it is still
+     * there to replay if the bot stops halfway. If the old journal is
+     * still there, because the last snapshot could not be written, the
+     * journal is appended to it instead.
+     */
+    void compact()
+    {
+        QUATBOT_TRACE("FileJar::compact");
+        if (m_snapshot.isRunning())
+        {
+            return;  // try again after the next record
+        }
+        QDir dataDir;
+        if (!findDataDir(dataDir))
+        {
+            return;
+        }
+
+        const QByteArray snapshot = saveVCurrent();
+
+        m_journal.close();
+        m_journalRecords = 0;
+        const QString journalName = m_saveFileName + JOURNAL_SUFFIX;
+        const QString oldJournalName = m_saveFileName + JOURNAL_OLD_SUFFIX;
+        if (dataDir.exists(oldJournalName))
+        {
+            // The last snapshot failed, so those records are in no save-file; keep them
+            if (!appendJournal(dataDir.absoluteFilePath(journalName), dataDir.absoluteFilePath(oldJournalName)))
+            {
+                return;  // the journal goes on, and this is tried again later
+            }
+            dataDir.remove(journalName);
         }
         else
         {
-            saveVCurrent(QDataStream(&saveFile));
-            saveFile.close();
+            dataDir.rename(journalName, oldJournalName);
         }
+
+        m_snapshot = QtConcurrent::run(writeSnapshot, dataDir.absolutePath(), m_saveFileName, snapshot);
     }
 
-    void load()
+    /// @brief Appends the records of journal @p fromName to journal @p toName; false if that fails
+    static bool appendJournal(const QString& fromName, const QString& toName)
     {
-        const auto [dataDirName, saveFileName] = dataLocation();
-        QFile saveFile(dataDirName + "/" + saveFileName);
-        qDebug() << "Loading coffee stats from" << saveFile.fileName();
-        if (saveFile.exists() && saveFile.open(QIODevice::ReadOnly))
+        QFile from(fromName);
+        QFile to(toName);
+        if (!from.open(QIODevice::ReadOnly) || !to.open(QIODevice::WriteOnly | QIODevice::Append))
         {
-            QDataStream d(&saveFile);
-            qint32 magic;
-            QDateTime when;
-            d >> magic;
-            if (magic != MAGIC)
-            {
-                qWarning() << "Save file" << saveFile.fileName() << "corrupt.";
-                return;
-            }
-            d >> magic >> when;
-            qDebug() << "Loading save file v" << magic << "from" << when.toString();
-            switch (magic)
-            {
-            case 1:
-                loadV1(d);
-                break;
-            case 2:
-                loadV2(d);
-                break;
-            default:
-                qWarning() << "Save file has unknown version" << magic;
-            }
+            qWarning() << "Could not move journal" << fromName << "to" << toName;
+            return false;
         }
+        // Both start with the same header
+        const QByteArray records = from.readAll().mid(2 * sizeof(qint32));
+        if (to.write(records) != records.size() || !to.flush())
+        {
+            qWarning() << "Could not move journal" << fromName << "to" << toName;
+            return false;
+        }
+        return true;
     }
 
-private:
-    CoffeeStats& find(const QString& user)
+    /** @brief Writes @p snapshot as the save-file @p saveFileName in @p dataDirName
+     *
+     * The previous save-file is kept as `.old`. Once the new one is
+     * in place, the old journal is removed. This is called from a
+     * worker thread, so it must not touch any FileJar. Returns true
+     * if the snapshot was written.
+     */
+    static bool writeSnapshot(const QString& dataDirName, const QString& saveFileName, const QByteArray& snapshot)
     {
-        if (!m_stats.contains(user))
+        QUATBOT_TRACE_DETAIL("FileJar::writeSnapshot", saveFileName);
+        QDir dataDir(dataDirName);
+        const QString newFileName = saveFileName + QStringLiteral(".new");
+
+        QFile saveFile(dataDir.absoluteFilePath(newFileName));
+        if (!saveFile.open(QIODevice::WriteOnly) || (saveFile.write(snapshot) != snapshot.size()))
         {
-            m_stats.insert(user, CoffeeStats(user));
+            qWarning() << "Could not create save-file" << saveFile.fileName();
+            return false;
         }
-        return m_stats[user];
+        saveFile.close();
+
+        // The cookie-jar isn't *SO* important that I'm going to do
+        // a lot of error-handling here.
+        dataDir.remove(saveFileName + QStringLiteral(".old"));
+        if (dataDir.exists(saveFileName))
+        {
+            dataDir.rename(saveFileName, saveFileName + QStringLiteral(".old"));
+        }
+        dataDir.rename(newFileName, saveFileName);
+        dataDir.remove(saveFileName + JOURNAL_OLD_SUFFIX);
+        return true;
+    }
+
+    /// @brief Applies the records in journal @p fileName; returns how many there were
+    int replay(const QString& fileName)
+    {
+        QFile journalFile(fileName);
+        if (!journalFile.exists() || !journalFile.open(QIODevice::ReadOnly))
+        {
+            return 0;
+        }
+
+        QDataStream d(&journalFile);
+        qint32 magic, version;
+        d >> magic >> version;
+        if ((magic != MAGIC) || (version != JOURNAL_VERSION))
+        {
+            qWarning() << "Journal" << fileName << "corrupt.";
+            return 0;
+        }
+
+        int count = 0;
+        QString user;
+        qint32 coffee, tea, cookie, eated;
+        while (!d.atEnd())
+        {
+            d >> user >> coffee >> tea >> cookie >> eated;
+            if (d.status() != QDataStream::Ok)
+            {
+                // Probably the bot stopped while writing the last record
+                qWarning() << "Journal" << fileName << "has a truncated record.";
+                break;
+            }
+            auto& u = find(UserId(user));
+            u.m_coffee = coffee;
+            u.m_tea = tea;
+            u.m_cookie = cookie;
+            u.m_cookieEated = eated;
+            count++;
+        }
+        return count;
     }
 
     /// @brief Replenish the cookiejar
@@ -310,20 +834,100 @@ private:
         }
     }
 
-    void saveVCurrent(QDataStream d) const
+    /// @brief Serializes all the stats as a v3 save-file
+    QByteArray saveVCurrent() const
     {
-        d << qint32(MAGIC);  // Coffee!
-        d << qint32(2);  // Version 2
-        d << QDateTime::currentDateTime();  // When?
+        struct Named
+        {
+            QByteArray name;
+            CoffeeStats stats;
+        };
+        // Users only in the mapped file are copied by name, so they are not interned
+        QVector<Named> users;
+        users.reserve(userCount());
+        QSet<QByteArray> changed;
+        int namesSize = 0;
+        for (const auto& [id, u] : m_stats)
+        {
+            users.append({ id.toString().toUtf8(), u });
+            changed.insert(users.last().name);
+            namesSize += users.last().name.size();
+        }
+        for (quint32 i = 0; i < m_mappedCount; ++i)
+        {
+            Named n { mappedName(int(i)), CoffeeStats() };
+            if (!n.name.isEmpty() && !changed.contains(n.name))
+            {
+                readMapped(int(i), n.stats);
+                namesSize += n.name.size();
+                users.append(n);
+            }
+        }
+        std::sort(users.begin(),
+                  users.end(),
+                  [](const Named& a, const Named& b)
+                  { return compare_name(a.name, b.name.constData(), quint32(b.name.size())) < 0; });
+
+        const int namesStart = V3_HEADER_SIZE + users.count() * V3_RECORD_SIZE;
+        QByteArray data(namesStart + namesSize, '\0');
+        uchar* p = reinterpret_cast<uchar*>(data.data());
+        qToBigEndian<qint32>(MAGIC, p);  // Coffee!
+        qToBigEndian<qint32>(3, p + 4);  // Version 3
+        qToBigEndian<qint64>(Clock::instance()->msecsSinceEpoch(), p + 8);  // When?
+        qToBigEndian<quint32>(quint32(users.count()), p + 16);
+        qToBigEndian<quint32>(quint32(namesSize), p + 20);
+
+        uchar* record = p + V3_HEADER_SIZE;
+        quint32 offset = 0;
+        for (const auto& [name, u] : users)
+        {
+            qToBigEndian<quint32>(offset, record);
+            qToBigEndian<quint32>(quint32(name.size()), record + 4);
+            qToBigEndian<qint32>(u.m_coffee, record + 8);
+            qToBigEndian<qint32>(u.m_tea, record + 12);
+            qToBigEndian<qint32>(u.m_cookie, record + 16);
+            qToBigEndian<qint32>(u.m_cookieEated, record + 20);
+            memcpy(p + namesStart + offset, name.constData(), size_t(name.size()));
+            offset += quint32(name.size());
+            record += V3_RECORD_SIZE;
+        }
+        return data;
+    }
+
+    /** @brief Maps the v3 save-file @p fileName
+     *
+     * Only the header is checked; records are read when they are
+     * needed, see find().
+     */
+    void loadV3(const QString& fileName)
+    {
+        m_mapped.setFileName(fileName);
+        const qint64 size = m_mapped.size();
+        const uchar* p = nullptr;
+        if ((size >= V3_HEADER_SIZE) && m_mapped.open(QIODevice::ReadOnly))
+        {
+            p = m_mapped.map(0, size);
+        }
+        if (!p)
+        {
+            qWarning() << "Could not map save file" << fileName;
+            return;
+        }
 
-        d << qint32(m_stats.count());  // Number of elements
-        for (const auto& u : m_stats)
+        const quint32 count = qFromBigEndian<quint32>(p + 16);
+        const quint32 namesSize = qFromBigEndian<quint32>(p + 20);
+        if (V3_HEADER_SIZE + qint64(count) * V3_RECORD_SIZE + namesSize != size)
         {
-            d << u.m_user << qint32(u.m_coffee) << qint32(u.m_tea) << qint32(u.m_cookie) << qint32(u.m_cookieEated);
+            qWarning() << "Save file" << fileName << "corrupt.";
+            return;
         }
+        qDebug() << "Loading save file v3 from"
+                 << QDateTime::fromMSecsSinceEpoch(qFromBigEndian<qint64>(p + 8)).toString() << count << "users";
 
-        d << qint32(0) << qint32(MAGIC);
-        d << QString("Koffiepot");
+        m_records = p + V3_HEADER_SIZE;
+        m_names = reinterpret_cast<const char*>(m_records + count * V3_RECORD_SIZE);
+        m_namesSize = namesSize;
+        m_mappedCount = count;
     }
 
     void loadV1(QDataStream& d)
@@ -334,7 +938,7 @@ private:
         qint32 coffee, cookie, eated;
 
         d >> count;
-        if ((count < 1) || (count > 1000))
+        if (count < 1)
         {
             qWarning() << "Unreasonable coffee-count" << count;
             return;
@@ -343,7 +947,12 @@ private:
         while (count > 0)
         {
             d >> user >> coffee >> cookie >> eated;
-            auto& u = find(user);
+            if (d.status() != QDataStream::Ok)
+            {
+                qWarning() << "Save file truncated," << count << "users missing.";
+                return;
+            }
+            auto& u = find(UserId(user));
             u.m_coffee = coffee;
             u.m_tea = 0;  // There was no tea in V1
             u.m_cookie = cookie;
@@ -363,7 +972,7 @@ private:
         qint32 coffee, tea, cookie, eated;
 
         d >> count;
-        if ((count < 1) || (count > 1000))
+        if (count < 1)
         {
             qWarning() << "Unreasonable coffee-count" << count;
             return;
@@ -372,7 +981,12 @@ private:
         while (count > 0)
         {
             d >> user >> coffee >> tea >> cookie >> eated;
-            auto& u = find(user);
+            if (d.status() != QDataStream::Ok)
+            {
+                qWarning() << "Save file truncated," << count << "users missing.";
+                return;
+            }
+            auto& u = find(UserId(user));
             u.m_coffee = coffee;
             u.m_tea = tea;
             u.m_cookie = cookie;
@@ -385,15 +999,359 @@ private:
     }
 
     int m_cookiejar = 12;  // a dozen cookies by default
-    QMap<QString, CoffeeStats> m_stats;
-    QTimer m_refill;
+    // This must be node-based, since references into it are kept
+    std::unordered_map<UserId, CoffeeStats> m_stats;
+    Leaderboard m_coffeeBoard { &CoffeeStats::m_coffee };
+    Leaderboard m_teaBoard { &CoffeeStats::m_tea };
+    Leaderboard m_cookieBoard { &CoffeeStats::m_cookie };
+    bool m_indexed = false;  // are the leaderboards filled?
+    WheelTimer m_refill { [this]() { this->addCookie(); } };
     const QString m_saveFileName;  // based on room name
+
+    QFile m_journal;
+    int m_journalRecords = 0;  // since the last snapshot
+    QFuture<void> m_snapshot;
+
+    // The v3 save-file, if any; users that change are copied to m_stats
+    QFile m_mapped;
+    const uchar* m_records = nullptr;
+    const char* m_names = nullptr;
+    quint32 m_namesSize = 0;
+    quint32 m_mappedCount = 0;
 };
 
+/** @brief The database behind SharedJar, one per process
+ *
+ * This is an SQLite database in WAL mode, in the same place as the
+ * per-room files. Changes are batched: they go into an open transaction,
+ * which is committed once enough changes have piled up, or after a second.
+ * Refilling the jars is done here too, for all rooms at once.
+ */
+class SharedCoffeeDatabase
+{
+public:
+    /// @brief The shared database, or nullptr if there is none
+    static SharedCoffeeDatabase*& instance()
+    {
+        static SharedCoffeeDatabase* db = nullptr;
+        return db;
+    }
+
+    /// @brief Saves and closes the shared database, if there is one; no jars may use it afterwards
+    static void shutdown()
+    {
+        auto*& db = instance();
+        delete db;
+        db = nullptr;
+        // The connection is only released once no QSqlDatabase refers to it
+        QSqlDatabase::removeDatabase(CONNECTION_NAME);
+    }
+
+    SharedCoffeeDatabase(const QString& fileName, bool globalStats)
+        : m_db(QSqlDatabase::addDatabase(QStringLiteral("QSQLITE"), CONNECTION_NAME))
+        , m_globalStats(globalStats)
+    {
+        m_db.setDatabaseName(fileName);
+        if (!m_db.open())
+        {
+            qWarning() << "Could not open shared cookie-jar" << fileName << m_db.lastError().text();
+            return;
+        }
+        qDebug() << "Using shared cookie-jar" << fileName;
+
+        QSqlQuery q(m_db);
+        for (const char* sql : {
+                 "PRAGMA journal_mode=WAL",
+                 "PRAGMA synchronous=NORMAL",
+                 "CREATE TABLE IF NOT EXISTS jars (room TEXT PRIMARY KEY, cookies INTEGER NOT NULL)",
+                 "CREATE TABLE IF NOT EXISTS stats (room TEXT NOT NULL, user TEXT NOT NULL, "
+                 "coffee INTEGER NOT NULL DEFAULT 0, tea INTEGER NOT NULL DEFAULT 0, "
+                 "cookie INTEGER NOT NULL DEFAULT 0, eaten INTEGER NOT NULL DEFAULT 0, "
+                 "PRIMARY KEY (room, user)) WITHOUT ROWID",
+                 "CREATE INDEX IF NOT EXISTS stats_coffee ON stats (room, coffee)",
+                 "CREATE INDEX IF NOT EXISTS stats_tea ON stats (room, tea)",
+                 "CREATE INDEX IF NOT EXISTS stats_cookie ON stats (room, cookie)",
+             })
+        {
+            if (!q.exec(QString::fromLatin1(sql)))
+            {
+                qWarning() << "Could not set up shared cookie-jar:" << q.lastError().text();
+                m_db.close();
+                return;
+            }
+        }
+
+        m_commit.setSingleShot(true);
+        m_refill.start(3579100);  // every hour, -ish
+    }
+
+    ~SharedCoffeeDatabase()
+    {
+        commit();
+        m_queries.clear();
+        m_db.close();
+    }
+
+    bool isValid() const { return m_db.isOpen(); }
+    /// @brief Are stats shared by all rooms (or per room, like the jars)?
+    bool globalStats() const { return m_globalStats; }
+
+    /// @brief A prepared query for @p sql; these are kept for re-use
+    QSqlQuery& query(const QString& sql)
+    {
+        auto it = m_queries.find(sql);
+        if (it == m_queries.end())
+        {
+            it = m_queries.insert(sql, QSqlQuery(m_db));
+            if (!it->prepare(sql))
+            {
+                qWarning() << "Could not prepare" << sql << it->lastError().text();
+            }
+        }
+        return it.value();
+    }
+
+    /// @brief Runs a reading query @p q; returns false on error
+    bool read(QSqlQuery& q)
+    {
+        if (!q.exec())
+        {
+            qWarning() << "Cookie-jar query failed:" << q.lastError().text();
+            return false;
+        }
+        return true;
+    }
+
+    /// @brief Runs a changing query @p q, as part of the current batch
+    bool change(QSqlQuery& q)
+    {
+        if (m_pending == 0)
+        {
+            m_db.transaction();
+            m_commit.start(1000);
+        }
+        const bool ok = read(q);
+        if (++m_pending >= MAX_BATCH)
+        {
+            commit();
+        }
+        return ok;
+    }
+
+    void commit()
+    {
+        QUATBOT_TRACE("SharedCoffeeDatabase::commit");
+        if (m_pending > 0)
+        {
+            m_commit.stop();
+            m_pending = 0;
+            if (!m_db.commit())
+            {
+                qWarning() << "Could not save shared cookie-jar:" << m_db.lastError().text();
+            }
+        }
+    }
+
+    static constexpr const int FULL_JAR = 12;
+
+private:
+    /// @brief Replenish all the cookiejars
+    void addCookies()
+    {
+        auto& q = query(QStringLiteral("UPDATE jars SET cookies = cookies + 1 WHERE cookies < ?"));
+        q.bindValue(0, FULL_JAR);
+        change(q);
+    }
+
+    /// Commit after this many changes, even if the timer has not expired
+    static constexpr const int MAX_BATCH = 100;
+    static constexpr const char* CONNECTION_NAME = "quatbot-coffee";
+
+    QSqlDatabase m_db;
+    QHash<QString, QSqlQuery> m_queries;
+    WheelTimer m_commit { [this]() { this->commit(); } };
+    WheelTimer m_refill { [this]() { this->addCookies(); } };
+    int m_pending = 0;  // changes in the open transaction
+    bool m_globalStats;
+};
+
+/// @brief Cookie-jar and stats for one room, stored in the SharedCoffeeDatabase
+class SharedJar : public Coffee::Private
+{
+public:
+    SharedJar(SharedCoffeeDatabase& db, const QString& roomName)
+        : m_db(db)
+        , m_room(roomName)
+        , m_statsRoom(db.globalStats() ? QStringLiteral("*") : roomName)
+    {
+        auto& q = m_db.query(QStringLiteral("INSERT OR IGNORE INTO jars (room, cookies) VALUES (?, ?)"));
+        q.bindValue(0, m_room);
+        q.bindValue(1, SharedCoffeeDatabase::FULL_JAR);
+        m_db.change(q);
+    }
+
+    int cookies() const override
+    {
+        auto& q = m_db.query(QStringLiteral("SELECT cookies FROM jars WHERE room = ?"));
+        q.bindValue(0, m_room);
+        return m_db.read(q) && q.next() ? q.value(0).toInt() : 0;
+    }
+
+    int coffee(UserId user) override { return increment(QStringLiteral("coffee"), user); }
+    int tea(UserId user) override { return increment(QStringLiteral("tea"), user); }
+
+    bool giveCookie(UserId user) override
+    {
+        auto& q = m_db.query(QStringLiteral("UPDATE jars SET cookies = cookies - 1 WHERE room = ? AND cookies > 0"));
+        q.bindValue(0, m_room);
+        if (!m_db.change(q) || (q.numRowsAffected() < 1))
+        {
+            return false;
+        }
+        increment(QStringLiteral("cookie"), user);
+        return true;
+    }
+
+    bool transferCookie(UserId user, UserId other) override
+    {
+        if (user == other)
+        {
+            return true;  // zero-sum
+        }
+        auto& q = m_db.query(
+            QStringLiteral("UPDATE stats SET cookie = cookie - 1 WHERE room = ? AND user = ? AND cookie > 0"));
+        q.bindValue(0, m_statsRoom);
+        q.bindValue(1, user.toString());
+        if (!m_db.change(q) || (q.numRowsAffected() < 1))
+        {
+            return false;
+        }
+        increment(QStringLiteral("cookie"), other);
+        return true;
+    }
+
+    bool eatCookie(UserId user) override
+    {
+        auto& q = m_db.query(QStringLiteral(
+            "UPDATE stats SET cookie = cookie - 1, eaten = eaten + 1 WHERE room = ? AND user = ? AND cookie > 0"));
+        q.bindValue(0, m_statsRoom);
+        q.bindValue(1, user.toString());
+        return m_db.change(q) && (q.numRowsAffected() > 0);
+    }
+
+    void stats(Bot* bot) override
+    {
+        const auto ids = bot->userIds();
+        const QSet<QString> roomUsers(ids.begin(), ids.end());
+
+        auto& q = m_db.query(
+            QStringLiteral("SELECT user, coffee, tea, cookie, eaten FROM stats WHERE room = ? ORDER BY user"));
+        q.bindValue(0, m_statsRoom);
+        QList<CoffeeStats> here;
+        if (m_db.read(q))
+        {
+            while (q.next())
+            {
+                const QString user = q.value(0).toString();
+                if (roomUsers.contains(user))
+                {
+                    CoffeeStats u(UserId { user });
+                    u.m_coffee = q.value(1).toInt();
+                    u.m_tea = q.value(2).toInt();
+                    u.m_cookie = q.value(3).toInt();
+                    u.m_cookieEated = q.value(4).toInt();
+                    here.append(u);
+                }
+            }
+        }
+        report_stats(bot, here);
+    }
+
+    void top(Bot* bot, int k) override
+    {
+        bot->message(QStringList { "Coffee:" } << top(QStringLiteral("coffee"), k));
+        bot->message(QStringList { "Tea:" } << top(QStringLiteral("tea"), k));
+        bot->message(QStringList { "Cookies:" } << top(QStringLiteral("cookie"), k));
+    }
+
+private:
+    /// @brief Adds one to @p column for @p user; returns the new value
+    int increment(const QString& column, UserId user)
+    {
+        auto& q = m_db.query(QStringLiteral("INSERT INTO stats (room, user, %1) VALUES (?, ?, 1) "
+                                            "ON CONFLICT (room, user) DO UPDATE SET %1 = %1 + 1")
+                                 .arg(column));
+        q.bindValue(0, m_statsRoom);
+        q.bindValue(1, user.toString());
+        m_db.change(q);
+
+        auto& value = m_db.query(QStringLiteral("SELECT %1 FROM stats WHERE room = ? AND user = ?").arg(column));
+        value.bindValue(0, m_statsRoom);
+        value.bindValue(1, user.toString());
+        return m_db.read(value) && value.next() ? value.value(0).toInt() : 0;
+    }
+
+    /// @brief The first @p k users by @p column, formatted as "user (count)"
+    QStringList top(const QString& column, int k)
+    {
+        auto& q = m_db.query(
+            QStringLiteral("SELECT user, %1 FROM stats WHERE room = ? AND %1 > 0 ORDER BY %1 DESC, user LIMIT ?")
+                .arg(column));
+        q.bindValue(0, m_statsRoom);
+        q.bindValue(1, k);
+        QStringList l;
+        if (m_db.read(q))
+        {
+            while (q.next())
+            {
+                l << QString("%1 (%2)").arg(q.value(0).toString()).arg(q.value(1).toInt());
+            }
+        }
+        return l;
+    }
+
+    SharedCoffeeDatabase& m_db;
+    const QString m_room;  // for the jar
+    const QString m_statsRoom;  // for the stats, "*" if they are global
+};
+
+void Coffee::setSharedStore(bool globalStats)
+{
+    auto*& db = SharedCoffeeDatabase::instance();
+    if (db)
+    {
+        return;
+    }
+
+    const QString dataDirName = QStandardPaths::writableLocation(QStandardPaths::StandardLocation::AppDataLocation);
+    if (dataDirName.isEmpty() || !QDir().mkpath(dataDirName))
+    {
+        qWarning() << "Could not find an AppData location for the shared cookie-jar.";
+        return;
+    }
+    db = new SharedCoffeeDatabase(QDir(dataDirName).absoluteFilePath(QStringLiteral("cookiejar.sqlite")), globalStats);
+    if (!db->isValid())
+    {
+        SharedCoffeeDatabase::shutdown();
+        return;
+    }
+    // Commits the last batch; the event loop is done, so no jar changes after this
+    QObject::connect(qApp, &QCoreApplication::aboutToQuit, []() { SharedCoffeeDatabase::shutdown(); });
+}
+
+static Coffee::Private* make_jar(const QString& roomName)
+{
+    auto* db = SharedCoffeeDatabase::instance();
+    if (db)
+    {
+        return new SharedJar(*db, roomName);
+    }
+    return new FileJar(roomName);
+}
 
 Coffee::Coffee(Bot* parent)
     : Watcher(parent)
-    , d(new Private(parent->botRoom()))
+    , d(make_jar(parent->botRoom()))
 {
 }
 
@@ -414,12 +1372,12 @@ const QStringList& Coffee::moduleCommands() const
         "coffee", "cookie", "lart",
         "stats",  // long status
         "status",  // brief status
-        "tea",
+        "tea",    "top",
     };
     return commands;
 }
 
-void Coffee::handleMessage(const Quotient::RoomMessageEvent*) {}
+void Coffee::handleMessage(const MessageEnvelope&) {}
 
 void Coffee::handleCookieCommand(const CommandArgs& cmd)
 {
@@ -428,7 +1386,7 @@ void Coffee::handleCookieCommand(const CommandArgs& cmd)
         // Empty is when you just go ~cookie
         if (d->eatCookie(cmd.user))
         {
-            message(QString("**%1** nom nom nom").arg(cmd.user));
+            message(QString("**%1** nom nom nom").arg(cmd.user.toString()));
         }
         else
         {
@@ -439,26 +1397,27 @@ void Coffee::handleCookieCommand(const CommandArgs& cmd)
     {
         const auto& realUsers = m_bot->userIds();
 
-        for (const auto& other : m_bot->userLookup(cmd.args))
+        for (const auto& name : m_bot->userLookup(cmd.args))
         {
-            if (!realUsers.contains(other))
+            if (!realUsers.contains(name))
             {
-                message(QString("%1 is not here.").arg(other));
+                message(QString("%1 is not here.").arg(name));
                 continue;
             }
+            const UserId other(name);
             if (other == cmd.user)
             {
                 message("It's a circular economy.");
             }
             else if (d->transferCookie(cmd.user, other))
             {
-                message(QString("**%1** gives %2 a cookie.").arg(cmd.user, other));
+                message(QString("**%1** gives %2 a cookie.").arg(cmd.user.toString(), name));
             }
             else
             {
                 if (d->giveCookie(other))
                 {
-                    message(QString("%2 gets a cookie from the jar.").arg(other));
+                    message(QString("%2 gets a cookie from the jar.").arg(name));
                 }
                 else
                 {
@@ -503,22 +1462,36 @@ void Coffee::handleCommand(const CommandArgs& cmd)
     {
         if (d->coffee(cmd.user) <= 1)
         {
-            message(QStringList { cmd.user, "is now a coffee drinker." });
+            message(QStringList { cmd.user.toString(), "is now a coffee drinker." });
         }
         else
         {
-            message(QStringList { cmd.user, "has a nice cup of coffee." });
+            message(QStringList { cmd.user.toString(), "has a nice cup of coffee." });
+        }
+    }
+    else if (cmd.command == QStringLiteral("top"))
+    {
+        int k = 5;
+        if (!cmd.args.isEmpty())
+        {
+            bool ok = false;
+            const int new_k = cmd.args[0].toInt(&ok);
+            if (ok)
+            {
+                k = qBound(1, new_k, MAX_STATS_USERS);
+            }
         }
+        d->top(m_bot, k);
     }
     else if (cmd.command == QStringLiteral("lart"))
     {
-        message(QString("%1 is eaten by a large trout.").arg(cmd.user));
+        message(QString("%1 is eaten by a large trout.").arg(cmd.user.toString()));
     }
     else if (cmd.command == QStringLiteral("tea"))
     {
         if (d->tea(cmd.user) <= 1)
         {
-            message(QStringList { cmd.user, "subscribes to Professor Elemental's newsletter." });
+            message(QStringList { cmd.user.toString(), "subscribes to Professor Elemental's newsletter." });
         }
         else
         {
@@ -24,18 +24,29 @@ namespace QuatBot
  */
 class Coffee : public Watcher
 {
+public:
+    /// @brief Storage for the cookie-jar, see coffee.cpp
     class Private;
 
-public:
     Coffee(Bot* parent);
     virtual ~Coffee() override;
 
     const QString& moduleName() const override;
     const QStringList& moduleCommands() const override;
 
-    virtual void handleMessage(const Quotient::RoomMessageEvent*) override;
+    virtual void handleMessage(const MessageEnvelope&) override;
     virtual void handleCommand(const CommandArgs&) override;
 
+    /** @brief Keep the cookie-jars of all rooms in one database
+     *
+     * By default, each room has its own cookie-jar file. Call this
+     * before creating any bots to use a single database for all the
+     * rooms in this process instead. With @p globalStats set, the
+     * coffee, tea and cookies of a user are counted across all rooms
+     * (each room still has its own jar).
+     */
+    static void setSharedStore(bool globalStats);
+
 protected:
     void handleCookieCommand(const CommandArgs&);
     bool handleMissingVerb(const CommandArgs&);
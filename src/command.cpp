@@ -7,61 +7,95 @@
 
 #include "command.h"
 
+#include "clock.h"
+#ifdef ENABLE_COWSAY
+#include "cowsay.h"
+#endif
+#include "envelope.h"
+#include "fortune.h"
+#include "lagmonitor.h"
+#include "process.h"
 #include "quatbot.h"
+#include "supervisor.h"
+#include "timerwheel.h"
+#ifdef ENABLE_TRACING
+#include "trace.h"
+#endif
 
 #include <room.h>
 
-#include <QProcess>
-#include <QTimer>
+#include <QDateTime>
+#include <QPointer>
+
+#include <atomic>
 
 namespace QuatBot
 {
-static QString runProcess(const QString& executable, const QStringList& args, const QString& failure)
+/** @brief Runs @p executable and sends its output to the room of @p bot
+ *
+ * This does not wait for the program: the output is sent (and flushed)
+ * when the program exits. If the bot goes away in the meantime, the
+ * output is dropped. The program is run from the bot's thread, see
+ * Bot::context(), which is also where the output arrives.
+ */
+static void runProcess(Bot* bot, const QString& executable, const QStringList& args, const QString& failure)
 {
-    QProcess f;
-    f.start(executable, args);
-    f.waitForFinished();
-    if (f.exitCode() == 0)
+    QPointer<QObject> context(bot->context());
+    auto reply = [bot, context](const QString& output)
     {
-        return QString::fromLatin1(f.readAllStandardOutput());
+        if (context)
+        {
+            bot->message(output);
+            bot->message(Bot::Flush {});
+        }
+    };
+    if (!ProcessRunner::instance()->run(executable, args, failure, reply))
+    {
+        bot->message(QStringLiteral("I'm too busy for that right now."));
     }
-    else
-        return failure;
 }
 
-static QString fortune()
+static void fortune(Bot* bot)
 {
-    return runProcess(QStringLiteral("/usr/bin/fortune"), { "freebsd-tips" }, QStringLiteral("No fortune for you!"));
+    const auto& db = FortuneDatabase::instance();
+    if (db.isValid())
+    {
+        bot->message(db.randomFortune());
+    }
+    else
+    {
+        runProcess(bot, QStringLiteral("/usr/bin/fortune"), { "freebsd-tips" }, QStringLiteral("No fortune for you!"));
+    }
 }
 
 #ifdef ENABLE_COWSAY
 // Copy because we modify the string
-static QString cowsay(QString message)
+static QString cowsayCommand(QString message)
 {
     message = message.simplified();
-    message.truncate(40);
+    message.truncate(160);
     if (message.isEmpty())
         return QStringLiteral("ix-nay on the oo-may");
 
-    static int instance = 0;
-    static const char* const specials[16] = { nullptr, nullptr, "-d",    nullptr, nullptr, nullptr, "-s", "-p",
-                                              nullptr, "-y",    nullptr, "-g",    "-w",    "-t",    "-b", nullptr };
+    static std::atomic<int> instance { 0 };  // bots in worker threads run this concurrently
+    static const CowMode specials[16] = {
+        CowMode::Normal, CowMode::Normal,   CowMode::Dead,   CowMode::Normal,   CowMode::Normal, CowMode::Normal,
+        CowMode::Stoned, CowMode::Paranoid, CowMode::Normal, CowMode::Youthful, CowMode::Normal, CowMode::Greedy,
+        CowMode::Wired,  CowMode::Tired,    CowMode::Borg,   CowMode::Normal
+    };
 
-    QStringList arg;
     // Go around and around mod 16
-    if (specials[instance])
-        arg << specials[instance];
-    instance = (instance + 1) & 0xf;
-    // The message
-    arg << message;
+    const CowMode mode = specials[instance++ & 0xf];
 
-    return runProcess(QStringLiteral("/usr/local/bin/cowsay"), arg, "Moo!");
+    return cowsay(message, mode);
 }
 #endif
 
 BasicCommands::BasicCommands(Bot* parent)
     : Watcher(parent)
 {
+    // Load the fortunes now, rather than on the first ~fortune
+    (void)FortuneDatabase::instance();
 }
 
 BasicCommands::~BasicCommands() {}
@@ -78,7 +112,10 @@ const QStringList& BasicCommands::moduleCommands() const
 #ifdef ENABLE_COWSAY
                                         "cowsay",
 #endif
-                                        "ops",    "help",    "status", "quit" };
+#ifdef ENABLE_TRACING
+                                        "trace",
+#endif
+                                        "ops",    "help",    "status", "latency", "quit" };
     return commands;
 }
 
@@ -96,12 +133,12 @@ void BasicCommands::handleCommand(const CommandArgs& l)
     }
     else if (l.command == QStringLiteral("fortune"))
     {
-        message(fortune());
+        fortune(m_bot);
     }
 #ifdef ENABLE_COWSAY
     else if (l.command == QStringLiteral("cowsay"))
     {
-        message(cowsay(l.args.join(' ')));
+        message(cowsayCommand(l.args.join(' ')));
     }
 #endif
     else if (l.command == QStringLiteral("ops"))
@@ -112,8 +149,12 @@ void BasicCommands::handleCommand(const CommandArgs& l)
         }
         else if ((l.args[0] == "?") || (l.args[0] == "status"))
         {
-            message(QStringList { QString("There are %1 operators.").arg(m_bot->m_operators.count()) }
-                    << m_bot->m_operators.values());
+            QStringList ops { QString("There are %1 operators.").arg(m_bot->m_operators.count()) };
+            for (const auto& user : m_bot->m_operators)
+            {
+                ops << user.toString();
+            }
+            message(ops);
         }
         else if ((l.args[0] == "+") || (l.args[0] == "add") || (l.args[0] == "op"))
         {
@@ -128,11 +169,20 @@ void BasicCommands::handleCommand(const CommandArgs& l)
             message(OpsUsage {});
         }
     }
+#ifdef ENABLE_TRACING
+    else if (l.command == QStringLiteral("trace"))
+    {
+        if (m_bot->checkOps(l))
+        {
+            traceCommand(l);
+        }
+    }
+#endif
     else if (l.command == QStringLiteral("quit"))
     {
         if (m_bot->checkOps(l))
         {
-            QTimer::singleShot(1000, m_bot, &QObject::deleteLater);
+            TimerWheel::singleShot(1000, m_bot->context(), [bot = m_bot]() { bot->deleteLater(); });
             message(QString("Goodbye (bot operation terminated)!"));
         }
     }
@@ -140,10 +190,17 @@ void BasicCommands::handleCommand(const CommandArgs& l)
     {
         message(QString("(quatbot) It is %1. Your message was sent at %2. (Time UTC) "
                         "I can see %3 people in the room. I have processed %4 messages and %5 commands.")
-                    .arg(QDateTime::currentDateTimeUtc().toString(), m_lastMessageTime.toString())
+                    .arg(Clock::instance()->currentDateTimeUtc().toString(),
+                         QDateTime::fromMSecsSinceEpoch(m_lastMessageTime, Qt::UTC).time().toString())
                     .arg(m_bot->userIds().count())
                     .arg(m_messageCount)
                     .arg(m_commandCount));
+        message(LagMonitor::instance()->summary());
+        const QString cluster = ShardWorker::clusterStatus();
+        if (!cluster.isEmpty())
+        {
+            message(cluster);
+        }
         for (const auto& w : m_bot->watcherNames())
         {
             auto* watcher = m_bot->getWatcher(w);
@@ -153,6 +210,22 @@ void BasicCommands::handleCommand(const CommandArgs& l)
             }
         }
     }
+    else if (l.command == QStringLiteral("latency"))
+    {
+        const QStringList lines = LatencyTracker::report(l.args.isEmpty() ? QString() : l.args.constFirst());
+        if (lines.isEmpty())
+        {
+            message(QStringLiteral("No command latencies yet."));
+        }
+        else
+        {
+            message(QStringLiteral("Command latency, p50/p99 in ms (count):"));
+            for (const auto& line : lines)
+            {
+                message(line);
+            }
+        }
+    }
     else if (l.command == QStringLiteral("help"))
     {
         if (l.args.isEmpty())
@@ -180,9 +253,9 @@ void BasicCommands::handleCommand(const CommandArgs& l)
     m_commandCount++;
 }
 
-void QuatBot::BasicCommands::handleMessage(const Quotient::RoomMessageEvent* event)
+void QuatBot::BasicCommands::handleMessage(const MessageEnvelope& e)
 {
-    m_lastMessageTime = event->originTimestamp().time();
+    m_lastMessageTime = e.timestamp();
     m_messageCount++;
 }
 
@@ -227,6 +300,33 @@ void BasicCommands::opsChange(const CommandArgs& cmd, bool enable)
     }
 }
 
+#ifdef ENABLE_TRACING
+void BasicCommands::traceCommand(const CommandArgs& cmd)
+{
+    const QString sub = cmd.args.isEmpty() ? QString() : cmd.args.constFirst();
+    if (sub == QStringLiteral("on"))
+    {
+        Trace::setEnabled(true);
+        message(QStringLiteral("Tracing is on."));
+    }
+    else if (sub == QStringLiteral("off"))
+    {
+        Trace::setEnabled(false);
+        message(QStringLiteral("Tracing is off."));
+    }
+    else if (sub == QStringLiteral("dump"))
+    {
+        const QString fileName = Trace::dump();
+        message(fileName.isEmpty() ? QStringLiteral("Could not write the trace.")
+                                   : QString("Trace written to %1.").arg(fileName));
+    }
+    else
+    {
+        message(QString("Usage: %1 trace <on|off|dump>").arg(displayCommand()));
+    }
+}
+#endif
+
 void BasicCommands::message(OpsUsage)
 {
     message(QString("Usage: %1 ops status").arg(displayCommand()));
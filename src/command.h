@@ -10,8 +10,6 @@
 
 #include "watcher.h"
 
-#include <QTime>
-
 namespace QuatBot
 {
 class BasicCommands : public Watcher
@@ -23,7 +21,7 @@ public:
     const QString& moduleName() const override;
     const QStringList& moduleCommands() const override;
 
-    virtual void handleMessage(const Quotient::RoomMessageEvent*) override;
+    virtual void handleMessage(const MessageEnvelope&) override;
     virtual void handleCommand(const CommandArgs&) override;
 
 protected:
@@ -37,8 +35,12 @@ protected:
 private:
     /// @brief Set or unset ops mode for the named users.
     void opsChange(const CommandArgs&, bool enable);
+#ifdef ENABLE_TRACING
+    /// @brief Switch tracing on or off, or dump the trace.
+    void traceCommand(const CommandArgs&);
+#endif
 
-    QTime m_lastMessageTime;
+    qint64 m_lastMessageTime = 0;  ///< origin of the last message, in msecs since the epoch
     int m_messageCount = 0;
     int m_commandCount = 0;
 };
@@ -0,0 +1,276 @@
+/*
+ *  SPDX-License-Identifier: BSD-2-Clause
+ *  SPDX-License-File: LICENSE
+ *
+ * Copyright 2019 Adriaan de Groot <groot@kde.org>
+ */
+
+#include "cowsay.h"
+
+#include <QStringList>
+
+namespace
+{
+// This is default.cow from cowsay(1), as-is
+static const char default_cow[] = R"cow(
+$the_cow = <<"EOC";
+        $thoughts   ^__^
+         $thoughts  ($eyes)\\_______
+            (__)\\       )\\/\\
+             $tongue ||----w |
+                ||     ||
+EOC
+)cow";
+
+/// @brief Undo Perl double-quote escapes (just the ones used in .cow files)
+QString unescape(const QString& s)
+{
+    QString r;
+    r.reserve(s.length());
+    for (int i = 0; i < s.length(); ++i)
+    {
+        if (s[i] == '\\' && i + 1 < s.length())
+        {
+            ++i;
+        }
+        r.append(s[i]);
+    }
+    return r;
+}
+
+/// @brief Word-wrap @p message into lines at most @p width long
+QStringList wrap(const QString& message, int width)
+{
+    QStringList lines;
+    QString line;
+    for (QString word : message.split(' ', Qt::SkipEmptyParts))
+    {
+        // Words that don't fit on a line at all are chopped up
+        while (word.length() > width)
+        {
+            if (!line.isEmpty())
+            {
+                lines << line;
+                line.clear();
+            }
+            lines << word.left(width);
+            word.remove(0, width);
+        }
+        if (line.isEmpty())
+        {
+            line = word;
+        }
+        else if (line.length() + 1 + word.length() <= width)
+        {
+            line.append(' ').append(word);
+        }
+        else
+        {
+            lines << line;
+            line = word;
+        }
+    }
+    if (!line.isEmpty() || lines.isEmpty())
+    {
+        lines << line;
+    }
+    return lines;
+}
+
+QString bubble(const QStringList& lines)
+{
+    int width = 0;
+    for (const auto& l : lines)
+    {
+        width = qMax(width, l.length());
+    }
+
+    QStringList b;
+    b << QStringLiteral(" ") + QString(width + 2, '_');
+    for (int i = 0; i < lines.count(); ++i)
+    {
+        QChar left, right;
+        if (lines.count() == 1)
+        {
+            left = '<';
+            right = '>';
+        }
+        else if (i == 0)
+        {
+            left = '/';
+            right = '\\';
+        }
+        else if (i == lines.count() - 1)
+        {
+            left = '\\';
+            right = '/';
+        }
+        else
+        {
+            left = right = '|';
+        }
+        b << QString("%1 %2 %3").arg(left).arg(lines[i].leftJustified(width)).arg(right);
+    }
+    b << QStringLiteral(" ") + QString(width + 2, '-');
+    return b.join('\n');
+}
+}  // namespace
+
+namespace QuatBot
+{
+CowTemplate CowTemplate::fromCowFile(const QString& text)
+{
+    CowTemplate cow;
+
+    const QStringList lines = text.split('\n');
+    int i = 0;
+    QString terminator;
+    for (; i < lines.count(); ++i)
+    {
+        const auto& l = lines[i];
+        const int heredoc = l.indexOf(QStringLiteral("<<"));
+        if (l.contains(QStringLiteral("$the_cow")) && heredoc >= 0)
+        {
+            terminator = l.mid(heredoc + 2);
+            terminator.remove('"').remove('\'').remove(';');
+            terminator = terminator.trimmed();
+            ++i;
+            break;
+        }
+    }
+    if (terminator.isEmpty())
+    {
+        return cow;
+    }
+
+    static const struct
+    {
+        QString name;
+        Segment::Kind kind;
+    } placeholders[] = { { QStringLiteral("$thoughts"), Segment::Kind::Thoughts },
+                         { QStringLiteral("$eyes"), Segment::Kind::Eyes },
+                         { QStringLiteral("$tongue"), Segment::Kind::Tongue } };
+
+    for (; i < lines.count() && lines[i].trimmed() != terminator; ++i)
+    {
+        const QString& l = lines[i];
+        Line line;
+        int textStart = 0;
+        int pos = 0;
+        while (pos < l.length())
+        {
+            if (l[pos] == '\\')
+            {
+                pos += 2;  // Escaped, so never a placeholder
+                continue;
+            }
+            bool matched = false;
+            if (l[pos] == '$')
+            {
+                for (const auto& p : placeholders)
+                {
+                    if (l.midRef(pos).startsWith(p.name))
+                    {
+                        if (pos > textStart)
+                        {
+                            line.append({ Segment::Kind::Text, unescape(l.mid(textStart, pos - textStart)) });
+                        }
+                        line.append({ p.kind, QString() });
+                        pos += p.name.length();
+                        textStart = pos;
+                        matched = true;
+                        break;
+                    }
+                }
+            }
+            if (!matched)
+            {
+                ++pos;
+            }
+        }
+        if (textStart < l.length())
+        {
+            line.append({ Segment::Kind::Text, unescape(l.mid(textStart)) });
+        }
+        cow.m_lines.append(line);
+    }
+    return cow;
+}
+
+const CowTemplate& CowTemplate::defaultCow()
+{
+    static const CowTemplate cow = fromCowFile(QString::fromLatin1(default_cow));
+    return cow;
+}
+
+QString CowTemplate::render(const QString& thoughts, const QString& eyes, const QString& tongue) const
+{
+    QStringList lines;
+    lines.reserve(m_lines.count());
+    for (const auto& line : m_lines)
+    {
+        QString l;
+        for (const auto& segment : line)
+        {
+            switch (segment.kind)
+            {
+            case Segment::Kind::Text:
+                l.append(segment.text);
+                break;
+            case Segment::Kind::Thoughts:
+                l.append(thoughts);
+                break;
+            case Segment::Kind::Eyes:
+                l.append(eyes);
+                break;
+            case Segment::Kind::Tongue:
+                l.append(tongue);
+                break;
+            }
+        }
+        lines << l;
+    }
+    return lines.join('\n');
+}
+
+QString cowsay(const QString& message, CowMode mode, int width)
+{
+    QString eyes = QStringLiteral("oo");
+    QString tongue = QStringLiteral("  ");
+    switch (mode)
+    {
+    case CowMode::Normal:
+        break;
+    case CowMode::Borg:
+        eyes = QStringLiteral("==");
+        break;
+    case CowMode::Dead:
+        eyes = QStringLiteral("xx");
+        tongue = QStringLiteral("U ");
+        break;
+    case CowMode::Greedy:
+        eyes = QStringLiteral("$$");
+        break;
+    case CowMode::Paranoid:
+        eyes = QStringLiteral("@@");
+        break;
+    case CowMode::Stoned:
+        eyes = QStringLiteral("**");
+        tongue = QStringLiteral("U ");
+        break;
+    case CowMode::Tired:
+        eyes = QStringLiteral("--");
+        break;
+    case CowMode::Wired:
+        eyes = QStringLiteral("OO");
+        break;
+    case CowMode::Youthful:
+        eyes = QStringLiteral("..");
+        break;
+    }
+
+    return bubble(wrap(message, qMax(1, width))) + '\n'
+        + CowTemplate::defaultCow().render(QStringLiteral("\\"), eyes, tongue) + '\n';
+}
+
+}  // namespace QuatBot
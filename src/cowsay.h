@@ -0,0 +1,79 @@
+/*
+ *  SPDX-License-Identifier: BSD-2-Clause
+ *  SPDX-License-File: LICENSE
+ *
+ * Copyright 2019 Adriaan de Groot <groot@kde.org>
+ */
+
+#ifndef QUATBOT_COWSAY_H
+#define QUATBOT_COWSAY_H
+
+#include <QString>
+#include <QVector>
+
+namespace QuatBot
+{
+/** @brief A cow, as read from a cowsay(1) .cow file
+ *
+ * The .cow file is parsed once into lines of text and placeholders
+ * (for the thoughts-line, eyes and tongue), so that drawing the cow
+ * is just gluing strings together.
+ */
+class CowTemplate
+{
+public:
+    /** @brief Parses the text of a .cow file
+     *
+     * A .cow file is a bit of Perl with a here-document that assigns
+     * to `$the_cow`. Only that here-document is used. If there is
+     * none, the template is empty.
+     */
+    static CowTemplate fromCowFile(const QString& text);
+    /// @brief The default cow, built in
+    static const CowTemplate& defaultCow();
+
+    bool isEmpty() const { return m_lines.isEmpty(); }
+
+    /// @brief Draws the cow with the given @p thoughts, @p eyes and @p tongue
+    QString render(const QString& thoughts, const QString& eyes, const QString& tongue) const;
+
+private:
+    struct Segment
+    {
+        enum class Kind
+        {
+            Text,
+            Thoughts,
+            Eyes,
+            Tongue
+        } kind;
+        QString text;
+    };
+    using Line = QVector<Segment>;
+
+    QVector<Line> m_lines;
+};
+
+/// @brief The cowsay(1) eye- and tongue-variations (-b, -d, -g, ..)
+enum class CowMode
+{
+    Normal,
+    Borg,  ///< -b
+    Dead,  ///< -d
+    Greedy,  ///< -g
+    Paranoid,  ///< -p
+    Stoned,  ///< -s
+    Tired,  ///< -t
+    Wired,  ///< -w
+    Youthful,  ///< -y
+};
+
+/** @brief The default cow says @p message, like cowsay(1) does
+ *
+ * The message is word-wrapped to @p width columns and put in
+ * a speech-bubble above the cow.
+ */
+QString cowsay(const QString& message, CowMode mode = CowMode::Normal, int width = 40);
+
+}  // namespace QuatBot
+#endif
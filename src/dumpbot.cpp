@@ -14,6 +14,7 @@
 #include <QNetworkReply>
 #include <QObject>
 #include <QTimer>
+#include <QtConcurrent>
 
 #include <connection.h>
 #include <networkaccessmanager.h>
@@ -21,6 +22,7 @@
 #include <user.h>
 
 #include <csapi/joining.h>
+#include <csapi/rooms.h>
 #include <events/roommessageevent.h>
 
 namespace QuatBot
@@ -40,17 +42,56 @@ QStringList DumpBot::userIds()
     return l;
 }
 
-void DumpBot::showUsers()
+/// Number of members printed before going back to the event loop
+static constexpr const int MEMBER_RUN_LENGTH = 1000;
+
+void DumpBot::listMembers(const QString& roomId)
+{
+    using GetJoinedMembersByRoomJob = Quotient::GetJoinedMembersByRoomJob;
+    auto* job = m_conn.callApi<GetJoinedMembersByRoomJob>(roomId);
+    connect(job,
+            &GetJoinedMembersByRoomJob::failure,
+            [this]()
+            {
+                qWarning() << "Could not get members of" << m_roomName;
+                deleteLater();
+            });
+    connect(job,
+            &GetJoinedMembersByRoomJob::success,
+            [this, job]()
+            {
+                const auto joined = job->joined();
+                m_members.clear();
+                m_members.reserve(joined.count());
+                for (auto it = joined.cbegin(); it != joined.cend(); ++it)
+                {
+                    m_members.append(qMakePair(it.key(), m_showDisplayNames ? it.value().displayName : QString()));
+                }
+                std::sort(m_members.begin(), m_members.end());
+                m_membersLogged = 0;
+                qDebug() << "Room" << m_roomName << "has" << m_members.count() << "members.";
+                logMemberRun();
+            });
+}
+
+void DumpBot::logMemberRun()
 {
-    QStringList l = userIds();
-    l.sort();
-    for (const auto& u : l)
+    const int end = qMin(m_membersLogged + MEMBER_RUN_LENGTH, m_members.count());
+    for (; m_membersLogged < end; ++m_membersLogged)
     {
-        m_logger->log(u);
+        const auto& [id, displayName] = m_members.at(m_membersLogged);
+        m_logger->log(displayName.isEmpty() ? id : QString("%1 %2").arg(id, displayName));
     }
-    if (m_showUsersOnly)
+    m_logger->flush();
+
+    if (m_membersLogged < m_members.count())
     {
-        QTimer::singleShot(100, qApp, &QCoreApplication::quit);
+        QTimer::singleShot(0, this, &DumpBot::logMemberRun);
+    }
+    else
+    {
+        m_members.clear();
+        deleteLater();
     }
 }
 
@@ -105,6 +146,12 @@ DumpBot::DumpBot(QMatrixClient::Connection& conn, const QString& roomName, const
             [this, joinRoom]()
             {
                 qDebug() << "Joined room" << this->m_roomName << "successfully.";
+                if (m_showUsersOnly)
+                {
+                    // No room state is needed for this, so don't wait for a sync
+                    listMembers(joinRoom->roomId());
+                    return;
+                }
                 m_room = m_conn.room(joinRoom->roomId(), QMatrixClient::JoinState::Join);
                 if (!m_room)
                 {
@@ -124,10 +171,24 @@ DumpBot::DumpBot(QMatrixClient::Connection& conn, const QString& roomName, const
             });
 }
 
+DumpBot::DumpBot(QMatrixClient::Connection& conn, QMatrixClient::Room* room)
+    : QObject()
+    , m_room(room)
+    , m_conn(conn)
+    , m_logger(new LoggerFile)
+    , m_roomName(room->id())
+    , m_newlyConnected(false)
+    , m_offline(true)
+{
+    instance_count++;
+    m_logger->open(QString());  // Default name
+    connect(m_room, &QMatrixClient::Room::addedMessages, this, &DumpBot::addedMessages);
+}
+
 DumpBot::~DumpBot()
 {
     m_logger->close();
-    if (m_room)
+    if (m_room && !m_offline)
     {
         m_room->leaveRoom();
     }
@@ -150,10 +211,6 @@ void DumpBot::baseStateLoaded()
         m_newlyConnected = false;
         qDebug() << "Room base state loaded"
                  << "id=" << m_room->id() << "name=" << m_room->displayName() << "topic=" << m_room->topic();
-        if (m_showUsersOnly)
-        {
-            showUsers();
-        }
     }
 }
 
@@ -173,6 +230,80 @@ void log_messages(const MessageList& messages, int from, LoggerFile& logger)
     }
 }
 
+/// Smallest block of messages worth handing to another thread
+static constexpr const int MIN_RENDER_BLOCK = 256;
+/// Largest block, so that blocks in flight don't hold the whole log
+static constexpr const int MAX_RENDER_BLOCK = 8192;
+
+static QStringList render_block(const MessageList& messages, int from, int to)
+{
+    QStringList texts;
+    texts.reserve(to - from);
+    for (int it = from; it < to; ++it)
+    {
+        texts.append(LoggerFile::format(messages[it]));
+    }
+    return texts;
+}
+
+/** @brief Like log_messages(), but formats blocks of messages on @p jobs threads
+ *
+ * Blocks are formatted concurrently by the global thread pool, and
+ * written in order as they complete. At most 2 * @p jobs blocks are
+ * in flight, so memory use does not depend on the number of messages.
+ * The output is the same as that of log_messages().
+ */
+static void log_messages_parallel(const MessageList& messages, int from, LoggerFile& logger, int jobs)
+{
+    if (from >= messages.count())
+    {
+        return;
+    }
+    qDebug() << "Room messages" << from << '-' << (messages.count() - 1) << messages[from].originTimestamp().toString()
+             << "arrived" << QDateTime::currentDateTimeUtc().toString();
+
+    const int blockSize = qBound(MIN_RENDER_BLOCK, (messages.count() - from) / (4 * jobs) + 1, MAX_RENDER_BLOCK);
+    const int window = 2 * jobs;
+
+    QList<QFuture<QStringList>> inFlight;
+    int next = from;
+    auto startBlock = [&]()
+    {
+        const int to = qMin(next + blockSize, messages.count());
+        inFlight.append(QtConcurrent::run(render_block, messages, next, to));
+        next = to;
+    };
+
+    while (next < messages.count() && inFlight.count() < window)
+    {
+        startBlock();
+    }
+    while (!inFlight.isEmpty())
+    {
+        const auto texts = inFlight.takeFirst().result();
+        if (next < messages.count())
+        {
+            startBlock();
+        }
+        for (const auto& t : texts)
+        {
+            logger.logFormatted(t);
+        }
+    }
+}
+
+void DumpBot::logMessages(int from)
+{
+    if (m_renderJobs > 1 && (m_messages.count() - from) > MIN_RENDER_BLOCK)
+    {
+        log_messages_parallel(m_messages, from, *m_logger, m_renderJobs);
+    }
+    else
+    {
+        log_messages(m_messages, from, *m_logger);
+    }
+}
+
 void DumpBot::finished()
 {
     if (!isSatisfied())
@@ -183,7 +314,7 @@ void DumpBot::finished()
     if (m_amount > 0)
     {
         const int from = m_amount <= m_messages.count() ? m_messages.count() - m_amount : 0;
-        log_messages(m_messages, from, *m_logger);
+        logMessages(from);
     }
     else
     {
@@ -192,7 +323,7 @@ void DumpBot::finished()
                                   [since = m_since](const MessageData& e) { return since < e.originTimestamp(); });
         if (first != m_messages.end())
         {
-            log_messages(m_messages, std::distance(m_messages.begin(), first), *m_logger);
+            logMessages(std::distance(m_messages.begin(), first));
         }
         else
         {
@@ -204,7 +335,7 @@ void DumpBot::finished()
 MessageData::MessageData(const Quotient::RoomMessageEvent* p)
     : m_dt(p->originTimestamp())
     , m_id(p->id())
-    , m_sender(p->senderId())
+    , m_sender(UserId(p->senderId()))
     , m_plainBody(p->plainBody())
 {
 }
@@ -306,11 +437,18 @@ void DumpBot::addedMessages(int from, int to)
     {
         add_messages(timeline, m_messages);
     }
-    m_room->markMessagesAsRead(timeline[to]->id());
+    if (!m_offline)
+    {
+        m_room->markMessagesAsRead(timeline[to]->id());
+    }
     m_logger->flush();
     if (!isSatisfied())
     {
-        getMoreHistory();
+        // Offline, more history only comes when the owner of the room adds it
+        if (!m_offline)
+        {
+            getMoreHistory();
+        }
     }
     else
     {
@@ -321,10 +459,11 @@ void DumpBot::addedMessages(int from, int to)
 void DumpBot::setShowUsersOnly(bool u)
 {
     m_showUsersOnly = u;
-    if (!m_newlyConnected && u)
-    {
-        showUsers();
-    }
+}
+
+void DumpBot::setRenderJobs(int jobs)
+{
+    m_renderJobs = qMax(1, jobs);
 }
 
 void DumpBot::setLogCriterion(unsigned int count)
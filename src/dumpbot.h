@@ -8,6 +8,8 @@
 #ifndef QUATBOT_DUMPBOT_H
 #define QUATBOT_DUMPBOT_H
 
+#include "userid.h"
+
 #include <QDateTime>
 #include <QObject>
 #include <QSet>
@@ -38,13 +40,13 @@ public:
 
     QDateTime originTimestamp() const { return m_dt; }
     QString id() const { return m_id; }
-    QString senderId() const { return m_sender; }
+    QString senderId() const { return m_sender.toString(); }
     QString plainBody() const { return m_plainBody; }
 
 private:
     QDateTime m_dt;
     QString m_id;
-    QString m_sender;
+    UserId m_sender;
     QString m_plainBody;
 };
 using MessageList = QList<MessageData>;
@@ -65,6 +67,13 @@ public:
      * set in @p conn is also always an operator.
      */
     explicit DumpBot(Quotient::Connection& conn, const QString& roomName, const QStringList& ops = QStringList());
+    /** @brief Create a bot for @p room, which is already joined
+     *
+     * This is for offline use (e.g. qb-replay): whoever owns the
+     * room fills it with events. The bot does not fetch more history,
+     * mark messages as read, or leave the room.
+     */
+    DumpBot(Quotient::Connection& conn, Quotient::Room* room);
     virtual ~DumpBot() override;
 
     /// @brief All the user ids from the room
@@ -78,11 +87,18 @@ public:
      *
      * When set to @c true, the bot will display only users
      * in the room, then exit; it will not dump messages.
-     * Call this early on in the connection setup, or messages
-     * may have been dumped already.
+     * Call this right after construction, before the room is
+     * joined: the member list is fetched once the join succeeds.
      */
     void setShowUsersOnly(bool u);
 
+    /** @brief Sets the show-display-names property
+     *
+     * When listing users, also print each user's display name
+     * (if they have one) after their Matrix id.
+     */
+    void setShowDisplayNames(bool d) { m_showDisplayNames = d; }
+
     /** @brief Sets the time-range (logs all messages since the given stamp)
      *
      * This unsets the log-a-number-of-messages value. If @p since is not
@@ -97,14 +113,29 @@ public:
      */
     void setLogCriterion(unsigned int count);
 
+    /** @brief Sets the number of threads used to format the log
+     *
+     * With more than one job, blocks of messages are formatted
+     * concurrently, and written in order. The log is the same
+     * either way. Values less than 1 are treated as 1.
+     */
+    void setRenderJobs(int jobs);
+
 protected:
     /// @brief Called once the room is loaded for the first time.
     void baseStateLoaded();
     /// @brief Messages delivered by quotient
     void addedMessages(int from, int to);
 
-    /// @brief Prints a list of users in the room (exit if m_showUsersOnly is set)
-    void showUsers();
+    /** @brief Fetches the member list of @p roomId and prints it, then exits
+     *
+     * This asks the server for the joined members directly, so no
+     * sync (and no room state) is needed. The list is sorted and
+     * then written out in runs, see logMemberRun().
+     */
+    void listMembers(const QString& roomId);
+    /// @brief Prints the next run of members; schedules itself until done.
+    void logMemberRun();
 
     /// @brief Tries to get some more history
     void getMoreHistory();
@@ -114,6 +145,8 @@ protected:
 
     /// @brief Called once the history is satisfied, does actual logging.
     void finished();
+    /// @brief Logs messages starting at index @p from, see setRenderJobs()
+    void logMessages(int from);
 
 private:
     Quotient::Room* m_room = nullptr;
@@ -122,12 +155,19 @@ private:
 
     QString m_roomName;
     bool m_newlyConnected = true;
+    bool m_offline = false;  ///< not joined, see the second constructor
     bool m_showUsersOnly = false;
+    bool m_showDisplayNames = false;
 
     QDateTime m_since;
     unsigned int m_amount = 100;
+    int m_renderJobs = 1;
     MessageList m_messages;
     QString m_previousChunkToken;
+
+    /// Sorted (id, displayname) pairs waiting to be printed by logMemberRun()
+    QVector<QPair<QString, QString>> m_members;
+    int m_membersLogged = 0;
 };
 }  // namespace QuatBot
 
@@ -0,0 +1,41 @@
+/*
+ *  SPDX-License-Identifier: BSD-2-Clause
+ *  SPDX-License-File: LICENSE
+ *
+ * Copyright 2019 Adriaan de Groot <groot@kde.org>
+ */
+
+#include "envelope.h"
+
+#include "watcher.h"
+
+#include <events/roommessageevent.h>
+
+namespace QuatBot
+{
+MessageEnvelope::MessageEnvelope(const QMatrixClient::RoomMessageEvent* e)
+    : m_event(e)
+    , m_timestamp(e->originTimestamp().toMSecsSinceEpoch())
+    , m_sender(e->senderId())
+    , m_body(e->plainBody())
+    , m_id(e->id())
+    , m_isCommand(CommandArgs::isCommand(m_body))
+{
+}
+
+MessageEnvelope::MessageEnvelope(const MessageEnvelope& other, std::nullptr_t)
+    : m_event(nullptr)
+    , m_timestamp(other.m_timestamp)
+    , m_sender(other.m_sender)
+    , m_body(other.m_body)
+    , m_id(other.m_id)
+    , m_isCommand(other.m_isCommand)
+{
+}
+
+MessageEnvelope MessageEnvelope::detached() const
+{
+    return MessageEnvelope(*this, nullptr);
+}
+
+}  // namespace QuatBot
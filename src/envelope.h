@@ -0,0 +1,67 @@
+/*
+ *  SPDX-License-Identifier: BSD-2-Clause
+ *  SPDX-License-File: LICENSE
+ *
+ * Copyright 2019 Adriaan de Groot <groot@kde.org>
+ */
+
+#ifndef QUATBOT_ENVELOPE_H
+#define QUATBOT_ENVELOPE_H
+
+#include "userid.h"
+
+#include <QString>
+
+#include <cstddef>
+
+namespace Quotient
+{
+class RoomMessageEvent;
+}  // namespace Quotient
+
+namespace QuatBot
+{
+/** @brief What the watchers need to know about a message, decoded once
+ *
+ * The Bot builds one envelope per message event and hands the same
+ * one to every watcher (and to CommandArgs), so the sender is interned,
+ * the timestamp converted and the body checked for a command only once.
+ * The body shares its data with the event; nothing is copied.
+ *
+ * An envelope is immutable, and only valid for as long as the event
+ * it was made from: do not keep it around. A detached() copy does not
+ * refer to the event, and can be handed to another thread.
+ */
+class MessageEnvelope
+{
+public:
+    explicit MessageEnvelope(const Quotient::RoomMessageEvent* e);
+
+    /// @brief A copy without the event, which may outlive it (see WorkerPool)
+    MessageEnvelope detached() const;
+
+    /// @brief Origin timestamp of the message, in milliseconds since the epoch (UTC)
+    qint64 timestamp() const { return m_timestamp; }
+    UserId sender() const { return m_sender; }
+    const QString& body() const { return m_body; }
+    const QString& id() const { return m_id; }
+    /// @brief Does the body start with the command prefix? See CommandArgs::isCommand()
+    bool isCommand() const { return m_isCommand; }
+
+    /// @brief The event itself, for the rare watcher that needs more; nullptr if detached
+    const Quotient::RoomMessageEvent* event() const { return m_event; }
+
+private:
+    MessageEnvelope(const MessageEnvelope& other, std::nullptr_t);
+
+    const Quotient::RoomMessageEvent* const m_event;
+    const qint64 m_timestamp;
+    const UserId m_sender;
+    const QString m_body;
+    const QString m_id;
+    const bool m_isCommand;
+};
+
+}  // namespace QuatBot
+
+#endif
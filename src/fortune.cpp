@@ -0,0 +1,165 @@
+/*
+ *  SPDX-License-Identifier: BSD-2-Clause
+ *  SPDX-License-File: LICENSE
+ *
+ * Copyright 2019 Adriaan de Groot <groot@kde.org>
+ */
+
+#include "fortune.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QRandomGenerator>
+#include <QStringList>
+#include <QtEndian>
+
+namespace
+{
+/* The header of a strfile(8) .dat file; all values are big-endian.
+ *
+ *  - quint32 version
+ *  - quint32 number of strings
+ *  - quint32 longest string
+ *  - quint32 shortest string
+ *  - quint32 flags
+ *  - char delimiter, 3 bytes padding
+ *
+ * This is followed by (number of strings + 1) offsets into the text
+ * file, 32-bit in the classic format and 64-bit in newer BSD ones.
+ */
+static constexpr const int HEADER_SIZE = 24;
+static constexpr const quint32 STR_ROTATED = 0x4;
+
+const QStringList& searchPath()
+{
+    static const QStringList dirs { "/usr/share/games/fortunes",
+                                    "/usr/share/games/fortune",
+                                    "/usr/share/fortune",
+                                    "/usr/local/share/games/fortune" };
+    return dirs;
+}
+
+QString rot13(QString s)
+{
+    for (auto& c : s)
+    {
+        const char l = c.toLatin1();
+        if ((l >= 'a' && l <= 'z'))
+        {
+            c = QChar('a' + (l - 'a' + 13) % 26);
+        }
+        else if ((l >= 'A' && l <= 'Z'))
+        {
+            c = QChar('A' + (l - 'A' + 13) % 26);
+        }
+    }
+    return s;
+}
+}  // namespace
+
+namespace QuatBot
+{
+FortuneDatabase::FortuneDatabase(const QString& name)
+{
+    for (const auto& d : searchPath())
+    {
+        QDir dir(d);
+        if (dir.exists(name) && dir.exists(name + QStringLiteral(".dat")))
+        {
+            m_text.setFileName(dir.absoluteFilePath(name));
+            m_index.setFileName(dir.absoluteFilePath(name + QStringLiteral(".dat")));
+            break;
+        }
+    }
+    if (m_text.fileName().isEmpty())
+    {
+        qDebug() << "No fortune database" << name;
+        return;
+    }
+
+    if (!m_text.open(QIODevice::ReadOnly) || !m_index.open(QIODevice::ReadOnly))
+    {
+        qWarning() << "Could not open fortune database" << m_text.fileName();
+        return;
+    }
+    m_textSize = m_text.size();
+    m_textData = m_text.map(0, m_textSize);
+    const qint64 indexSize = m_index.size();
+    const uchar* index = indexSize >= HEADER_SIZE ? m_index.map(0, indexSize) : nullptr;
+    if (!m_textData || !index)
+    {
+        qWarning() << "Could not map fortune database" << m_text.fileName();
+        return;
+    }
+
+    const quint32 count = qFromBigEndian<quint32>(index + 4);
+    const quint32 flags = qFromBigEndian<quint32>(index + 16);
+    const qint64 offsetsSize = indexSize - HEADER_SIZE;
+    if (count < 1 || (offsetsSize != 4 * qint64(count + 1) && offsetsSize != 8 * qint64(count + 1)))
+    {
+        qWarning() << "Fortune index" << m_index.fileName() << "corrupt.";
+        return;
+    }
+
+    m_offsetSize = int(offsetsSize / (count + 1));
+    m_offsets = index + HEADER_SIZE;
+    m_rotated = flags & STR_ROTATED;
+    m_delimiter = char(index[20]);
+    if (offset(count) > quint64(m_textSize))
+    {
+        qWarning() << "Fortune index" << m_index.fileName() << "does not match" << m_text.fileName();
+        return;
+    }
+    m_count = count;
+    qDebug() << "Loaded" << m_count << "fortunes from" << m_text.fileName();
+}
+
+FortuneDatabase::~FortuneDatabase() {}
+
+const FortuneDatabase& FortuneDatabase::instance()
+{
+    static const FortuneDatabase db(QStringLiteral("freebsd-tips"));
+    return db;
+}
+
+quint64 FortuneDatabase::offset(int index) const
+{
+    const uchar* p = m_offsets + index * m_offsetSize;
+    return m_offsetSize == 8 ? qFromBigEndian<quint64>(p) : qFromBigEndian<quint32>(p);
+}
+
+QString FortuneDatabase::fortune(int index) const
+{
+    if (index < 0 || quint32(index) >= m_count)
+    {
+        return QString();
+    }
+
+    const quint64 start = offset(index);
+    quint64 end = offset(index + 1);
+    if (end <= start)
+    {
+        return QString();
+    }
+    const char* text = reinterpret_cast<const char*>(m_textData + start);
+    int length = int(end - start);
+    // Each fortune is followed by its delimiter line (except maybe the last)
+    if (length >= 2 && text[length - 1] == '\n' && text[length - 2] == m_delimiter)
+    {
+        length -= 2;
+    }
+
+    const QString s = QString::fromLatin1(text, length);
+    return m_rotated ? rot13(s) : s;
+}
+
+QString FortuneDatabase::randomFortune() const
+{
+    if (!isValid())
+    {
+        return QString();
+    }
+    return fortune(int(QRandomGenerator::global()->bounded(m_count)));
+}
+
+}  // namespace QuatBot
@@ -0,0 +1,63 @@
+/*
+ *  SPDX-License-Identifier: BSD-2-Clause
+ *  SPDX-License-File: LICENSE
+ *
+ * Copyright 2019 Adriaan de Groot <groot@kde.org>
+ */
+
+#ifndef QUATBOT_FORTUNE_H
+#define QUATBOT_FORTUNE_H
+
+#include <QFile>
+#include <QString>
+
+namespace QuatBot
+{
+/** @brief A fortune(6) database, read directly from disk
+ *
+ * A fortune database is a text file with the fortunes, separated by
+ * lines containing just a `%`, and a `.dat` file written by strfile(8)
+ * with the offset of each fortune in the text file. Both files are
+ * memory-mapped, so picking a fortune is just looking up two offsets.
+ */
+class FortuneDatabase
+{
+public:
+    /** @brief Loads the database @p name (e.g. "freebsd-tips")
+     *
+     * The usual fortune directories are searched for a text file
+     * with that name, and a matching `.dat` file. If they can't be
+     * found or mapped, the database is invalid.
+     */
+    explicit FortuneDatabase(const QString& name);
+    ~FortuneDatabase();
+
+    /// @brief The database the bot uses for ~fortune, loaded on first use
+    static const FortuneDatabase& instance();
+
+    bool isValid() const { return m_count > 0; }
+    /// @brief Number of fortunes in the database
+    int count() const { return int(m_count); }
+
+    /// @brief The fortune at @p index (from 0 to count() - 1)
+    QString fortune(int index) const;
+    /// @brief A random fortune; empty if the database is invalid
+    QString randomFortune() const;
+
+private:
+    /// @brief Offset of fortune @p index in the text file
+    quint64 offset(int index) const;
+
+    QFile m_text;
+    QFile m_index;
+    const uchar* m_textData = nullptr;
+    qint64 m_textSize = 0;
+    const uchar* m_offsets = nullptr;
+    int m_offsetSize = 4;  // 4 for classic strfile, 8 for 64-bit ones
+    quint32 m_count = 0;
+    bool m_rotated = false;
+    char m_delimiter = '%';
+};
+
+}  // namespace QuatBot
+#endif
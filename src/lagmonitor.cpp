@@ -0,0 +1,161 @@
+/*
+ *  SPDX-License-Identifier: BSD-2-Clause
+ *  SPDX-License-File: LICENSE
+ *
+ * Copyright 2019 Adriaan de Groot <groot@kde.org>
+ */
+
+#include "lagmonitor.h"
+
+#include "metrics.h"
+
+#include <QDebug>
+#include <QMutexLocker>
+#include <QThread>
+
+#include <algorithm>
+
+namespace
+{
+// Samples kept for the percentiles; at the default probe interval, a minute
+static constexpr const size_t MAX_SAMPLES = 1200;
+
+static QString milliseconds(qint64 usecs)
+{
+    return QString::number(double(usecs) / 1000.0, 'f', 1);
+}
+
+// The innermost activity of this thread
+static thread_local QuatBot::LagMonitor::Activity* currentActivity = nullptr;
+}  // namespace
+
+namespace QuatBot
+{
+LagMonitor::LagMonitor()
+    : QObject()
+    , m_lagMetric(MetricsRegistry::instance()->histogram(QStringLiteral("quatbot_event_loop_lag_seconds"),
+                                                         "How late the event loop runs a timer."))
+{
+    m_samples.reserve(MAX_SAMPLES);
+    m_probe.setTimerType(Qt::PreciseTimer);
+    connect(&m_probe, &QTimer::timeout, this, &LagMonitor::probe);
+}
+
+LagMonitor* LagMonitor::instance()
+{
+    static LagMonitor* monitor = new LagMonitor;
+    return monitor;
+}
+
+void LagMonitor::start(int msec)
+{
+    if (msec <= 0)
+    {
+        m_probe.stop();
+        return;
+    }
+    m_probe.start(msec);
+    m_sinceProbe.start();
+}
+
+void LagMonitor::probe()
+{
+    const qint64 lag = qMax<qint64>(m_sinceProbe.nsecsElapsed() - qint64(m_probe.interval()) * 1000000, 0);
+    m_sinceProbe.start();
+
+    m_lagMetric->observe(lag);
+    const qint64 usecs = lag / 1000;
+    {
+        QMutexLocker lock(&m_samplesMutex);
+        if (m_samples.size() < MAX_SAMPLES)
+        {
+            m_samples.push_back(usecs);
+        }
+        else
+        {
+            m_samples[m_nextSample] = usecs;
+            m_nextSample = (m_nextSample + 1) % MAX_SAMPLES;
+        }
+        m_maxLag = qMax(m_maxLag, usecs);
+    }
+
+    if (usecs >= qint64(m_thresholdMs) * 1000)
+    {
+        qWarning().noquote() << "Event loop stalled for" << milliseconds(usecs) << "ms,"
+                             << (m_lastSlow.isEmpty() ? QStringLiteral("not in a watcher.") : "in " + m_lastSlow);
+    }
+    m_lastSlow.clear();
+}
+
+QString LagMonitor::summary() const
+{
+    QMutexLocker lock(&m_samplesMutex);
+    if (m_samples.empty())
+    {
+        return QStringLiteral("No event-loop lag measured.");
+    }
+
+    std::vector<qint64> sorted(m_samples);
+    auto percentile = [&sorted](int p)
+    {
+        auto nth = sorted.begin() + (sorted.size() - 1) * p / 100;
+        std::nth_element(sorted.begin(), nth, sorted.end());
+        return *nth;
+    };
+    const qint64 p50 = percentile(50);
+    const qint64 p99 = percentile(99);
+    return QString("Event-loop lag p50 %1ms, p99 %2ms (recently), max %3ms.")
+        .arg(milliseconds(p50), milliseconds(p99), milliseconds(m_maxLag));
+}
+
+LagMonitor::Activity::Activity(const QString& watcher, const QString& what, const QString& id)
+    : m_watcher(watcher)
+    , m_what(what)
+    , m_id(id)
+    , m_parent(currentActivity)
+{
+    currentActivity = this;
+    m_timer.start();
+}
+
+LagMonitor::Activity::~Activity()
+{
+    auto* monitor = LagMonitor::instance();
+    currentActivity = m_parent;
+
+    const qint64 msecs = m_timer.elapsed();
+    if (msecs < monitor->m_thresholdMs)
+    {
+        return;
+    }
+    if (m_parent)
+    {
+        // The parent is slow too, but the blame goes here
+        m_parent->m_reported = true;
+    }
+    if (!m_reported)
+    {
+        const QString slow = describe();
+        qWarning().noquote() << "Slow handler" << slow << "took" << msecs << "ms";
+        if (QThread::currentThread() == monitor->thread())
+        {
+            monitor->m_lastSlow = slow;
+        }
+    }
+}
+
+QString LagMonitor::Activity::describe() const
+{
+    QString s = m_watcher;
+    if (!m_what.isEmpty())
+    {
+        s += ' ' + m_what;
+    }
+    if (!m_id.isEmpty())
+    {
+        s += " (event " + m_id + ')';
+    }
+    return s;
+}
+
+}  // namespace QuatBot
@@ -0,0 +1,104 @@
+/*
+ *  SPDX-License-Identifier: BSD-2-Clause
+ *  SPDX-License-File: LICENSE
+ *
+ * Copyright 2019 Adriaan de Groot <groot@kde.org>
+ */
+
+#ifndef QUATBOT_LAGMONITOR_H
+#define QUATBOT_LAGMONITOR_H
+
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QObject>
+#include <QString>
+#include <QTimer>
+
+#include <vector>
+
+namespace QuatBot
+{
+class Histogram;
+
+/** @brief Watches how late the event loop is
+ *
+ * Unless they run in a WorkerPool, all rooms share one event loop,
+ * so one slow handler delays everything. The monitor runs a short
+ * timer (the probe) and measures how much later than requested it
+ * fires; that is the event-loop lag. The most recent samples are kept
+ * for percentiles (see summary()).
+ *
+ * Code that handles something on behalf of a watcher runs inside an
+ * Activity. An activity that takes longer than the threshold is logged
+ * with its watcher, command and event id, so that a stall seen by the
+ * probe can be blamed on someone.
+ *
+ * The probe runs in the main thread. Activities nest per thread; slow
+ * ones are logged from any thread, but only those in the main thread
+ * are blamed for its stalls. summary() may be called from any thread.
+ */
+class LagMonitor : public QObject
+{
+public:
+    static LagMonitor* instance();
+
+    /// @brief Starts probing every @p msec milliseconds; 0 stops probing
+    void start(int msec = 50);
+
+    /// @brief Activities (and stalls) longer than this many milliseconds are logged
+    int threshold() const { return m_thresholdMs; }
+    void setThreshold(int msec) { m_thresholdMs = msec; }
+
+    /// @brief Human-readable p50, p99 and max lag of the recent samples
+    QString summary() const;
+
+    /** @brief Something the event loop is busy with
+     *
+     * Create one on the stack around a handler; @p watcher and
+     * @p what (e.g. a command) describe it, @p id is the event id
+     * that caused it, if any. Activities nest; only the innermost
+     * slow one is logged.
+     */
+    class Activity
+    {
+    public:
+        Activity(const QString& watcher, const QString& what, const QString& id = QString());
+        ~Activity();
+
+        Activity(const Activity&) = delete;
+        Activity& operator=(const Activity&) = delete;
+
+    private:
+        friend class LagMonitor;
+
+        QString describe() const;
+
+        QString m_watcher;
+        QString m_what;
+        QString m_id;
+        Activity* m_parent;
+        QElapsedTimer m_timer;
+        bool m_reported = false;  // a nested activity was slow, and logged
+    };
+
+private:
+    LagMonitor();
+
+    void probe();
+
+    QTimer m_probe;
+    QElapsedTimer m_sinceProbe;
+    Histogram* m_lagMetric;
+
+    QString m_lastSlow;  // the slow activity since the last probe, if any
+    int m_thresholdMs = 100;
+
+    // Recent lag samples, in microseconds
+    mutable QMutex m_samplesMutex;  // summary() is also called from worker threads
+    std::vector<qint64> m_samples;
+    size_t m_nextSample = 0;
+    qint64 m_maxLag = 0;
+};
+
+}  // namespace QuatBot
+#endif
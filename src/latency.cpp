@@ -0,0 +1,255 @@
+/*
+ *  SPDX-License-Identifier: BSD-2-Clause
+ *  SPDX-License-File: LICENSE
+ *
+ * Copyright 2019 Adriaan de Groot <groot@kde.org>
+ */
+
+#include "latency.h"
+
+#include "metrics.h"
+
+#include <QDateTime>
+#include <QMutex>
+#include <QMutexLocker>
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+namespace
+{
+// Samples kept per command and stage, for the percentiles
+static constexpr const size_t MAX_SAMPLES = 256;
+// Replies that are never echoed are forgotten after this many
+static constexpr const int MAX_IN_FLIGHT = 64;
+
+static qint64 now()
+{
+    return QDateTime::currentMSecsSinceEpoch();
+}
+
+/// @brief The most recent samples of one duration, in milliseconds
+class Samples
+{
+public:
+    void add(qint64 msecs)
+    {
+        if (m_samples.size() < MAX_SAMPLES)
+        {
+            m_samples.push_back(msecs);
+        }
+        else
+        {
+            m_samples[m_next] = msecs;
+            m_next = (m_next + 1) % MAX_SAMPLES;
+        }
+    }
+
+    bool isEmpty() const { return m_samples.empty(); }
+
+    /// @brief "p50/p99" of the samples
+    QString percentiles() const
+    {
+        std::vector<qint64> sorted(m_samples);
+        std::sort(sorted.begin(), sorted.end());
+        const size_t last = sorted.size() - 1;
+        return QStringLiteral("%1/%2").arg(sorted[last * 50 / 100]).arg(sorted[last * 99 / 100]);
+    }
+
+private:
+    std::vector<qint64> m_samples;
+    size_t m_next = 0;
+};
+
+struct CommandStats
+{
+    quint64 count = 0;
+    Samples sync;  // origin to arrival
+    Samples wait;  // arrival to start
+    Samples handle;  // start to end
+    Samples send;  // enqueued to sent
+    Samples echo;  // sent to echoed
+    Samples total;  // origin to echoed, or to end if there is no reply
+    QuatBot::Histogram* metric = nullptr;
+};
+
+struct Stats
+{
+    QMutex mutex;
+    std::map<QString, CommandStats> commands;
+};
+
+static Stats& stats()
+{
+    static Stats* s = new Stats;
+    return *s;
+}
+}  // namespace
+
+namespace QuatBot
+{
+void LatencyTracker::begin(const QString& command, qint64 origin, qint64 arrival)
+{
+    m_current = Timing();
+    m_current.command = command;
+    m_current.origin = origin;
+    m_current.arrival = arrival;
+    m_current.start = now();
+    m_currentTxnId.clear();
+    m_active = true;
+    m_handedOver = false;
+}
+
+void LatencyTracker::enqueued(const QString& txnId)
+{
+    if (!m_active || m_current.enqueued || txnId.isEmpty())
+    {
+        return;
+    }
+    m_current.end = now();
+    m_current.enqueued = m_current.end;
+    m_currentTxnId = txnId;
+}
+
+bool LatencyTracker::handOver(Timing& t)
+{
+    if (!m_active || m_current.enqueued)
+    {
+        return false;
+    }
+    m_current.end = now();
+    m_current.enqueued = m_current.end;
+    m_handedOver = true;
+    t = m_current;
+    return true;
+}
+
+void LatencyTracker::track(const QString& txnId, const Timing& t)
+{
+    if (txnId.isEmpty())
+    {
+        record(t);
+    }
+    else
+    {
+        addInFlight(txnId, t);
+    }
+}
+
+void LatencyTracker::finish()
+{
+    if (!m_active)
+    {
+        return;
+    }
+    m_active = false;
+    if (m_handedOver)
+    {
+        // The reply is posted by the other thread, which has the timing now
+        return;
+    }
+    if (!m_current.end)
+    {
+        m_current.end = now();
+    }
+
+    if (m_currentTxnId.isEmpty())
+    {
+        record(m_current);
+        return;
+    }
+    addInFlight(m_currentTxnId, m_current);
+}
+
+void LatencyTracker::addInFlight(const QString& txnId, const Timing& t)
+{
+    if (m_inFlight.count() >= MAX_IN_FLIGHT)
+    {
+        // Drop the oldest, it's not coming back
+        auto oldest = std::min_element(m_inFlight.begin(),
+                                       m_inFlight.end(),
+                                       [](const Timing& a, const Timing& b) { return a.enqueued < b.enqueued; });
+        m_inFlight.erase(oldest);
+    }
+    m_inFlight.insert(txnId, t);
+}
+
+void LatencyTracker::sent(const QString& txnId)
+{
+    auto it = m_inFlight.find(txnId);
+    if (it != m_inFlight.end() && !it->sent)
+    {
+        it->sent = now();
+    }
+}
+
+void LatencyTracker::echoed(const QString& txnId)
+{
+    auto it = m_inFlight.find(txnId);
+    if (it != m_inFlight.end())
+    {
+        it->echoed = now();
+        record(*it);
+        m_inFlight.erase(it);
+    }
+}
+
+void LatencyTracker::record(const Timing& t)
+{
+    auto& s = stats();
+    QMutexLocker lock(&s.mutex);
+    auto& c = s.commands[t.command];
+    if (!c.metric)
+    {
+        c.metric = MetricsRegistry::instance()->histogram(QStringLiteral("quatbot_command_e2e_seconds"),
+                                                          "Time from sending a command to seeing the reply.",
+                                                          { { QStringLiteral("command"), t.command } });
+    }
+
+    c.count++;
+    c.sync.add(t.arrival - t.origin);
+    c.wait.add(t.start - t.arrival);
+    c.handle.add(t.end - t.start);
+    if (t.echoed)
+    {
+        // Replies that are echoed before the send job reports back have no sent time
+        const qint64 sent = t.sent ? t.sent : t.echoed;
+        c.send.add(sent - t.enqueued);
+        c.echo.add(t.echoed - sent);
+        c.total.add(t.echoed - t.origin);
+        c.metric->observe((t.echoed - t.origin) * 1000000);
+    }
+    else
+    {
+        c.total.add(t.end - t.origin);
+        c.metric->observe((t.end - t.origin) * 1000000);
+    }
+}
+
+QStringList LatencyTracker::report(const QString& command)
+{
+    QStringList lines;
+    auto& s = stats();
+    QMutexLocker lock(&s.mutex);
+    for (const auto& [name, c] : s.commands)
+    {
+        if (!command.isEmpty() && name != command)
+        {
+            continue;
+        }
+        QString line
+            = QStringLiteral("%1 (%2): total %3ms, sync %4, wait %5, handle %6")
+                  .arg(name)
+                  .arg(c.count)
+                  .arg(c.total.percentiles(), c.sync.percentiles(), c.wait.percentiles(), c.handle.percentiles());
+        if (!c.send.isEmpty())
+        {
+            line += QStringLiteral(", send %1, echo %2").arg(c.send.percentiles(), c.echo.percentiles());
+        }
+        lines << line;
+    }
+    return lines;
+}
+
+}  // namespace QuatBot
@@ -0,0 +1,103 @@
+/*
+ *  SPDX-License-Identifier: BSD-2-Clause
+ *  SPDX-License-File: LICENSE
+ *
+ * Copyright 2019 Adriaan de Groot <groot@kde.org>
+ */
+
+#ifndef QUATBOT_LATENCY_H
+#define QUATBOT_LATENCY_H
+
+#include <QHash>
+#include <QString>
+#include <QStringList>
+
+namespace QuatBot
+{
+/** @brief End-to-end latency of the commands in one room
+ *
+ * For each command, the tracker notes (in milliseconds since the epoch):
+ *  - origin: the server timestamp of the command event,
+ *  - arrival: when the bot got it from sync,
+ *  - start and end of handling (up to the first reply),
+ *  - enqueued: when the first reply was handed to the room to send,
+ *  - sent: when the server accepted the reply,
+ *  - echoed: when the reply came back from the server in a sync.
+ *
+ * Replies are matched up by transaction id. Once a command is complete
+ * (echoed, or handled without a reply) the durations go into statistics
+ * per command, shared by all rooms; see report().
+ *
+ * The origin is the server's clock and the rest is the bot's, so
+ * the part before arrival includes any difference between the two.
+ *
+ * When the bot's watchers run in a worker thread (see WorkerPool),
+ * begin(), handOver(), finish() and discard() are called there, and
+ * the rest in the main thread, which posts the reply.
+ */
+class LatencyTracker
+{
+public:
+    struct Timing
+    {
+        QString command;
+        qint64 origin = 0;
+        qint64 arrival = 0;
+        qint64 start = 0;
+        qint64 end = 0;
+        qint64 enqueued = 0;
+        qint64 sent = 0;
+        qint64 echoed = 0;
+    };
+
+    LatencyTracker() = default;
+    ~LatencyTracker() = default;
+
+    /// @brief A command @p command, sent at @p origin and received at @p arrival, is being handled now
+    void begin(const QString& command, qint64 origin, qint64 arrival);
+    /** @brief A reply to the current command has been posted as @p txnId
+     *
+     * Only the first reply counts; this also ends the handling, since
+     * the reply is sent at the end of the command.
+     */
+    void enqueued(const QString& txnId);
+    /// @brief The command from begin() is done; if nothing was posted, it is recorded now
+    void finish();
+    /// @brief Forget the command from begin(), e.g. because nobody understood it
+    void discard() { m_active = false; }
+    /** @brief The first reply to the current command goes to another thread to be posted
+     *
+     * Like enqueued(), but instead of keeping the timing, copies it
+     * to @p t for track(). Returns false if this is not the first reply.
+     */
+    bool handOver(Timing& t);
+    /// @brief A reply that was handed over as @p t has been posted as @p txnId
+    void track(const QString& txnId, const Timing& t);
+
+    /// @brief The server has accepted @p txnId
+    void sent(const QString& txnId);
+    /// @brief The server has sent @p txnId back in a sync
+    void echoed(const QString& txnId);
+
+    /** @brief Percentiles of the stages, per command
+     *
+     * With an empty @p command, gives one line for each command seen;
+     * otherwise just the line for that command.
+     */
+    static QStringList report(const QString& command = QString());
+
+private:
+    /// @brief Adds @p t to the statistics
+    static void record(const Timing& t);
+    /// @brief Waits for @p txnId to come back
+    void addInFlight(const QString& txnId, const Timing& t);
+
+    Timing m_current;
+    QString m_currentTxnId;
+    bool m_active = false;
+    bool m_handedOver = false;  ///< see handOver()
+    QHash<QString, Timing> m_inFlight;  // by transaction id
+};
+
+}  // namespace QuatBot
+#endif
@@ -9,6 +9,7 @@
 
 // Slightly weird: non-Quotient type for logging
 #include "dumpbot.h"
+#include "envelope.h"
 
 #include <room.h>
 
@@ -173,6 +174,42 @@ void LoggerFile::log(const QuatBot::MessageData& message)
     logX(d, message.originTimestamp().toString(Qt::DateFormat::ISODate), message.senderId(), message.plainBody());
 }
 
+void LoggerFile::log(const QuatBot::MessageEnvelope& message)
+{
+    const QString timestamp
+        = QDateTime::fromMSecsSinceEpoch(message.timestamp(), Qt::UTC).toString(Qt::DateFormat::ISODate);
+    const QString sender = message.sender().toString();
+    if (m_stream)
+    {
+        ++m_lines;
+        logX(*m_stream, timestamp, sender, message.body());
+    }
+
+    auto d = qDebug().noquote().nospace();
+    logX(d, timestamp, sender, message.body());
+}
+
+QString LoggerFile::format(const QuatBot::MessageData& message)
+{
+    QString text;
+    QTextStream s(&text);
+    logX(s, message.originTimestamp().toString(Qt::DateFormat::ISODate), message.senderId(), message.plainBody());
+    s.flush();
+    return text;
+}
+
+void LoggerFile::logFormatted(const QString& text)
+{
+    if (m_stream)
+    {
+        ++m_lines;
+        *m_stream << text;
+    }
+
+    // Single-line messages do not get an eol() when sent to QDebug
+    const bool multiLine = text.indexOf('\n') < text.length() - 1;
+    qDebug().noquote().nospace() << (multiLine ? text : text.left(text.length() - 1));
+}
 
 QString LoggerFile::makeName(QString s)
 {
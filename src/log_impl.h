@@ -19,6 +19,7 @@ namespace QuatBot
 {
 
 class MessageData;
+class MessageEnvelope;
 
 class LoggerFile
 {
@@ -29,12 +30,24 @@ public:
     void log(const Quotient::RoomMessageEvent* message);
     void log(const QString& s);
     void log(const MessageData& message);
+    void log(const MessageEnvelope& message);
+
+    /** @brief Formats @p message as log() would write it to the file
+     *
+     * This does not touch any LoggerFile state, so it can be called
+     * from any thread. Pass the result to logFormatted() to write it.
+     */
+    static QString format(const MessageData& message);
+    /// @brief Writes @p text produced by format(), same as log() would
+    void logFormatted(const QString& text);
 
     void open(const QString& name);
     void close();
     bool isOpen() const { return m_stream != nullptr; }
     QString fileName() const { return m_file ? m_file->fileName() : QString(); }
     int lineCount() const { return m_lines; }
+    /// @brief Bytes that have reached the file (not counting the stream buffer)
+    qint64 bytesWritten() const { return m_file ? m_file->pos() : 0; }
     void flush();
 
 private:
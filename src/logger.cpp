@@ -7,8 +7,11 @@
 
 #include "logger.h"
 
+#include "clock.h"
 #include "log_impl.h"
+#include "metrics.h"
 #include "quatbot.h"
+#include "trace.h"
 
 #include <room.h>
 
@@ -21,6 +24,9 @@ namespace QuatBot
 Logger::Logger(Bot* parent)
     : Watcher(parent)
     , d(new LoggerFile)
+    , m_bytesMetric(MetricsRegistry::instance()->counter(QStringLiteral("quatbot_log_bytes_total"),
+                                                         "Bytes written to log files.",
+                                                         { { QStringLiteral("room"), parent->botRoom() } }))
 {
 }
 
@@ -41,30 +47,45 @@ const QStringList& Logger::moduleCommands() const
     return commands;
 }
 
-void Logger::handleMessage(const Quotient::RoomMessageEvent* event)
+void Logger::countBytes()
 {
-    d->log(event);
+    const qint64 written = d->bytesWritten();
+    if (written > m_bytesCounted)
+    {
+        m_bytesMetric->add(quint64(written - m_bytesCounted));
+    }
+    m_bytesCounted = written;
+}
+
+void Logger::observe(const MessageEnvelope& e)
+{
+    QUATBOT_TRACE("LoggerFile::log");
+    d->log(e);
+    countBytes();
 }
 
-void Logger::handleMessage(const QString& s)
+void Logger::observe(const QString& s)
 {
+    QUATBOT_TRACE("LoggerFile::log");
     d->log(s);
     d->flush();
+    countBytes();
 }
 
-static void report(Bot* bot, LoggerFile* file)
+/// @brief Describes the state of @p file; call it in the observer stage
+static QString report(LoggerFile* file)
 {
     if (!file->isOpen())
     {
-        bot->message("(log) Logging is off.");
+        return QStringLiteral("(log) Logging is off.");
     }
     else if (file->lineCount() > 0)
     {
-        bot->message(QString("(log) Logging to %1, %2 lines.").arg(file->fileName(), file->lineCount()));
+        return QString("(log) Logging to %1, %2 lines.").arg(file->fileName(), file->lineCount());
     }
     else
     {
-        bot->message(QString("(log) Logging to %1").arg(file->fileName()));
+        return QString("(log) Logging to %1").arg(file->fileName());
     }
 }
 
@@ -81,12 +102,24 @@ void Logger::handleCommand(const CommandArgs& cmd)
                 quiet = true;
                 argIndex = 1;
             }
-            d->open(cmd.args.count() > argIndex ? cmd.args[argIndex] : cmd.id);
-            d->log(QString("Log started %1.").arg(QDateTime::currentDateTime().toString()));
-            d->flush();
+            const QString name = cmd.args.count() > argIndex ? cmd.args[argIndex] : cmd.id;
+            const QString started = QString("Log started %1.").arg(Clock::instance()->currentDateTime().toString());
+            QString status;
+            m_bot->observeAndWait(
+                [&]()
+                {
+                    d->flush();
+                    countBytes();  // of the previous log, if any
+                    d->open(name);
+                    m_bytesCounted = 0;
+                    d->log(started);
+                    d->flush();
+                    countBytes();
+                    status = report(d);
+                });
             if (!quiet)
             {
-                report(m_bot, d);
+                message(status);
             }
         }
     }
@@ -99,16 +132,27 @@ void Logger::handleCommand(const CommandArgs& cmd)
             {
                 quiet = true;
             }
-            d->close();
+            QString status;
+            m_bot->observeAndWait(
+                [&]()
+                {
+                    d->flush();
+                    countBytes();
+                    d->close();
+                    m_bytesCounted = 0;
+                    status = report(d);
+                });
             if (!quiet)
             {
-                report(m_bot, d);
+                message(status);
             }
         }
     }
     else if (cmd.command == "status")
     {
-        report(m_bot, d);
+        QString status;
+        m_bot->observeAndWait([&]() { status = report(d); });
+        message(status);
     }
     else
     {
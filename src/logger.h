@@ -15,8 +15,14 @@
 
 namespace QuatBot
 {
+class Counter;
 class LoggerFile;
 
+/** @brief Writes the messages of the room to a log file (~log on)
+ *
+ * The logger is an observer: the file belongs to the observer stage,
+ * and commands change it through the bot (see Bot::observe()).
+ */
 class Logger : public Watcher
 {
 public:
@@ -26,12 +32,19 @@ public:
     const QString& moduleName() const override;
     const QStringList& moduleCommands() const override;
 
-    virtual void handleMessage(const QString&) override;
-    virtual void handleMessage(const Quotient::RoomMessageEvent*) override;
     virtual void handleCommand(const CommandArgs&) override;
 
+    bool isObserver() const override { return true; }
+    void observe(const MessageEnvelope&) override;
+    void observe(const QString&) override;
+
 private:
+    /// @brief Adds the bytes written to the log file since last time to the metrics
+    void countBytes();
+
     LoggerFile* d;
+    Counter* m_bytesMetric;
+    qint64 m_bytesCounted = 0;
 };
 
 }  // namespace QuatBot
@@ -23,6 +23,9 @@
 #include <QObject>
 #include <QTimer>
 
+#include <memory>
+#include <vector>
+
 #include <connection.h>
 #include <networkaccessmanager.h>
 #include <room.h>
@@ -30,7 +33,19 @@
 #include <csapi/joining.h>
 #include <events/roommessageevent.h>
 
+#ifdef ENABLE_COFFEE
+#include "coffee.h"
+#endif
+#include "accounts.h"
 #include "command.h"
+#include "lagmonitor.h"
+#include "metrics.h"
+#include "recorder.h"
+#include "supervisor.h"
+#ifdef ENABLE_TRACING
+#include "trace.h"
+#endif
+#include "workerpool.h"
 
 int main(int argc, char** argv)
 {
@@ -41,33 +56,302 @@ int main(int argc, char** argv)
     QCommandLineOption userOption(QStringList { "u", "user" }, "User to use to connect.", "user");
     QCommandLineOption passOption(
         QStringList { "p", "password" }, "Password to use to connect (will prompt if unset).", "password");
+    QCommandLineOption recordOption(
+        QStringList { "record" }, "Record the events received to <file>, for qb-replay.", "file");
+    QCommandLineOption accountsOption(
+        QStringList { "accounts" }, "Log in to each of the accounts in the JSON <file>, with its rooms.", "file");
+    QCommandLineOption homeserverOption(QStringList { "homeserver" },
+                                        "Connect to the homeserver at <url> instead of the one of the user-id.",
+                                        "url");
     QCommandLineOption operatorOption(
         QStringList { "o", "operator" }, "Additional user-id to consider as operator.", "userid");
+    QCommandLineOption metricsOption(
+        QStringList { "metrics-port" }, "Serve Prometheus metrics on localhost, on the given port.", "port");
+    QCommandLineOption lagProbeOption(QStringList { "lag-probe" },
+                                      "Measure event-loop lag every <ms> milliseconds (default 50, 0 is off).",
+                                      "ms",
+                                      "50");
+    QCommandLineOption lagThresholdOption(QStringList { "lag-threshold" },
+                                          "Log handlers and stalls longer than <ms> milliseconds (default 100).",
+                                          "ms",
+                                          "100");
+    QCommandLineOption threadsOption(QStringList { "threads" },
+                                     "Run the watchers of the rooms on <n> worker threads (default 0 is none).",
+                                     "n",
+                                     "0");
+    QCommandLineOption observerOption(QStringList { "observer-thread" },
+                                      "Write logs (and other observations) on a separate thread.");
+    QCommandLineOption workersOption(QStringList { "workers" },
+                                     "Spread the rooms over <n> worker processes (default 0 is none).",
+                                     "n",
+                                     "0");
+    // Used by the supervisor to start its workers
+    QCommandLineOption shardOption(QStringList { "shard" }, "Run as worker <i> of a supervisor.", "i");
+    shardOption.setFlags(QCommandLineOption::HiddenFromHelp);
+    QCommandLineOption supervisorOption(QStringList { "supervisor" }, "Socket of the supervisor.", "name");
+    supervisorOption.setFlags(QCommandLineOption::HiddenFromHelp);
+#ifdef ENABLE_TRACING
+    QCommandLineOption traceOption(QStringList { "trace" }, "Record trace spans from the start (see ~trace).");
+#endif
+#ifdef ENABLE_COFFEE
+    QCommandLineOption sharedCoffeeOption(QStringList { "shared-cookiejar" },
+                                          "Keep the cookie-jars of all rooms in one database.");
+    QCommandLineOption globalCoffeeOption(QStringList { "global-coffee" },
+                                          "With --shared-cookiejar, count coffee for each user across all rooms.");
+#endif
     QCommandLineParser parser;
     parser.setApplicationDescription("Chatbot for meeting-management on Matrix");
     parser.addHelpOption();
     parser.addVersionOption();
     parser.addOption(userOption);
     parser.addOption(passOption);
+    parser.addOption(accountsOption);
+    parser.addOption(homeserverOption);
+    parser.addOption(recordOption);
     parser.addOption(operatorOption);
+    parser.addOption(metricsOption);
+    parser.addOption(lagProbeOption);
+    parser.addOption(lagThresholdOption);
+    parser.addOption(threadsOption);
+    parser.addOption(observerOption);
+    parser.addOption(workersOption);
+    parser.addOption(shardOption);
+    parser.addOption(supervisorOption);
+#ifdef ENABLE_TRACING
+    parser.addOption(traceOption);
+#endif
+#ifdef ENABLE_COFFEE
+    parser.addOption(sharedCoffeeOption);
+    parser.addOption(globalCoffeeOption);
+#endif
     parser.addPositionalArgument("rooms", "Room names to join", "[rooms..]");
     parser.process(app);
 
-    if (parser.positionalArguments().count() < 1)
+    // A worker of a supervisor gets its rooms from the supervisor
+    const bool isShard = parser.isSet(shardOption);
+    const int shard = qMax(parser.value(shardOption).toInt(), 0);
+    // .. and accounts from a file have rooms of their own
+    const bool hasAccounts = parser.isSet(accountsOption);
+    if ((parser.positionalArguments().count() < 1) && !isShard && !hasAccounts)
     {
         qWarning() << "Usage: quatbot <options> <room..>\n"
                       "  Give at least one room name.\n";
         return 1;
     }
 
+    const int workers = qMax(parser.value(workersOption).toInt(), 0);
+    if (hasAccounts && (workers > 0 || isShard))
+    {
+        qWarning() << "--accounts can't be combined with --workers.";
+        return 1;
+    }
+    if ((workers > 0) && !isShard)
+    {
+#ifdef ENABLE_COFFEE
+        if (parser.isSet(sharedCoffeeOption))
+        {
+            // Each worker would refill all the jars, and hold up the others with its transactions
+            qWarning() << "--workers can't be combined with --shared-cookiejar.";
+            return 1;
+        }
+#endif
+        // Everything but the rooms and the password goes to the workers, as given
+        QStringList arguments;
+        auto forward = [&](const QCommandLineOption& option)
+        {
+            const QString name = QStringLiteral("--") + option.names().constLast();
+            if (option.valueName().isEmpty())
+            {
+                if (parser.isSet(option))
+                {
+                    arguments << name;
+                }
+                return;
+            }
+            for (const auto& value : parser.values(option))
+            {
+                arguments << name << value;
+            }
+        };
+        for (const auto& option : { userOption,
+                                    homeserverOption,
+                                    recordOption,
+                                    operatorOption,
+                                    metricsOption,
+                                    lagProbeOption,
+                                    lagThresholdOption,
+                                    threadsOption,
+                                    observerOption,
+#ifdef ENABLE_TRACING
+                                    traceOption,
+#endif
+             })
+        {
+            forward(option);
+        }
+        const QString password
+            = parser.isSet(passOption) ? parser.value(passOption) : QString(getpass("Matrix password: "));
+
+        QuatBot::Supervisor supervisor(arguments, parser.positionalArguments(), workers, password);
+        if (!supervisor.start())
+        {
+            return 1;
+        }
+        QObject::connect(&app, &QCoreApplication::aboutToQuit, [&supervisor]() { supervisor.stop(); });
+        return app.exec();
+    }
+
+    if (parser.isSet(metricsOption))
+    {
+        bool ok = false;
+        // Each worker has a port of its own, counting up from the one given
+        const int port = parser.value(metricsOption).toInt(&ok) + shard;
+        if (!ok || port <= 0 || port > 65535)
+        {
+            qWarning() << "Metrics port must be a number from 1 to 65535.";
+            return 1;
+        }
+        if (!QuatBot::MetricsRegistry::instance()->listen(quint16(port)))
+        {
+            return 1;
+        }
+    }
+
+    QuatBot::LagMonitor::instance()->setThreshold(qMax(parser.value(lagThresholdOption).toInt(), 1));
+    QuatBot::LagMonitor::instance()->start(parser.value(lagProbeOption).toInt());
+
+#ifdef ENABLE_TRACING
+    if (parser.isSet(traceOption))
+    {
+        QuatBot::Trace::setEnabled(true);
+    }
+#endif
+
+    int threads = qMax(parser.value(threadsOption).toInt(), 0);
+#ifdef ENABLE_COFFEE
+    if (parser.isSet(sharedCoffeeOption))
+    {
+        QuatBot::Coffee::setSharedStore(parser.isSet(globalCoffeeOption));
+        if (threads > 0)
+        {
+            // The database connection can only be used from the thread that opened it
+            qWarning() << "--threads can't be combined with --shared-cookiejar, running on the main thread.";
+            threads = 0;
+        }
+    }
+#endif
+    if (threads > 0)
+    {
+        QuatBot::WorkerPool::start(threads);
+        QObject::connect(&app, &QCoreApplication::aboutToQuit, []() { QuatBot::WorkerPool::stop(); });
+    }
+    if (parser.isSet(observerOption))
+    {
+        QuatBot::ObserverStage::start();
+        QObject::connect(&app, &QCoreApplication::aboutToQuit, []() { QuatBot::ObserverStage::stop(); });
+    }
+
     QObject::connect(QMatrixClient::NetworkAccessManager::instance(),
                      &QNetworkAccessManager::sslErrors,
                      [](QNetworkReply* reply, const QList<QSslError>& errors) { reply->ignoreSslErrors(errors); });
 
+    if (hasAccounts)
+    {
+        QVector<QuatBot::AccountConfig> configs;
+        if (!QuatBot::AccountConfig::load(parser.value(accountsOption), configs))
+        {
+            return 1;
+        }
+        if (parser.isSet(userOption) && !parser.positionalArguments().isEmpty())
+        {
+            // The account from the command-line comes first
+            QuatBot::AccountConfig config;
+            config.user = parser.value(userOption);
+            config.password = parser.value(passOption);
+            config.homeserver = parser.value(homeserverOption);
+            config.rooms = parser.positionalArguments();
+            configs.prepend(config);
+        }
+        if (!QuatBot::AccountConfig::uniqueRooms(configs))
+        {
+            return 1;
+        }
+
+        std::vector<std::unique_ptr<QuatBot::Account>> accounts;
+        int done = 0;  // accounts without bots
+        for (auto& config : configs)
+        {
+            config.operators += parser.values(operatorOption);
+            if (config.password.isEmpty())
+            {
+                config.password = QString(getpass(qPrintable(QString("Matrix password for %1: ").arg(config.user))));
+            }
+            auto account = std::make_unique<QuatBot::Account>(config);
+            if (parser.isSet(recordOption))
+            {
+                // Each account records to a file of its own
+                const QString file = QString("%1.%2").arg(parser.value(recordOption)).arg(accounts.size());
+                if (!account->record(file))
+                {
+                    return 1;
+                }
+            }
+            account->setFinished(
+                [&done, &accounts]()
+                {
+                    // The bots of one account don't take the others down with them
+                    if (++done == int(accounts.size()))
+                    {
+                        QTimer::singleShot(0, qApp, &QCoreApplication::quit);
+                    }
+                });
+            accounts.push_back(std::move(account));
+        }
+        for (auto& account : accounts)
+        {
+            account->connectToServer();
+        }
+        return app.exec();
+    }
+
     QMatrixClient::Connection conn;
+    std::unique_ptr<QuatBot::SyncRecorder> recorder;
+    if (parser.isSet(recordOption))
+    {
+        // Each worker records to a file of its own
+        const QString file = isShard ? QString("%1.%2").arg(parser.value(recordOption)).arg(shard)
+                                     : parser.value(recordOption);
+        recorder = std::make_unique<QuatBot::SyncRecorder>(conn, file);
+        if (!recorder->isOpen())
+        {
+            return 1;
+        }
+    }
+    if (parser.isSet(homeserverOption))
+    {
+        // Skips the server discovery, e.g. for a test server
+        conn.setHomeserver(QUrl::fromUserInput(parser.value(homeserverOption)));
+    }
+    std::unique_ptr<QuatBot::ShardWorker> shardWorker;
+    QString password = parser.value(passOption);
+    if (isShard)
+    {
+        shardWorker = std::make_unique<QuatBot::ShardWorker>(shard, conn, parser.values(operatorOption));
+        if (!shardWorker->attach(parser.value(supervisorOption)))
+        {
+            return 1;
+        }
+        // From the supervisor, which asked once; don't pass it on to fortune(6) and friends
+        password = qEnvironmentVariable("QUATBOT_PASSWORD", password);
+        qunsetenv("QUATBOT_PASSWORD");
+    }
+    if (!parser.isSet(passOption) && password.isEmpty())
+    {
+        password = QString(getpass("Matrix password: "));
+    }
     conn.connectToServer(parser.value(userOption),
-                         parser.isSet(passOption) ? parser.value(passOption) : QString(getpass("Matrix password: ")),
-                         "quatbot");  // user pass device
+                         password,
+                         isShard ? QString("quatbot-shard-%1").arg(shard) : "quatbot");  // user pass device
 
     QObject::connect(&conn,
                      &QMatrixClient::Connection::connected,
@@ -76,6 +360,11 @@ int main(int argc, char** argv)
                          qDebug() << "Connected to" << conn.homeserver() << "as" << conn.userId();
                          conn.setLazyLoading(false);
                          conn.syncLoop();
+                         if (shardWorker)
+                         {
+                             shardWorker->connected();
+                             return;
+                         }
                          for (const auto& r : parser.positionalArguments())
                          {
                              // Unused, gets cleaned up by itself
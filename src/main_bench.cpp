@@ -0,0 +1,484 @@
+/*
+ *  SPDX-License-Identifier: BSD-2-Clause
+ *  SPDX-License-File: LICENSE
+ *
+ * Copyright 2019 Adriaan de Groot <groot@kde.org>
+ */
+
+/** @file Microbenchmarks for the hot paths of the bot
+ *
+ * Everything runs offline: rooms are filled with synthetic events
+ * (built as JSON, as a sync would deliver them) and the bots are
+ * created with the offline Bot constructor. Results are printed as
+ * JSON, one object per benchmark, with the time and the number of
+ * heap allocations per operation.
+ */
+
+#ifdef ENABLE_COFFEE
+#include "coffee.h"
+#endif
+#include "alloccount.h"
+#include "clock.h"
+#include "envelope.h"
+#include "log_impl.h"
+#include "quatbot.h"
+#include "watcher.h"
+
+#include <connection.h>
+#include <room.h>
+#include <syncdata.h>
+
+#include <events/roommessageevent.h>
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QStandardPaths>
+
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+namespace
+{
+static const QString ROOM_PREFIX = QStringLiteral("!bench-%1:bench.invalid");
+
+static bool verbose = false;
+
+static void messageHandler(QtMsgType type, const QMessageLogContext& context, const QString& message)
+{
+    // The bot logs every message to qDebug, which would swamp the results
+    if (verbose || type == QtFatalMsg)
+    {
+        fprintf(stderr, "%s\n", qPrintable(qFormatLogMessage(type, context, message)));
+    }
+}
+
+QString userId(int i)
+{
+    return QStringLiteral("@user%1:bench.invalid").arg(i);
+}
+
+QJsonObject memberEvent(int i)
+{
+    return QJsonObject { { "type", "m.room.member" },
+                         { "event_id", QStringLiteral("$member%1").arg(i) },
+                         { "sender", userId(i) },
+                         { "state_key", userId(i) },
+                         { "origin_server_ts", 1600000000000LL + i },
+                         { "content",
+                           QJsonObject { { "membership", "join" },
+                                         { "displayname", QStringLiteral("User %1").arg(i) } } } };
+}
+
+QJsonObject messageEvent(qint64 serial, const QString& sender, const QString& body)
+{
+    return QJsonObject { { "type", "m.room.message" },
+                         { "event_id", QStringLiteral("$message%1").arg(serial) },
+                         { "sender", sender },
+                         { "origin_server_ts", 1600000000000LL + serial },
+                         { "content", QJsonObject { { "msgtype", "m.text" }, { "body", body } } } };
+}
+
+/// @brief Delivers @p state and @p timeline events to @p room, as a sync would
+void feed(Quotient::Room* room, const QJsonArray& state, const QJsonArray& timeline)
+{
+    const QJsonObject timelineData { { "events", timeline }, { "limited", false }, { "prev_batch", "bench" } };
+    const QJsonObject data { { "state", QJsonObject { { "events", state } } }, { "timeline", timelineData } };
+    room->updateData(Quotient::SyncRoomData(room->id(), Quotient::JoinState::Join, data), false);
+}
+
+/// @brief A joined room with @p members members, none of them the bot
+Quotient::Room* makeRoom(Quotient::Connection& conn, const QString& name, int members)
+{
+    auto* room = conn.provideRoom(ROOM_PREFIX.arg(name), Quotient::JoinState::Join);
+    QJsonArray state;
+    for (int i = 0; i < members; ++i)
+    {
+        state.append(memberEvent(i));
+    }
+    feed(room, state, QJsonArray());
+    return room;
+}
+
+/// @brief Some of the things people say, and some commands
+QString chatter(qint64 serial)
+{
+    static const QStringList lines {
+        QStringLiteral("good morning everyone"),
+        QStringLiteral("I pushed the fix for the build, please review"),
+        QStringLiteral("~echo hello there"),
+        QStringLiteral("has anyone seen the release schedule?"),
+        QStringLiteral("~log status"),
+        QStringLiteral("that sounds good to me"),
+#ifdef ENABLE_COFFEE
+        QStringLiteral("~coffee"),
+#else
+        QStringLiteral("~meeting status"),
+#endif
+        QStringLiteral("let's talk about it at the meeting"),
+        QStringLiteral("~quatbot ops status"),
+        QStringLiteral("thanks!"),
+    };
+    return lines[int(serial % lines.count())];
+}
+
+struct Result
+{
+    QString name;
+    qint64 operations = 0;
+    qint64 nsecs = 0;
+    quint64 allocations = 0;
+    QJsonObject extra;
+
+    QJsonObject toJson() const
+    {
+        QJsonObject o { { "name", name },
+                        { "operations", operations },
+                        { "total_ns", nsecs },
+                        { "ns_per_op", operations ? double(nsecs) / operations : 0.0 },
+                        { "ops_per_sec", nsecs ? double(operations) * 1e9 / nsecs : 0.0 },
+                        { "allocations", qint64(allocations) },
+                        { "allocs_per_op", operations ? double(allocations) / operations : 0.0 } };
+        for (auto it = extra.constBegin(); it != extra.constEnd(); ++it)
+        {
+            o.insert(it.key(), it.value());
+        }
+        return o;
+    }
+};
+
+/// @brief Runs @p f, which does @p operations operations, and measures it
+template<typename F>
+Result measure(const QString& name, qint64 operations, F f)
+{
+    Result r;
+    r.name = name;
+    r.operations = operations;
+
+    const quint64 allocationsBefore = QuatBot::allocationCount();
+    QElapsedTimer timer;
+    timer.start();
+    f();
+    r.nsecs = timer.nsecsElapsed();
+    r.allocations = QuatBot::allocationCount() - allocationsBefore;
+    return r;
+}
+
+Result benchCommandArgs(double scale)
+{
+    // Build the events up-front; that's not what is measured
+    std::vector<std::unique_ptr<Quotient::RoomMessageEvent>> events;
+    for (int i = 0; i < 1000; ++i)
+    {
+        events.emplace_back(std::make_unique<Quotient::RoomMessageEvent>(messageEvent(i, userId(i % 50), chatter(i))));
+    }
+
+    const int rounds = qMax(1, int(100 * scale));
+    int commands = 0;
+    Result r = measure(QStringLiteral("commandargs"),
+                       qint64(rounds) * qint64(events.size()),
+                       [&]()
+                       {
+                           for (int round = 0; round < rounds; ++round)
+                           {
+                               // As the bot does it: only commands are parsed
+                               for (const auto& e : events)
+                               {
+                                   const QuatBot::MessageEnvelope envelope(e.get());
+                                   if (envelope.isCommand())
+                                   {
+                                       QuatBot::CommandArgs cmd(envelope);
+                                       commands += cmd.isValid() ? 1 : 0;
+                                   }
+                               }
+                           }
+                       });
+    r.extra.insert("commands", commands);
+    return r;
+}
+
+Result benchDispatch(Quotient::Connection& conn, double scale)
+{
+    auto* room = makeRoom(conn, QStringLiteral("dispatch"), 100);
+    auto* bot = new QuatBot::Bot(conn, room);
+
+    const int batches = qMax(1, int(200 * scale));
+    const int batchSize = 100;
+    qint64 serial = 0;
+
+    // Build all the batches first, feeding them is what is measured
+    std::vector<QJsonArray> timelines(batches);
+    for (auto& timeline : timelines)
+    {
+        for (int i = 0; i < batchSize; ++i, ++serial)
+        {
+            timeline.append(messageEvent(serial, userId(int(serial % 100)), chatter(serial)));
+        }
+    }
+
+    Result r = measure(QStringLiteral("dispatch"),
+                       qint64(batches) * batchSize,
+                       [&]()
+                       {
+                           for (const auto& timeline : timelines)
+                           {
+                               feed(room, QJsonArray(), timeline);
+                               QCoreApplication::processEvents();
+                           }
+                       });
+    r.extra.insert("batch_size", batchSize);
+    delete bot;
+    return r;
+}
+
+Result benchUserLookup(Quotient::Connection& conn, int members, double scale)
+{
+    auto* room = makeRoom(conn, QStringLiteral("users%1").arg(members), members);
+    auto* bot = new QuatBot::Bot(conn, room);
+
+    // A nickname in the middle, an id, and a word that matches nobody
+    const QStringList words { QStringLiteral("User"),
+                              QString::number(members / 2),
+                              userId(1),
+                              QStringLiteral("nobody") };
+    const int lookups = qMax(1, int(scale * 2000000 / (members + 100)));
+    int found = 0;
+    Result r = measure(QStringLiteral("userlookup_%1").arg(members),
+                       lookups,
+                       [&]()
+                       {
+                           for (int i = 0; i < lookups; ++i)
+                           {
+                               found += bot->userLookup(words).count();
+                           }
+                       });
+    r.extra.insert("members", members);
+    r.extra.insert("found", found);
+    delete bot;
+    return r;
+}
+
+Result benchLogger(double scale)
+{
+    QuatBot::LoggerFile log;
+    log.open(QStringLiteral("bench"));
+    const QString fileName = log.fileName();
+
+    const int lines = qMax(1, int(100000 * scale));
+    Result r = measure(QStringLiteral("logger"),
+                       lines,
+                       [&]()
+                       {
+                           for (int i = 0; i < lines; ++i)
+                           {
+                               log.log(chatter(i));
+                           }
+                           log.flush();
+                       });
+    r.extra.insert("bytes", log.bytesWritten());
+    log.close();
+    QFile::remove(fileName);
+    return r;
+}
+
+Result benchMeeting(Quotient::Connection& conn, double scale)
+{
+    static constexpr const int participants = 200;
+    auto* room = makeRoom(conn, QStringLiteral("meeting"), participants);
+
+    // Reminders are what take the time in a real meeting
+    QuatBot::VirtualClock clock;
+    QuatBot::Clock::setInstance(&clock);
+    auto* bot = new QuatBot::Bot(conn, room);
+
+    const int meetings = qMax(1, int(20 * scale));
+    qint64 serial = 0;
+    auto say = [&](int user, const QString& body)
+    {
+        feed(room, QJsonArray(), QJsonArray { messageEvent(serial++, userId(user), body) });
+    };
+
+    // A roll-call that everyone answers, and then everyone gets a turn
+    // after being reminded once; user 0 chairs and speaks last.
+    Result r = measure(QStringLiteral("meeting"),
+                       meetings,
+                       [&]()
+                       {
+                           for (int m = 0; m < meetings; ++m)
+                           {
+                               say(0, QStringLiteral("~rollcall"));
+                               QJsonArray hello;
+                               for (int i = 1; i < participants; ++i)
+                               {
+                                   hello.append(messageEvent(serial++, userId(i), QStringLiteral("hi")));
+                               }
+                               feed(room, QJsonArray(), hello);
+                               clock.advance(60000);
+                               say(0, QStringLiteral("~next"));
+                               for (int i = 1; i < participants; ++i)
+                               {
+                                   clock.advance(30000);
+                                   say(i, QStringLiteral("~next"));
+                               }
+                               say(0, QStringLiteral("~next"));
+                               QCoreApplication::processEvents();
+                           }
+                       });
+    r.extra.insert("participants", participants);
+    r.extra.insert("simulated_seconds", clock.elapsed() / 1000);
+    delete bot;
+    QuatBot::Clock::setInstance(nullptr);
+    return r;
+}
+
+#ifdef ENABLE_COFFEE
+QList<Result> benchCoffee(Quotient::Connection& conn, double scale)
+{
+    auto* room = makeRoom(conn, QStringLiteral("coffee"), 0);
+
+    // Start with an empty jar (this is the test-mode data dir)
+    QDir dataDir(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation));
+    for (const auto& f : dataDir.entryList({ QStringLiteral("cookiejar-bench-coffeebenchinvalid*") }, QDir::Files))
+    {
+        dataDir.remove(f);
+    }
+
+    const int users = qMax(1, int(5000 * scale));
+    auto* bot = new QuatBot::Bot(conn, room);
+    auto* coffee = bot->getWatcher(QStringLiteral("coffee"));
+
+    // Each user has a coffee, which changes the jar once per user
+    Result save = measure(QStringLiteral("coffee_save"),
+                          users,
+                          [&]()
+                          {
+                              for (int i = 0; i < users; ++i)
+                              {
+                                  QuatBot::CommandArgs cmd(QStringLiteral("~coffee"));
+                                  cmd.user = QuatBot::UserId(userId(i));
+                                  coffee->handleCommand(cmd);
+                                  if (i % 100 == 99)
+                                  {
+                                      bot->message(QuatBot::Bot::Flush {});
+                                  }
+                              }
+                              bot->message(QuatBot::Bot::Flush {});
+                          });
+    save.extra.insert("users", users);
+    delete bot;
+
+    // Creating the bot (and its watchers) loads the jar again
+    Result load = measure(QStringLiteral("coffee_load"), 1, [&]() { bot = new QuatBot::Bot(conn, room); });
+    load.extra.insert("users", users);
+    delete bot;
+
+    return { save, load };
+}
+#endif
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("QuatBot");
+    app.setApplicationVersion("0.8");
+    // Keep the cookie-jars of the benchmarks away from the real ones
+    QStandardPaths::setTestModeEnabled(true);
+
+    QCommandLineOption scaleOption(
+        QStringList { "s", "scale" }, "Multiply the amount of work per benchmark by <factor>.", "factor", "1");
+    QCommandLineOption outputOption(
+        QStringList { "o", "output" }, "Write the JSON results to <file> instead of standard output.", "file");
+    QCommandLineOption verboseOption(QStringList { "v", "verbose" }, "Show the log messages of the bot.");
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Benchmarks for the QuatBot hot paths");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addOption(scaleOption);
+    parser.addOption(outputOption);
+    parser.addOption(verboseOption);
+    parser.addPositionalArgument("benchmarks",
+                                 "Benchmarks to run (commandargs, dispatch, userlookup, meeting, logger, coffee)",
+                                 "[benchmarks..]");
+    parser.process(app);
+
+    bool ok = false;
+    const double scale = parser.value(scaleOption).toDouble(&ok);
+    if (!ok || scale <= 0)
+    {
+        qWarning() << "Scale must be a positive number.";
+        return 1;
+    }
+
+    verbose = parser.isSet(verboseOption);
+    qInstallMessageHandler(messageHandler);
+
+    const QStringList selected = parser.positionalArguments();
+    auto wanted = [&selected](const QString& name) { return selected.isEmpty() || selected.contains(name); };
+
+    Quotient::Connection conn;  // never connected
+    QList<Result> results;
+    if (wanted(QStringLiteral("commandargs")))
+    {
+        results << benchCommandArgs(scale);
+    }
+    if (wanted(QStringLiteral("dispatch")))
+    {
+        results << benchDispatch(conn, scale);
+    }
+    if (wanted(QStringLiteral("userlookup")))
+    {
+        for (int members : { 10, 100, 1000, 10000, 50000 })
+        {
+            results << benchUserLookup(conn, members, scale);
+        }
+    }
+    if (wanted(QStringLiteral("meeting")))
+    {
+        results << benchMeeting(conn, scale);
+    }
+    if (wanted(QStringLiteral("logger")))
+    {
+        results << benchLogger(scale);
+    }
+#ifdef ENABLE_COFFEE
+    if (wanted(QStringLiteral("coffee")))
+    {
+        results << benchCoffee(conn, scale);
+    }
+#endif
+
+    QJsonArray benchmarks;
+    for (const auto& r : results)
+    {
+        benchmarks.append(r.toJson());
+    }
+    const QByteArray json = QJsonDocument(QJsonObject { { "version", app.applicationVersion() },
+                                                        { "scale", scale },
+                                                        { "benchmarks", benchmarks } })
+                                .toJson();
+    qInstallMessageHandler(nullptr);
+
+    if (parser.isSet(outputOption))
+    {
+        QFile f(parser.value(outputOption));
+        if (!f.open(QFile::WriteOnly) || f.write(json) != json.size())
+        {
+            qWarning() << "Could not write" << f.fileName();
+            return 1;
+        }
+    }
+    else
+    {
+        fwrite(json.constData(), 1, size_t(json.size()), stdout);
+    }
+    return 0;
+}
@@ -21,8 +21,12 @@
 #include <QDebug>
 #include <QNetworkReply>
 #include <QObject>
+#include <QThread>
+#include <QThreadPool>
 #include <QTimer>
 
+#include <memory>
+
 #include <connection.h>
 #include <networkaccessmanager.h>
 #include <room.h>
@@ -31,6 +35,7 @@
 #include <events/roommessageevent.h>
 
 #include "command.h"
+#include "recorder.h"
 
 int main(int argc, char** argv)
 {
@@ -41,8 +46,17 @@ int main(int argc, char** argv)
     QCommandLineOption userOption(QStringList { "u", "user" }, "User to use to connect.", "user");
     QCommandLineOption passOption(
         QStringList { "p", "password" }, "Password to use to connect (will prompt if unset).", "password");
+    QCommandLineOption recordOption(
+        QStringList { "record" }, "Record the events received to <file>, for qb-replay.", "file");
+    QCommandLineOption homeserverOption(QStringList { "homeserver" },
+                                        "Connect to the homeserver at <url> instead of the one of the user-id.",
+                                        "url");
     QCommandLineOption usersOnlyOption(QStringList { "l", "list-users" }, "List users in the room, then exit.");
+    QCommandLineOption displayNamesOption(QStringList { "d", "display-names" },
+                                          "With --list-users, also list display names.");
     QCommandLineOption amountOption(QStringList { "n", "message-count" }, "Number of messages to load", "count");
+    QCommandLineOption jobsOption(
+        QStringList { "j", "jobs" }, "Number of threads used to format messages (default: all cores)", "jobs");
     QCommandLineOption sinceOption(
         QStringList { "s", "since" }, "Start date-time to load (yyyy-MM-ddTHH:mm:ss)", "since");
     QCommandLineParser parser;
@@ -51,9 +65,13 @@ int main(int argc, char** argv)
     parser.addVersionOption();
     parser.addOption(userOption);
     parser.addOption(passOption);
+    parser.addOption(homeserverOption);
+    parser.addOption(recordOption);
     parser.addOption(usersOnlyOption);
+    parser.addOption(displayNamesOption);
     parser.addOption(amountOption);
     parser.addOption(sinceOption);
+    parser.addOption(jobsOption);
     parser.addPositionalArgument("rooms", "Room names to join", "[rooms..]");
     parser.process(app);
 
@@ -70,11 +88,39 @@ int main(int argc, char** argv)
         return 1;
     }
 
+    int jobs = QThread::idealThreadCount();
+    if (parser.isSet(jobsOption))
+    {
+        bool ok = false;
+        jobs = parser.value(jobsOption).toInt(&ok);
+        if (!ok || jobs < 1)
+        {
+            qWarning() << "Usage: qb-dumper <options> <room..>\n"
+                          "  The -j|--jobs value must be a positive number\n";
+            return 1;
+        }
+    }
+    QThreadPool::globalInstance()->setMaxThreadCount(jobs);
+
     QObject::connect(QMatrixClient::NetworkAccessManager::instance(),
                      &QNetworkAccessManager::sslErrors,
                      [](QNetworkReply* reply, const QList<QSslError>& errors) { reply->ignoreSslErrors(errors); });
 
     QMatrixClient::Connection conn;
+    std::unique_ptr<QuatBot::SyncRecorder> recorder;
+    if (parser.isSet(recordOption))
+    {
+        recorder = std::make_unique<QuatBot::SyncRecorder>(conn, parser.value(recordOption));
+        if (!recorder->isOpen())
+        {
+            return 1;
+        }
+    }
+    if (parser.isSet(homeserverOption))
+    {
+        // Skips the server discovery, e.g. for a test server
+        conn.setHomeserver(QUrl::fromUserInput(parser.value(homeserverOption)));
+    }
     conn.connectToServer(parser.value(userOption),
                          parser.isSet(passOption) ? parser.value(passOption) : QString(getpass("Matrix password: ")),
                          "quatbot");  // user pass device
@@ -85,12 +131,18 @@ int main(int argc, char** argv)
                      {
                          qDebug() << "Connected to" << conn.homeserver() << "as" << conn.userId();
                          conn.setLazyLoading(false);
-                         conn.syncLoop();
+                         if (!parser.isSet(usersOnlyOption))
+                         {
+                             // Listing users asks for the members directly, no need to sync
+                             conn.syncLoop();
+                         }
                          for (const auto& r : parser.positionalArguments())
                          {
                              // Unused, gets cleaned up by itself
                              auto* bot = new QuatBot::DumpBot(conn, r);
                              bot->setShowUsersOnly(parser.isSet(usersOnlyOption));
+                             bot->setShowDisplayNames(parser.isSet(displayNamesOption));
+                             bot->setRenderJobs(jobs);
                              if (parser.isSet(amountOption))
                              {
                                  bot->setLogCriterion(parser.value(amountOption).toUInt());
@@ -0,0 +1,337 @@
+/*
+ *  SPDX-License-Identifier: BSD-2-Clause
+ *  SPDX-License-File: LICENSE
+ *
+ * Copyright 2019 Adriaan de Groot <groot@kde.org>
+ */
+
+/** @file Load generator for the bot, against a mock homeserver
+ *
+ * This starts a MockHomeserver on localhost and (optionally) a quatbot
+ * process that connects to it and joins all of its rooms. Once the bot
+ * has joined, messages are injected at a steady rate, spread over the
+ * rooms and members; a fraction of them are `~echo load <n>` commands,
+ * and the bot's answers to those give the reply latency. Every few
+ * seconds a line with the sustained rates, latency and memory use is
+ * printed, and a JSON summary at the end.
+ */
+
+#include "mockserver.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QProcess>
+#include <QRandomGenerator>
+#include <QTimer>
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+namespace
+{
+// Messages are injected in small bursts, this many times per second
+static constexpr const int INJECT_HZ = 100;
+
+/// @brief Resident memory of process @p pid (0 is this process) in kB, or -1
+qint64 residentKB(qint64 pid)
+{
+    QFile f(pid ? QStringLiteral("/proc/%1/status").arg(pid) : QStringLiteral("/proc/self/status"));
+    if (!f.open(QFile::ReadOnly))
+    {
+        return -1;
+    }
+    for (const auto& line : f.readAll().split('\n'))
+    {
+        if (line.startsWith("VmRSS:"))
+        {
+            return line.mid(6).trimmed().split(' ').value(0).toLongLong();
+        }
+    }
+    return -1;
+}
+
+/// @brief Reply latencies (in ms) collected over one reporting interval, or the whole run
+struct Latencies
+{
+    std::vector<double> samples;
+
+    double percentile(double p)
+    {
+        if (samples.empty())
+        {
+            return 0.0;
+        }
+        std::sort(samples.begin(), samples.end());
+        return samples[std::min(samples.size() - 1, size_t(p * samples.size()))];
+    }
+    QString summary()
+    {
+        if (samples.empty())
+        {
+            return QStringLiteral("no replies");
+        }
+        return QStringLiteral("p50 %1ms p99 %2ms max %3ms")
+            .arg(percentile(0.5), 0, 'f', 1)
+            .arg(percentile(0.99), 0, 'f', 1)
+            .arg(samples.back(), 0, 'f', 1);
+    }
+};
+
+class LoadGenerator : public QObject
+{
+public:
+    struct Options
+    {
+        double rate = 100;  ///< messages per second, over all rooms
+        double commands = 0.1;  ///< fraction of messages that are commands
+        int duration = 60;  ///< seconds, after the bot has joined
+        int report = 5;  ///< seconds between reports
+    };
+
+    LoadGenerator(QuatBot::MockHomeserver& server, const Options& options)
+        : m_server(server)
+        , m_options(options)
+        , m_random(20190101)
+    {
+        m_server.setSentCallback([this](int room, const QString& body) { sent(room, body); });
+        connect(&m_injector, &QTimer::timeout, this, &LoadGenerator::inject);
+        connect(&m_reporter, &QTimer::timeout, this, &LoadGenerator::report);
+        m_injector.setTimerType(Qt::PreciseTimer);
+        m_injector.setInterval(1000 / INJECT_HZ);
+        m_reporter.setInterval(m_options.report * 1000);
+    }
+
+    void setBot(QProcess* bot) { m_bot = bot; }
+
+    /// @brief Starts injecting once the bot has joined all the rooms
+    void start()
+    {
+        if (m_server.joinedCount() < m_server.roomCount())
+        {
+            QTimer::singleShot(100, this, &LoadGenerator::start);
+            return;
+        }
+        qDebug() << "Bot has joined" << m_server.roomCount() << "rooms, starting load.";
+        m_clock.start();
+        m_lastReport = 0;
+        m_injector.start();
+        m_reporter.start();
+        QTimer::singleShot(m_options.duration * 1000, this, &LoadGenerator::finish);
+    }
+
+private:
+    void inject()
+    {
+        // Keep up with the rate even if the timer is late
+        const double due = m_options.rate * m_clock.elapsed() / 1000.0;
+        while (m_injected < due)
+        {
+            const int room = int(m_injected % quint64(m_server.roomCount()));
+            const int member = int(m_random.bounded(qMax(m_server.memberCount(), 1)));
+            if (m_random.generateDouble() < m_options.commands)
+            {
+                m_pending.insert(m_sequence, m_clock.nsecsElapsed());
+                m_server.inject(room, member, QStringLiteral("~echo load %1").arg(m_sequence++));
+            }
+            else
+            {
+                m_server.inject(room, member, QStringLiteral("just chatting, message %1").arg(m_injected));
+            }
+            m_injected++;
+        }
+    }
+
+    void sent(int, const QString& body)
+    {
+        // Replies to several commands may have been flushed together
+        for (const auto& line : body.split('\n'))
+        {
+            if (!line.startsWith(QStringLiteral("load ")))
+            {
+                continue;
+            }
+            auto it = m_pending.find(line.mid(5).toLongLong());
+            if (it != m_pending.end())
+            {
+                const double ms = (m_clock.nsecsElapsed() - it.value()) / 1e6;
+                m_interval.samples.push_back(ms);
+                m_total.samples.push_back(ms);
+                m_pending.erase(it);
+            }
+        }
+    }
+
+    void report()
+    {
+        const qint64 elapsed = m_clock.elapsed();
+        const double seconds = qMax<qint64>(elapsed - m_lastReport, 1) / 1000.0;
+        const auto& stats = m_server.stats();
+        fprintf(stderr,
+                "%6.1fs  injected %8.1f/s  delivered %8.1f/s  replies %6.1f/s  %s  unanswered %d  rss %lldkB mock, "
+                "%lldkB bot\n",
+                elapsed / 1000.0,
+                (stats.injected - m_lastStats.injected) / seconds,
+                (stats.delivered - m_lastStats.delivered) / seconds,
+                m_interval.samples.size() / seconds,
+                qPrintable(m_interval.summary()),
+                m_pending.count(),
+                residentKB(0),
+                m_bot ? residentKB(m_bot->processId()) : -1LL);
+        m_interval.samples.clear();
+        m_lastStats = stats;
+        m_lastReport = elapsed;
+    }
+
+    void finish()
+    {
+        m_injector.stop();
+        m_reporter.stop();
+        report();
+
+        const double seconds = qMax<qint64>(m_clock.elapsed(), 1) / 1000.0;
+        const auto& stats = m_server.stats();
+        const QJsonObject summary { { "seconds", seconds },
+                                    { "rooms", m_server.roomCount() },
+                                    { "members", m_server.memberCount() },
+                                    { "injected_per_sec", stats.injected / seconds },
+                                    { "delivered_per_sec", stats.delivered / seconds },
+                                    { "sent_per_sec", stats.sent / seconds },
+                                    { "commands", m_sequence },
+                                    { "replies", qint64(m_total.samples.size()) },
+                                    { "latency_p50_ms", m_total.percentile(0.5) },
+                                    { "latency_p99_ms", m_total.percentile(0.99) },
+                                    { "latency_max_ms", m_total.samples.empty() ? 0.0 : m_total.samples.back() },
+                                    { "rss_mock_kb", residentKB(0) },
+                                    { "rss_bot_kb", m_bot ? residentKB(m_bot->processId()) : -1 } };
+        const QByteArray json = QJsonDocument(summary).toJson();
+        fwrite(json.constData(), 1, size_t(json.size()), stdout);
+
+        if (m_bot)
+        {
+            // Ending it is not an error (as a crash during the run is)
+            QObject::disconnect(m_bot, &QProcess::errorOccurred, nullptr, nullptr);
+            m_bot->terminate();
+            m_bot->waitForFinished(5000);
+        }
+        QCoreApplication::quit();
+    }
+
+    QuatBot::MockHomeserver& m_server;
+    Options m_options;
+    QRandomGenerator m_random;  // fixed seed, so runs are comparable
+    QProcess* m_bot = nullptr;
+
+    QTimer m_injector;
+    QTimer m_reporter;
+    QElapsedTimer m_clock;
+    qint64 m_lastReport = 0;
+    QuatBot::MockHomeserver::Stats m_lastStats;
+
+    quint64 m_injected = 0;
+    qint64 m_sequence = 0;
+    QHash<qint64, qint64> m_pending;  // command sequence number to injection time (ns)
+    Latencies m_interval;
+    Latencies m_total;
+};
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("QuatBot");
+    app.setApplicationVersion("0.8");
+
+    QCommandLineOption portOption(
+        QStringList { "port" }, "Serve the mock homeserver on <port> (default: any free port).", "port", "0");
+    QCommandLineOption roomsOption(QStringList { "r", "rooms" }, "Number of rooms (default 10).", "count", "10");
+    QCommandLineOption membersOption(
+        QStringList { "m", "members" }, "Number of members in each room (default 100).", "count", "100");
+    QCommandLineOption historyOption(
+        QStringList { "history" }, "Number of messages in each room before the bot joins (default 0).", "count", "0");
+    QCommandLineOption rateOption(
+        QStringList { "rate" }, "Messages per second, over all rooms (default 100).", "rate", "100");
+    QCommandLineOption commandsOption(
+        QStringList { "commands" }, "Fraction of the messages that are commands (default 0.1).", "fraction", "0.1");
+    QCommandLineOption durationOption(
+        QStringList { "d", "duration" }, "Seconds of load after the bot has joined (default 60).", "seconds", "60");
+    QCommandLineOption reportOption(
+        QStringList { "report" }, "Seconds between progress reports (default 5).", "seconds", "5");
+    QCommandLineOption botOption(QStringList { "bot" }, "Start the quatbot at <path> against the mock server.", "path");
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Load generator for QuatBot, with a mock homeserver");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addOption(portOption);
+    parser.addOption(roomsOption);
+    parser.addOption(membersOption);
+    parser.addOption(historyOption);
+    parser.addOption(rateOption);
+    parser.addOption(commandsOption);
+    parser.addOption(durationOption);
+    parser.addOption(reportOption);
+    parser.addOption(botOption);
+    parser.process(app);
+
+    QuatBot::MockHomeserver::Options serverOptions;
+    serverOptions.rooms = parser.value(roomsOption).toInt();
+    serverOptions.members = parser.value(membersOption).toInt();
+    serverOptions.history = parser.value(historyOption).toInt();
+    LoadGenerator::Options loadOptions;
+    loadOptions.rate = parser.value(rateOption).toDouble();
+    loadOptions.commands = parser.value(commandsOption).toDouble();
+    loadOptions.duration = parser.value(durationOption).toInt();
+    loadOptions.report = parser.value(reportOption).toInt();
+    if (serverOptions.rooms < 1 || serverOptions.members < 1 || serverOptions.history < 0 || loadOptions.rate <= 0
+        || loadOptions.commands < 0 || loadOptions.commands > 1 || loadOptions.duration < 1 || loadOptions.report < 1)
+    {
+        qWarning() << "Usage: qb-loadtest <options>\n"
+                      "  Rooms, members, rate, duration and report must be positive, commands from 0 to 1.\n";
+        return 1;
+    }
+
+    QuatBot::MockHomeserver server(serverOptions);
+    if (!server.listen(quint16(parser.value(portOption).toUInt())))
+    {
+        return 1;
+    }
+
+    LoadGenerator load(server, loadOptions);
+    QStringList rooms;
+    for (int i = 0; i < server.roomCount(); ++i)
+    {
+        rooms << server.roomAlias(i);
+    }
+    if (parser.isSet(botOption))
+    {
+        // The bot logs every message, which is not what the load test is about
+        auto* bot = new QProcess(&app);
+        bot->setStandardOutputFile(QProcess::nullDevice());
+        bot->setStandardErrorFile(QProcess::nullDevice());
+        QObject::connect(bot,
+                         &QProcess::errorOccurred,
+                         [bot]()
+                         {
+                             qWarning() << "Could not run the bot" << bot->program() << bot->errorString();
+                             QCoreApplication::exit(1);
+                         });
+        bot->start(parser.value(botOption),
+                   QStringList { "--homeserver", server.url().toString(), "-u", "@bot:" + serverOptions.serverName }
+                       + QStringList { "-p", "mock" } + rooms);
+        load.setBot(bot);
+    }
+    else
+    {
+        qDebug() << "Waiting for a bot on" << server.url().toString() << "to join" << rooms.join(' ');
+    }
+    load.start();
+
+    return app.exec();
+}
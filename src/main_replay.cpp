@@ -0,0 +1,374 @@
+/*
+ *  SPDX-License-Identifier: BSD-2-Clause
+ *  SPDX-License-File: LICENSE
+ *
+ * Copyright 2019 Adriaan de Groot <groot@kde.org>
+ */
+
+/** @file Replays a recorded sync into the bot, offline
+ *
+ * The recording is made with `quatbot --record <file>` (or the same
+ * option of qb-dumper), see SyncRecorder. All of it is read first, then
+ * fed to offline bots, one per room, as fast as possible: batches are
+ * delivered to the rooms as a sync would, and the bots handle them
+ * through their usual addedMessages() path.
+ *
+ * The bot's own messages in the recording are left out; what the bot
+ * sends during the replay can be written to a file and compared with
+ * that of an earlier run (e.g. of an older version) with --expect.
+ * The results are printed as JSON.
+ *
+ * So that runs can be compared, each starts with empty cookie-jars, and
+ * the bot's clock is a VirtualClock that follows the times recorded.
+ */
+
+#include "alloccount.h"
+#include "clock.h"
+#include "dumpbot.h"
+#include "quatbot.h"
+
+#include <connection.h>
+#include <room.h>
+#include <syncdata.h>
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSet>
+#include <QStandardPaths>
+
+#include <cstdio>
+#include <vector>
+
+namespace
+{
+static bool verbose = false;
+
+static void messageHandler(QtMsgType type, const QMessageLogContext& context, const QString& message)
+{
+    // The bots log every message to qDebug, which would swamp the results
+    if (verbose || type == QtFatalMsg)
+    {
+        fprintf(stderr, "%s\n", qPrintable(qFormatLogMessage(type, context, message)));
+    }
+}
+
+struct Record
+{
+    QString kind;
+    QString room;
+    QJsonArray events;
+    qint64 t;  ///< milliseconds since recording started
+};
+
+struct Recording
+{
+    QString user;  ///< the recording bot, whose messages are left out
+    std::vector<Record> records;
+    QStringList rooms;  ///< in order of appearance
+};
+
+bool load(const QString& fileName, Recording& recording)
+{
+    QFile f(fileName);
+    if (!f.open(QFile::ReadOnly))
+    {
+        qWarning() << "Can't read" << fileName << f.errorString();
+        return false;
+    }
+    int lineNumber = 0;
+    while (!f.atEnd())
+    {
+        const QByteArray line = f.readLine().trimmed();
+        ++lineNumber;
+        if (line.isEmpty())
+        {
+            continue;
+        }
+        const QJsonObject o = QJsonDocument::fromJson(line).object();
+        const QString kind = o.value("kind").toString();
+        if (kind == QStringLiteral("header"))
+        {
+            recording.user = o.value("user").toString();
+        }
+        else if (kind == QStringLiteral("state") || kind == QStringLiteral("timeline")
+                 || kind == QStringLiteral("history"))
+        {
+            Record r { kind,
+                       o.value("room").toString(),
+                       o.value("events").toArray(),
+                       qint64(o.value("t").toDouble()) };
+            if (!recording.rooms.contains(r.room))
+            {
+                recording.rooms.append(r.room);
+            }
+            recording.records.push_back(std::move(r));
+        }
+        else
+        {
+            qWarning() << "Ignoring line" << lineNumber << "of" << fileName;
+        }
+    }
+    return true;
+}
+
+/// @brief Delivers @p state and @p timeline events to @p room, as a sync would
+void feed(Quotient::Room* room, const QJsonArray& state, const QJsonArray& timeline)
+{
+    const QJsonObject timelineData { { "events", timeline }, { "limited", false }, { "prev_batch", "replay" } };
+    const QJsonObject data { { "state", QJsonObject { { "events", state } } }, { "timeline", timelineData } };
+    room->updateData(Quotient::SyncRoomData(room->id(), Quotient::JoinState::Join, data), false);
+}
+
+/// @brief Messages are written one per line, so line breaks in them are escaped
+QString outboundLine(const QString& roomId, QString body)
+{
+    return roomId + '\t' + body.replace('\\', QStringLiteral("\\\\")).replace('\n', QStringLiteral("\\n"));
+}
+
+/** @brief Compares the @p sent messages with those in @p fileName
+ *
+ * Returns the number of lines that differ (or are missing from
+ * either side), and prints the first few differences.
+ */
+int compare(const QStringList& sent, const QString& fileName)
+{
+    QFile f(fileName);
+    if (!f.open(QFile::ReadOnly))
+    {
+        qWarning() << "Can't read" << fileName << f.errorString();
+        return -1;
+    }
+    QStringList expected = QString::fromUtf8(f.readAll()).split('\n');
+    if (!expected.isEmpty() && expected.last().isEmpty())
+    {
+        expected.removeLast();
+    }
+
+    int different = 0;
+    for (int i = 0; i < qMax(sent.count(), expected.count()); ++i)
+    {
+        if (i < sent.count() && i < expected.count() && sent[i] == expected[i])
+        {
+            continue;
+        }
+        if (++different <= 5)
+        {
+            fprintf(stderr,
+                    "Message %d differs:\n- %s\n+ %s\n",
+                    i + 1,
+                    i < expected.count() ? qPrintable(expected[i]) : "(none)",
+                    i < sent.count() ? qPrintable(sent[i]) : "(none)");
+        }
+    }
+    return different;
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("QuatBot");
+    app.setApplicationVersion("0.8");
+    // Keep the cookie-jars of the replayed rooms away from the real ones
+    QStandardPaths::setTestModeEnabled(true);
+
+    QCommandLineOption dumperOption(QStringList { "dumper" }, "Replay into qb-dumper's bot instead of quatbot.");
+    QCommandLineOption operatorOption(
+        QStringList { "o", "operator" }, "Additional user-id to consider as operator.", "userid");
+    QCommandLineOption messagesOption(
+        QStringList { "m", "messages" }, "Write the messages the bot sends to <file>, one per line.", "file");
+    QCommandLineOption expectOption(
+        QStringList { "e", "expect" }, "Compare the messages the bot sends with those in <file>.", "file");
+    QCommandLineOption outputOption(
+        QStringList { "output" }, "Write the JSON results to <file> instead of standard output.", "file");
+    QCommandLineOption verboseOption(QStringList { "v", "verbose" }, "Show the log messages of the bot.");
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Replays a recorded sync into QuatBot, offline");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addOption(dumperOption);
+    parser.addOption(operatorOption);
+    parser.addOption(messagesOption);
+    parser.addOption(expectOption);
+    parser.addOption(outputOption);
+    parser.addOption(verboseOption);
+    parser.addPositionalArgument("recording", "File recorded with --record", "<recording>");
+    parser.process(app);
+
+    if (parser.positionalArguments().count() != 1)
+    {
+        qWarning() << "Usage: qb-replay <options> <recording>\n"
+                      "  Give exactly one recording.\n";
+        return 1;
+    }
+
+    Recording recording;
+    if (!load(parser.positionalArguments().first(), recording))
+    {
+        return 1;
+    }
+
+    verbose = parser.isSet(verboseOption);
+    qInstallMessageHandler(messageHandler);
+
+    // Every run starts with full jars (this is the test-mode data dir)
+    QDir dataDir(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation));
+    for (const auto& f : dataDir.entryList({ QStringLiteral("cookiejar-*") }, QDir::Files))
+    {
+        dataDir.remove(f);
+    }
+    // Status messages, meeting logs and reminders follow the recording, not the wall clock
+    QuatBot::VirtualClock clock;
+    QuatBot::Clock::setInstance(&clock);
+
+    const bool dumper = parser.isSet(dumperOption);
+    QStringList sent;  // outlives the rooms, which append to it
+    Quotient::Connection conn;  // never connected
+    QList<QObject*> bots;
+    QHash<QString, Quotient::Room*> rooms;
+    for (const auto& id : recording.rooms)
+    {
+        auto* room = conn.provideRoom(id, Quotient::JoinState::Join);
+        rooms.insert(id, room);
+        QObject::connect(room,
+                         &Quotient::Room::pendingEventAboutToAdd,
+                         [&sent, id](Quotient::RoomEvent* e)
+                         { sent.append(outboundLine(id, e->contentJson().value("body").toString())); });
+        if (dumper)
+        {
+            // Log everything that is in the recording for this room
+            QSet<QString> messages;
+            for (const auto& r : recording.records)
+            {
+                for (const auto& e : r.events)
+                {
+                    const QJsonObject event = e.toObject();
+                    if (r.room == id && event.value("type").toString() == QStringLiteral("m.room.message"))
+                    {
+                        messages.insert(event.value("event_id").toString());
+                    }
+                }
+            }
+            auto* bot = new QuatBot::DumpBot(conn, room);
+            bot->setLogCriterion(uint(messages.count()));
+            bots.append(bot);
+        }
+        else
+        {
+            bots.append(new QuatBot::Bot(conn, room, parser.values(operatorOption)));
+        }
+    }
+
+    // What is measured is delivering the events and the bots handling them
+    qint64 events = 0;
+    const quint64 allocationsBefore = QuatBot::allocationCount();
+    QElapsedTimer timer;
+    timer.start();
+    for (const auto& r : recording.records)
+    {
+        auto* room = rooms.value(r.room);
+        if (r.t > clock.elapsed())
+        {
+            // Runs the timers that came due in the meantime, too
+            clock.advance(r.t - clock.elapsed());
+        }
+        qint64 fed = r.events.count();  // what the bots get
+        if (r.kind == QStringLiteral("state"))
+        {
+            feed(room, r.events, QJsonArray());
+        }
+        else if (r.kind == QStringLiteral("timeline"))
+        {
+            // The bot's own replies are what the replay produces again
+            QJsonArray timeline;
+            for (const auto& e : r.events)
+            {
+                if (dumper || e.toObject().value("sender").toString() != recording.user)
+                {
+                    timeline.append(e);
+                }
+            }
+            feed(room, QJsonArray(), timeline);
+            fed = timeline.count();
+        }
+        else if (dumper)
+        {
+            // History comes newest-first; the dumper sorts it anyway
+            QJsonArray timeline;
+            for (auto it = r.events.constEnd(); it != r.events.constBegin();)
+            {
+                timeline.append(*--it);
+            }
+            feed(room, QJsonArray(), timeline);
+        }
+        else
+        {
+            continue;
+        }
+        events += fed;
+        QCoreApplication::processEvents();
+    }
+    const qint64 nsecs = timer.nsecsElapsed();
+    const quint64 allocations = QuatBot::allocationCount() - allocationsBefore;
+
+    qDeleteAll(bots);
+    QuatBot::Clock::setInstance(nullptr);
+    qInstallMessageHandler(nullptr);
+
+    QJsonObject results { { "version", app.applicationVersion() },
+                          { "recording", parser.positionalArguments().first() },
+                          { "mode", dumper ? "dumper" : "bot" },
+                          { "rooms", recording.rooms.count() },
+                          { "events", events },
+                          { "total_ns", nsecs },
+                          { "events_per_sec", nsecs ? double(events) * 1e9 / nsecs : 0.0 },
+                          { "allocations", qint64(allocations) },
+                          { "allocs_per_event", events ? double(allocations) / events : 0.0 },
+                          { "messages_sent", sent.count() } };
+
+    if (parser.isSet(messagesOption))
+    {
+        QFile f(parser.value(messagesOption));
+        const QByteArray text = sent.isEmpty() ? QByteArray() : (sent.join('\n') + '\n').toUtf8();
+        if (!f.open(QFile::WriteOnly | QFile::Truncate) || f.write(text) != text.size())
+        {
+            qWarning() << "Could not write" << f.fileName();
+            return 1;
+        }
+    }
+    int different = 0;
+    if (parser.isSet(expectOption))
+    {
+        different = compare(sent, parser.value(expectOption));
+        if (different < 0)
+        {
+            return 1;
+        }
+        results.insert("messages_different", different);
+    }
+
+    const QByteArray json = QJsonDocument(results).toJson();
+    if (parser.isSet(outputOption))
+    {
+        QFile f(parser.value(outputOption));
+        if (!f.open(QFile::WriteOnly) || f.write(json) != json.size())
+        {
+            qWarning() << "Could not write" << f.fileName();
+            return 1;
+        }
+    }
+    else
+    {
+        fwrite(json.constData(), 1, size_t(json.size()), stdout);
+    }
+    return different ? 2 : 0;
+}
@@ -7,7 +7,11 @@
 
 #include "meeting.h"
 
+#include "clock.h"
+#include "envelope.h"
 #include "quatbot.h"
+#include "timerwheel.h"
+#include "userid.h"
 
 #include <room.h>
 
@@ -18,17 +22,21 @@ struct Breakout
 {
     QString id;
     QString description;
-    QString chair;
-    QStringList participants;
+    UserId chair;
+    QList<UserId> participants;
 
     QString toString() const
     {
         QStringList parts { "Breakout:" };
         parts << (description.isEmpty() ? id : description);
-        parts << "; Chair:" << chair;
+        parts << "; Chair:" << chair.toString();
         if (participants.count() > 0)
         {
-            parts << "; Participants:" << participants;
+            parts << "; Participants:";
+            for (const auto& u : participants)
+            {
+                parts << u.toString();
+            }
         }
 
         return parts.join(' ');
@@ -40,14 +48,14 @@ struct Meeting::Private
     explicit Private(Bot* bot)
         : m_bot(bot)
         , m_state(State::None)
+        , m_waiting([this]() { this->timeout(); })
     {
-        QObject::connect(&m_waiting, &QTimer::timeout, [this]() { this->timeout(); });
         m_waiting.setSingleShot(true);
     }
 
     bool hasStarted() const { return m_state != State::None; }
 
-    void addParticipant(const QString& s)
+    void addParticipant(UserId s)
     {
         m_participants.append(s);
         // Keep the chair at the end
@@ -59,7 +67,7 @@ struct Meeting::Private
     }
 
     /// @brief Start the meeting (roll-call)
-    void start(const QString& chair)
+    void start(UserId chair)
     {
         m_state = State::RollCall;
         m_breakouts.clear();
@@ -67,12 +75,13 @@ struct Meeting::Private
         m_participants.clear();
         m_participants.append(chair);
         m_chair = chair;
-        m_current.clear();
+        m_current = UserId();
 
-        if (m_bot->botUser() != m_chair)
+        const UserId bot(m_bot->botUser());
+        if (bot != m_chair)
         {
             // Don't rollcall the bot itself
-            m_participantsDone.insert(m_bot->botUser());
+            m_participantsDone.insert(bot);
         }
         m_reminderCount = 2;
         m_waiting.start(60000);  // one minute until reminder
@@ -82,23 +91,24 @@ struct Meeting::Private
     void startProper()
     {
         m_state = State::InProgress;
-        if (m_bot->botUser() != m_chair)
+        const UserId bot(m_bot->botUser());
+        if (bot != m_chair)
         {
-            m_participants.removeAll(m_bot->botUser());
-            m_participantsDone.insert(m_bot->botUser());
+            m_participants.removeAll(bot);
+            m_participantsDone.insert(bot);
         }
     }
 
-    bool isNew(const QString& s) { return !m_participantsDone.contains(s) && !m_participants.contains(s); }
+    bool isNew(UserId s) { return !m_participantsDone.contains(s) && !m_participants.contains(s); }
     bool isChair(const CommandArgs& cmd) { return cmd.user == m_chair; }
 
-    void skip(const QString& user)
+    void skip(UserId user)
     {
         m_participants.removeAll(user);
         m_participantsDone.insert(user);
     }
 
-    void bump(int index, const QString& user)
+    void bump(int index, UserId user)
     {
         m_participants.removeAll(user);
         m_participantsDone.remove(user);
@@ -132,17 +142,18 @@ struct Meeting::Private
 
         if (m_participants.count() > 0)
         {
-            m_bot->message(QString("%1, you're up (after that, %2).").arg(m_current, m_participants.first()));
+            m_bot->message(QString("%1, you're up (after that, %2).")
+                               .arg(m_current.toString(), m_participants.first().toString()));
         }
         else
         {
-            m_bot->message(QString("%1, you're up (after that, we're done!).").arg(m_current));
+            m_bot->message(QString("%1, you're up (after that, we're done!).").arg(m_current.toString()));
         }
         m_reminderCount = 2;
         m_waiting.start(30000);  // half a minute to reminder
     }
 
-    void breakout(const QString& user, QStringList b)  // Copy since we're going to modify it
+    void breakout(UserId user, QStringList b)  // Copy since we're going to modify it
     {
         if (b.count() < 1)
         {
@@ -163,7 +174,7 @@ struct Meeting::Private
         }
 
         // None matched, make new
-        m_breakouts.append({ breakoutId, description, user, QStringList {} });
+        m_breakouts.append({ breakoutId, description, user, QList<UserId> {} });
 
         QStringList l { QString("Breakout '%1' is registered.").arg(breakoutId) };
         if (!description.isEmpty())
@@ -177,12 +188,12 @@ struct Meeting::Private
 
     Bot* m_bot;
     State m_state;
-    QList<QString> m_participants;
-    QSet<QString> m_participantsDone;
+    QList<UserId> m_participants;
+    QSet<UserId> m_participantsDone;
     QList<Breakout> m_breakouts;
-    QString m_chair;
-    QString m_current;
-    QTimer m_waiting;
+    UserId m_chair;
+    UserId m_current;
+    WheelTimer m_waiting;
     int m_reminderCount = 0;
     bool m_currentSeen = false;
 };
@@ -207,14 +218,15 @@ const QStringList& Meeting::moduleCommands() const
     return commands;
 }
 
-void Meeting::handleMessage(const Quotient::RoomMessageEvent* e)
+void Meeting::handleMessage(const MessageEnvelope& e)
 {
+    const UserId sender = e.sender();
     // New speaker?
-    if (d->hasStarted() && d->isNew(e->senderId()))
+    if (d->hasStarted() && d->isNew(sender))
     {
-        d->addParticipant(e->senderId());
+        d->addParticipant(sender);
     }
-    if ((d->m_state == State::InProgress) && (e->senderId() == d->m_current))
+    if ((d->m_state == State::InProgress) && (sender == d->m_current))
     {
         d->m_waiting.stop();
     }
@@ -233,13 +245,14 @@ void Meeting::handleCommand(const CommandArgs& cmd)
             d->start(cmd.user);
             enableLogging(cmd, true);
             QStringList ids = m_bot->userIds();
-            ids.removeAll(d->m_chair);
+            ids.removeAll(d->m_chair.toString());
             for (const auto& u : d->m_participantsDone)
-                ids.removeAll(u);
+                ids.removeAll(u.toString());
             for (const auto& u : d->m_participants)
-                ids.removeAll(u);
-            message(QStringList {
-                        "Hello @room, this is the roll-call!", QString("%1 is chair.").arg(d->m_chair), "Calling" }
+                ids.removeAll(u.toString());
+            message(QStringList { "Hello @room, this is the roll-call!",
+                                  QString("%1 is chair.").arg(d->m_chair.toString()),
+                                  "Calling" }
                     << ids);
         }
         else
@@ -283,7 +296,7 @@ void Meeting::handleCommand(const CommandArgs& cmd)
             {
                 if (!user.isEmpty())
                 {
-                    d->skip(user);
+                    d->skip(UserId(user));
                     message(QString("User %1 will be skipped this meeting.").arg(user));
                 }
             }
@@ -313,12 +326,13 @@ void Meeting::handleCommand(const CommandArgs& cmd)
                 QString userName = m_bot->userLookup(user);
                 if (!userName.isEmpty())
                 {
-                    d->bump(index - 1, userName);
+                    const UserId id(userName);
+                    d->bump(index - 1, id);
                     if (index > 1)
                     {
                         message(QString("User %1 will be up in %2.")
                                     .arg(userName)
-                                    .arg(d->m_participants.indexOf(userName) + 1));
+                                    .arg(d->m_participants.indexOf(id) + 1));
                     }
                     else
                     {
@@ -353,9 +367,9 @@ void Meeting::handleCommand(const CommandArgs& cmd)
             }
             QStringList participantsMessage;
 
-            if ((d->m_state == State::InProgress) && !d->m_current.isEmpty())
+            if ((d->m_state == State::InProgress) && !d->m_current.isNull())
             {
-                participantsMessage << QString("It is %1 's turn.").arg(d->m_current);
+                participantsMessage << QString("It is %1 's turn.").arg(d->m_current.toString());
             }
             if (d->m_participants.count() > 0)
             {
@@ -366,7 +380,7 @@ void Meeting::handleCommand(const CommandArgs& cmd)
                 {
                     if (--amount >= 0)
                     {
-                        participantsMessage << u;
+                        participantsMessage << u.toString();
                     }
                     else
                     {
@@ -433,8 +447,8 @@ void Meeting::status() const
     l << _shortStatus(d->m_state);
     if (d->m_state != State::None)
     {
-        l << QString("It is %1 (time UTC).").arg(QDateTime::currentDateTimeUtc().toString());
-        l << QString("Chaired by %1.").arg(d->m_chair)
+        l << QString("It is %1 (time UTC).").arg(Clock::instance()->currentDateTimeUtc().toString());
+        l << QString("Chaired by %1.").arg(d->m_chair.toString())
           << QString("There are %1 participants left.").arg(d->m_participants.count());
         // Here > 1 because the bot itself is always "done"
         if (d->m_participantsDone.count() > 1)
@@ -442,9 +456,9 @@ void Meeting::status() const
             l << QString("%1 people are already done.").arg(d->m_participantsDone.count());
         }
     }
-    if ((d->m_state == State::InProgress) && !d->m_current.isEmpty())
+    if ((d->m_state == State::InProgress) && !d->m_current.isNull())
     {
-        l << QString("\nIt is %1 's turn.").arg(d->m_current);
+        l << QString("\nIt is %1 's turn.").arg(d->m_current.toString());
     }
     message(l);
 }
@@ -462,7 +476,7 @@ void Meeting::enableLogging(const CommandArgs& cmd, bool b)
             // a subcommand, not their main command.
             CommandArgs logCommand(cmd);
             int year = 0;
-            QString week = QString::number(QDate::currentDate().weekNumber(&year));
+            QString week = QString::number(Clock::instance()->currentDate().weekNumber(&year));
             if (week.length() < 2)
             {
                 week.prepend('0');
@@ -487,7 +501,9 @@ void Meeting::Private::timeout()
 
         for (const auto& u : m_bot->userIds())
         {
-            if (!m_participants.contains(u) && !m_participantsDone.contains(u))
+            // Users who never said anything were never interned
+            const UserId id = UserId::lookup(u);
+            if (id.isNull() || (!m_participants.contains(id) && !m_participantsDone.contains(id)))
             {
                 noResponse.append(u);
             }
@@ -500,7 +516,7 @@ void Meeting::Private::timeout()
     }
     else if (m_state == State::InProgress)
     {
-        m_bot->message(QStringList { m_current, "are you with us?" });
+        m_bot->message(QStringList { m_current.toString(), "are you with us?" });
     }
     m_bot->message(Bot::Flush {});
     m_waiting.start();
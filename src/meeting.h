@@ -12,7 +12,6 @@
 
 #include <QList>
 #include <QSet>
-#include <QTimer>
 
 namespace QuatBot
 {
@@ -28,7 +27,7 @@ public:
     const QString& moduleName() const override;
     const QStringList& moduleCommands() const override;
 
-    virtual void handleMessage(const Quotient::RoomMessageEvent*) override;
+    virtual void handleMessage(const MessageEnvelope&) override;
     virtual void handleCommand(const CommandArgs&) override;
 
     enum class State
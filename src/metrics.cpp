@@ -0,0 +1,219 @@
+/*
+ *  SPDX-License-Identifier: BSD-2-Clause
+ *  SPDX-License-File: LICENSE
+ *
+ * Copyright 2019 Adriaan de Groot <groot@kde.org>
+ */
+
+#include "metrics.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QHostAddress>
+#include <QMutexLocker>
+#include <QTcpServer>
+#include <QTcpSocket>
+
+namespace
+{
+// Upper bounds of the histogram buckets, in nanoseconds
+static constexpr const qint64 bucketBounds[QuatBot::Histogram::BUCKETS] = {
+    100'000,    250'000,    500'000,     1'000'000,   2'500'000,     5'000'000,
+    10'000'000, 25'000'000, 50'000'000, 100'000'000, 1'000'000'000, 10'000'000'000,
+};
+
+static QByteArray seconds(qint64 nsecs)
+{
+    return QByteArray::number(double(nsecs) / 1e9, 'g', 9);
+}
+
+/// @brief Label value with \, " and newline escaped
+static QByteArray escape(const QString& s)
+{
+    QByteArray r = s.toUtf8();
+    r.replace('\\', "\\\\").replace('"', "\\\"").replace('\n', "\\n");
+    return r;
+}
+
+/// @brief Joins @p name and @p labels as Prometheus wants them: name{a="b",c="d"}
+static QByteArray series(const QByteArray& name, const QByteArray& labels, const QByteArray& extra = QByteArray())
+{
+    if (labels.isEmpty() && extra.isEmpty())
+    {
+        return name;
+    }
+    QByteArray r = name + '{' + labels;
+    if (!labels.isEmpty() && !extra.isEmpty())
+    {
+        r += ',';
+    }
+    return r + extra + '}';
+}
+
+// A request larger than this is not a metrics scrape
+static constexpr const int MAX_REQUEST = 8192;
+}  // namespace
+
+namespace QuatBot
+{
+Metric::~Metric() {}
+
+void Counter::write(QByteArray& out, const QByteArray& name, const QByteArray& labels) const
+{
+    out += series(name, labels) + ' ' + QByteArray::number(value()) + '\n';
+}
+
+void Gauge::write(QByteArray& out, const QByteArray& name, const QByteArray& labels) const
+{
+    out += series(name, labels) + ' ' + QByteArray::number(value()) + '\n';
+}
+
+void Histogram::observe(qint64 nsecs)
+{
+    int i = 0;
+    while (i < BUCKETS && nsecs > bucketBounds[i])
+    {
+        ++i;
+    }
+    m_buckets[i].fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(quint64(qMax<qint64>(nsecs, 0)), std::memory_order_relaxed);
+}
+
+void Histogram::write(QByteArray& out, const QByteArray& name, const QByteArray& labels) const
+{
+    quint64 count = 0;
+    for (int i = 0; i <= BUCKETS; ++i)
+    {
+        count += m_buckets[i].load(std::memory_order_relaxed);
+        const QByteArray le = i < BUCKETS ? seconds(bucketBounds[i]) : QByteArrayLiteral("+Inf");
+        out += series(name + "_bucket", labels, "le=\"" + le + '"') + ' ' + QByteArray::number(count) + '\n';
+    }
+    out += series(name + "_sum", labels) + ' ' + seconds(qint64(m_sum.load(std::memory_order_relaxed))) + '\n';
+    out += series(name + "_count", labels) + ' ' + QByteArray::number(count) + '\n';
+}
+
+MetricsRegistry* MetricsRegistry::instance()
+{
+    static MetricsRegistry* registry = new MetricsRegistry;
+    return registry;
+}
+
+template<typename T>
+T* MetricsRegistry::lookup(const QString& name, const char* type, const QString& help, const Labels& labels)
+{
+    QByteArray labelText;
+    for (const auto& l : labels)
+    {
+        if (!labelText.isEmpty())
+        {
+            labelText += ',';
+        }
+        labelText += l.first.toLatin1() + "=\"" + escape(l.second) + '"';
+    }
+
+    QMutexLocker lock(&m_mutex);
+    Family& family = m_families[name.toLatin1()];
+    if (family.type.isEmpty())
+    {
+        family.type = type;
+        family.help = help.toUtf8();
+    }
+    else if (family.type != type)
+    {
+        qWarning() << "Metric" << name << "is a" << family.type << "not a" << type;
+        return nullptr;
+    }
+
+    auto& metric = family.series[labelText];
+    if (!metric)
+    {
+        metric = std::make_unique<T>();
+    }
+    return static_cast<T*>(metric.get());
+}
+
+Counter* MetricsRegistry::counter(const QString& name, const QString& help, const Labels& labels)
+{
+    return lookup<Counter>(name, "counter", help, labels);
+}
+
+Gauge* MetricsRegistry::gauge(const QString& name, const QString& help, const Labels& labels)
+{
+    return lookup<Gauge>(name, "gauge", help, labels);
+}
+
+Histogram* MetricsRegistry::histogram(const QString& name, const QString& help, const Labels& labels)
+{
+    return lookup<Histogram>(name, "histogram", help, labels);
+}
+
+QByteArray MetricsRegistry::exposition() const
+{
+    QByteArray out;
+    QMutexLocker lock(&m_mutex);
+    for (const auto& [name, family] : m_families)
+    {
+        out += "# HELP " + name + ' ' + family.help + '\n';
+        out += "# TYPE " + name + ' ' + family.type + '\n';
+        for (const auto& [labels, metric] : family.series)
+        {
+            metric->write(out, name, labels);
+        }
+    }
+    return out;
+}
+
+/// @brief Answers one HTTP request on @p socket, once the request is complete
+static void answer(QTcpSocket* socket)
+{
+    const QByteArray request = socket->peek(MAX_REQUEST);
+    if (!request.contains("\r\n\r\n") && request.size() < MAX_REQUEST)
+    {
+        return;  // Wait for the rest of the request header
+    }
+    socket->readAll();
+
+    QByteArray response;
+    if (request.startsWith("GET "))
+    {
+        const QByteArray body = MetricsRegistry::instance()->exposition();
+        response = "HTTP/1.0 200 OK\r\n"
+                   "Content-Type: text/plain; version=0.0.4\r\n"
+                   "Content-Length: "
+            + QByteArray::number(body.size()) + "\r\n\r\n" + body;
+    }
+    else
+    {
+        response = "HTTP/1.0 405 Method Not Allowed\r\nContent-Length: 0\r\n\r\n";
+    }
+    socket->write(response);
+    socket->disconnectFromHost();
+}
+
+bool MetricsRegistry::listen(quint16 port)
+{
+    if (!m_server)
+    {
+        m_server = new QTcpServer(qApp);
+        QObject::connect(m_server,
+                         &QTcpServer::newConnection,
+                         [server = m_server]()
+                         {
+                             while (QTcpSocket* socket = server->nextPendingConnection())
+                             {
+                                 QObject::connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+                                 QObject::connect(
+                                     socket, &QTcpSocket::readyRead, socket, [socket]() { answer(socket); });
+                             }
+                         });
+    }
+    if (!m_server->listen(QHostAddress::LocalHost, port))
+    {
+        qWarning() << "Can't serve metrics on port" << port << m_server->errorString();
+        return false;
+    }
+    qDebug() << "Serving metrics on" << m_server->serverAddress().toString() << m_server->serverPort();
+    return true;
+}
+
+}  // namespace QuatBot
@@ -0,0 +1,146 @@
+/*
+ *  SPDX-License-Identifier: BSD-2-Clause
+ *  SPDX-License-File: LICENSE
+ *
+ * Copyright 2019 Adriaan de Groot <groot@kde.org>
+ */
+
+#ifndef QUATBOT_METRICS_H
+#define QUATBOT_METRICS_H
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QList>
+#include <QMutex>
+#include <QPair>
+#include <QString>
+
+#include <atomic>
+#include <map>
+#include <memory>
+
+class QTcpServer;
+
+namespace QuatBot
+{
+/// @brief Base class for the things kept in the MetricsRegistry
+class Metric
+{
+public:
+    virtual ~Metric();
+
+    /// @brief Appends Prometheus text lines for this metric to @p out
+    virtual void write(QByteArray& out, const QByteArray& name, const QByteArray& labels) const = 0;
+};
+
+/// @brief A number that only goes up (e.g. messages seen)
+class Counter : public Metric
+{
+public:
+    void add(quint64 n = 1) { m_value.fetch_add(n, std::memory_order_relaxed); }
+    quint64 value() const { return m_value.load(std::memory_order_relaxed); }
+
+    void write(QByteArray& out, const QByteArray& name, const QByteArray& labels) const override;
+
+private:
+    std::atomic<quint64> m_value { 0 };
+};
+
+/// @brief A number that goes up and down (e.g. queue length)
+class Gauge : public Metric
+{
+public:
+    void set(qint64 v) { m_value.store(v, std::memory_order_relaxed); }
+    qint64 value() const { return m_value.load(std::memory_order_relaxed); }
+
+    void write(QByteArray& out, const QByteArray& name, const QByteArray& labels) const override;
+
+private:
+    std::atomic<qint64> m_value { 0 };
+};
+
+/** @brief Distribution of durations
+ *
+ * Durations are given in nanoseconds (as from QElapsedTimer::nsecsElapsed())
+ * and exported in seconds, with fixed buckets from 100µs to 10s.
+ */
+class Histogram : public Metric
+{
+public:
+    static constexpr const int BUCKETS = 12;
+
+    void observe(qint64 nsecs);
+
+    void write(QByteArray& out, const QByteArray& name, const QByteArray& labels) const override;
+
+private:
+    std::atomic<quint64> m_buckets[BUCKETS + 1] {};  // last one is +Inf
+    std::atomic<quint64> m_sum { 0 };  // nanoseconds
+};
+
+/// @brief RAII helper that observes the lifetime of the object in a Histogram
+class HistogramTimer
+{
+public:
+    explicit HistogramTimer(Histogram* h)
+        : m_histogram(h)
+    {
+        m_timer.start();
+    }
+    ~HistogramTimer() { m_histogram->observe(m_timer.nsecsElapsed()); }
+
+private:
+    Histogram* m_histogram;
+    QElapsedTimer m_timer;
+};
+
+/** @brief All the metrics of the bot process
+ *
+ * Metrics are looked up by name and labels once, and the returned
+ * pointer is kept by the caller; it stays valid for the lifetime
+ * of the process. Updating a metric is a relaxed atomic operation.
+ *
+ * The registry can serve the metrics in the Prometheus text format
+ * over HTTP on a local port, see listen().
+ */
+class MetricsRegistry
+{
+public:
+    using Labels = QList<QPair<QString, QString>>;
+
+    static MetricsRegistry* instance();
+
+    Counter* counter(const QString& name, const QString& help, const Labels& labels = Labels());
+    Gauge* gauge(const QString& name, const QString& help, const Labels& labels = Labels());
+    Histogram* histogram(const QString& name, const QString& help, const Labels& labels = Labels());
+
+    /// @brief All the metrics, in Prometheus text exposition format
+    QByteArray exposition() const;
+
+    /** @brief Serve the metrics on localhost, port @p port
+     *
+     * Any GET request is answered with exposition(). Returns false
+     * (with a warning) if the port can't be used.
+     */
+    bool listen(quint16 port);
+
+private:
+    MetricsRegistry() = default;
+
+    struct Family
+    {
+        QByteArray type;
+        QByteArray help;
+        std::map<QByteArray, std::unique_ptr<Metric>> series;  // by label text
+    };
+
+    template<typename T>
+    T* lookup(const QString& name, const char* type, const QString& help, const Labels& labels);
+
+    mutable QMutex m_mutex;
+    std::map<QByteArray, Family> m_families;
+    QTcpServer* m_server = nullptr;
+};
+
+}  // namespace QuatBot
+#endif
@@ -0,0 +1,572 @@
+/*
+ *  SPDX-License-Identifier: BSD-2-Clause
+ *  SPDX-License-File: LICENSE
+ *
+ * Copyright 2019 Adriaan de Groot <groot@kde.org>
+ */
+
+#include "mockserver.h"
+
+#include <QDateTime>
+#include <QDebug>
+#include <QHostAddress>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QUrlQuery>
+
+#include <algorithm>
+
+namespace
+{
+// Requests larger than this are refused
+static constexpr const int MAX_REQUEST = 1 << 20;
+// Long-polling syncs without a timeout wait this long
+static constexpr const int DEFAULT_SYNC_TIMEOUT = 30000;
+// A newly joined room gets this many recent events in sync
+static constexpr const int INITIAL_TIMELINE = 20;
+
+static qint64 now()
+{
+    return QDateTime::currentMSecsSinceEpoch();
+}
+
+/// @brief Parses a sync token "s<pos>"; no token is -1 (initial sync)
+static qint64 parseSince(const QString& token)
+{
+    bool ok = false;
+    const qint64 pos = token.startsWith('s') ? token.mid(1).toLongLong(&ok) : -1;
+    return ok ? pos : -1;
+}
+
+/// @brief Parses a /messages token "i<index>"
+static int parseIndex(const QString& token, int fallback)
+{
+    bool ok = false;
+    const int index = token.startsWith('i') ? token.mid(1).toInt(&ok) : fallback;
+    return ok ? index : fallback;
+}
+
+static QString indexToken(size_t index)
+{
+    return QStringLiteral("i%1").arg(index);
+}
+
+static const char* statusText(int status)
+{
+    switch (status)
+    {
+    case 200:
+        return "OK";
+    case 400:
+        return "Bad Request";
+    case 404:
+        return "Not Found";
+    default:
+        return "Error";
+    }
+}
+}  // namespace
+
+namespace QuatBot
+{
+MockHomeserver::MockHomeserver(const Options& options, QObject* parent)
+    : QObject(parent)
+    , m_options(options)
+    , m_server(new QTcpServer(this))
+    , m_botId(QStringLiteral("@bot:%1").arg(options.serverName))
+{
+    connect(m_server, &QTcpServer::newConnection, this, &MockHomeserver::newConnection);
+    m_syncTimer.setInterval(100);
+    connect(&m_syncTimer, &QTimer::timeout, this, [this]() { wakeSyncs(true); });
+
+    m_rooms.resize(size_t(qMax(options.rooms, 0)));
+    for (int r = 0; r < roomCount(); ++r)
+    {
+        Room& room = m_rooms[size_t(r)];
+        room.id = QStringLiteral("!room%1:%2").arg(r).arg(options.serverName);
+        room.alias = roomAlias(r);
+
+        // The room's state isn't news to anyone, so it's all at position 0
+        auto setup = [&room](QJsonObject e)
+        {
+            room.state.push_back(e);
+            room.timeline.push_back(Event { 0, e });
+        };
+        QJsonObject create = makeEvent(QStringLiteral("m.room.create"),
+                                       memberId(0),
+                                       QJsonObject { { "creator", memberId(0) }, { "room_version", "6" } });
+        create.insert("state_key", QString());
+        setup(create);
+        QJsonObject alias = makeEvent(
+            QStringLiteral("m.room.canonical_alias"), memberId(0), QJsonObject { { "alias", room.alias } });
+        alias.insert("state_key", QString());
+        setup(alias);
+        for (int m = 0; m < options.members; ++m)
+        {
+            const QJsonObject content { { "membership", "join" },
+                                        { "displayname", QStringLiteral("Member %1").arg(m) } };
+            QJsonObject member = makeEvent(QStringLiteral("m.room.member"), memberId(m), content);
+            member.insert("state_key", memberId(m));
+            setup(member);
+        }
+        for (int h = 0; h < options.history; ++h)
+        {
+            room.timeline.push_back(Event {
+                0,
+                makeEvent(QStringLiteral("m.room.message"),
+                          memberId(h % qMax(options.members, 1)),
+                          QJsonObject { { "msgtype", "m.text" }, { "body", QStringLiteral("history %1").arg(h) } }) });
+        }
+    }
+}
+
+MockHomeserver::~MockHomeserver() {}
+
+bool MockHomeserver::listen(quint16 port)
+{
+    if (!m_server->listen(QHostAddress::LocalHost, port))
+    {
+        qWarning() << "Mock homeserver can't listen on port" << port << m_server->errorString();
+        return false;
+    }
+    m_syncTimer.start();
+    return true;
+}
+
+QUrl MockHomeserver::url() const
+{
+    return QUrl(QStringLiteral("http://127.0.0.1:%1").arg(m_server->serverPort()));
+}
+
+int MockHomeserver::joinedCount() const
+{
+    return int(std::count_if(m_rooms.begin(), m_rooms.end(), [](const Room& r) { return r.botJoined >= 0; }));
+}
+
+QString MockHomeserver::roomAlias(int room) const
+{
+    return QStringLiteral("#load%1:%2").arg(room).arg(m_options.serverName);
+}
+
+QString MockHomeserver::memberId(int member) const
+{
+    return QStringLiteral("@member%1:%2").arg(member).arg(m_options.serverName);
+}
+
+QJsonObject MockHomeserver::makeEvent(const QString& type, const QString& sender, const QJsonObject& content)
+{
+    return QJsonObject { { "type", type },
+                         { "event_id", QStringLiteral("$%1:%2").arg(++m_eventCount).arg(m_options.serverName) },
+                         { "sender", sender },
+                         { "origin_server_ts", now() },
+                         { "content", content } };
+}
+
+void MockHomeserver::append(Room& room, QJsonObject json)
+{
+    if (json.contains("state_key"))
+    {
+        room.state.push_back(json);
+    }
+    room.timeline.push_back(Event { ++m_pos, json });
+    if (room.botJoined >= 0 && !m_wakeScheduled)
+    {
+        // Answer the waiting syncs once, after everything that happens now
+        m_wakeScheduled = true;
+        QTimer::singleShot(0,
+                           this,
+                           [this]()
+                           {
+                               m_wakeScheduled = false;
+                               wakeSyncs();
+                           });
+    }
+}
+
+void MockHomeserver::inject(int room, int member, const QString& body)
+{
+    if (room < 0 || room >= roomCount())
+    {
+        return;
+    }
+    m_stats.injected++;
+    const QJsonObject content { { "msgtype", "m.text" }, { "body", body } };
+    append(m_rooms[size_t(room)], makeEvent(QStringLiteral("m.room.message"), memberId(member), content));
+}
+
+MockHomeserver::Room* MockHomeserver::findRoom(const QString& roomIdOrAlias)
+{
+    for (auto& room : m_rooms)
+    {
+        if (room.id == roomIdOrAlias || room.alias == roomIdOrAlias)
+        {
+            return &room;
+        }
+    }
+    return nullptr;
+}
+
+void MockHomeserver::newConnection()
+{
+    while (QTcpSocket* socket = m_server->nextPendingConnection())
+    {
+        connect(socket, &QTcpSocket::readyRead, this, [this, socket]() { readRequests(socket); });
+        connect(socket,
+                &QTcpSocket::disconnected,
+                this,
+                [this, socket]()
+                {
+                    m_buffers.remove(socket);
+                    socket->deleteLater();
+                });
+    }
+}
+
+void MockHomeserver::readRequests(QTcpSocket* socket)
+{
+    QByteArray& buffer = m_buffers[socket];
+    buffer += socket->readAll();
+    if (buffer.size() > MAX_REQUEST)
+    {
+        socket->abort();
+        return;
+    }
+
+    // There may be more than one request in the buffer
+    while (true)
+    {
+        const int headerEnd = buffer.indexOf("\r\n\r\n");
+        if (headerEnd < 0)
+        {
+            return;
+        }
+        const QList<QByteArray> lines = buffer.left(headerEnd).split('\n');
+        const QList<QByteArray> requestLine = lines.value(0).trimmed().split(' ');
+        int contentLength = 0;
+        for (const auto& line : lines)
+        {
+            if (line.toLower().startsWith("content-length:"))
+            {
+                contentLength = line.mid(15).trimmed().toInt();
+            }
+        }
+        if (buffer.size() < headerEnd + 4 + contentLength)
+        {
+            return;
+        }
+
+        Request request;
+        request.method = requestLine.value(0);
+        const QUrl url(QString::fromLatin1(requestLine.value(1)));
+        request.path = url.path(QUrl::FullyDecoded);
+        for (const auto& item : QUrlQuery(url).queryItems(QUrl::FullyDecoded))
+        {
+            request.query.insert(item.first, item.second);
+        }
+        request.body = buffer.mid(headerEnd + 4, contentLength);
+        buffer.remove(0, headerEnd + 4 + contentLength);
+
+        m_stats.requests++;
+        handle(socket, request);
+    }
+}
+
+void MockHomeserver::handle(QTcpSocket* socket, const Request& request)
+{
+    static const QString prefix = QStringLiteral("/_matrix/client/");
+    if (!request.path.startsWith(prefix))
+    {
+        reply(socket, QJsonObject { { "errcode", "M_UNRECOGNIZED" } }, 404);
+        return;
+    }
+    if (request.path == QStringLiteral("/_matrix/client/versions"))
+    {
+        reply(socket, QJsonObject { { "versions", QJsonArray { "r0.5.0", "r0.6.1" } } });
+        return;
+    }
+
+    // Drop "/_matrix/client/r0/"; room ids and aliases don't contain '/'
+    const QStringList parts = request.path.mid(prefix.length()).split('/').mid(1);
+    const QString endpoint = parts.value(0);
+    const QJsonObject body = QJsonDocument::fromJson(request.body).object();
+
+    if (endpoint == QStringLiteral("login"))
+    {
+        reply(socket, login(request));
+    }
+    else if (endpoint == QStringLiteral("capabilities"))
+    {
+        const QJsonObject versions { { "default", "6" }, { "available", QJsonObject { { "6", "stable" } } } };
+        reply(socket, QJsonObject { { "capabilities", QJsonObject { { "m.room_versions", versions } } } });
+    }
+    else if (endpoint == QStringLiteral("sync"))
+    {
+        m_stats.syncs++;
+        const qint64 since = parseSince(request.query.value(QStringLiteral("since")));
+        bool ok = false;
+        int timeout = request.query.value(QStringLiteral("timeout")).toInt(&ok);
+        if (!ok)
+        {
+            timeout = DEFAULT_SYNC_TIMEOUT;
+        }
+        // The initial sync, or one with news, is answered right away; the others wait
+        const QJsonObject response = sync(since);
+        if (since < 0 || timeout <= 0 || response.value("rooms").toObject().value("join").toObject().count() > 0)
+        {
+            reply(socket, response);
+        }
+        else
+        {
+            m_pendingSyncs.append(PendingSync { socket, since, now() + timeout });
+        }
+    }
+    else if (endpoint == QStringLiteral("join"))
+    {
+        reply(socket, join(parts.value(1)));
+    }
+    else if (endpoint == QStringLiteral("rooms") && parts.count() >= 3)
+    {
+        const QString roomId = parts.value(1);
+        const QString action = parts.value(2);
+        if (action == QStringLiteral("join"))
+        {
+            reply(socket, join(roomId));
+        }
+        else if (action == QStringLiteral("send"))
+        {
+            reply(socket, send(roomId, parts.value(4), body));
+        }
+        else if (action == QStringLiteral("messages"))
+        {
+            reply(socket, messages(roomId, request));
+        }
+        else if (action == QStringLiteral("joined_members"))
+        {
+            reply(socket, joinedMembers(roomId));
+        }
+        else
+        {
+            // leave, read_markers, receipt, typing, ...
+            reply(socket, QJsonObject());
+        }
+    }
+    else if (endpoint == QStringLiteral("user") && parts.value(2) == QStringLiteral("filter"))
+    {
+        reply(socket, QJsonObject { { "filter_id", "1" } });
+    }
+    else
+    {
+        reply(socket, QJsonObject());
+    }
+}
+
+void MockHomeserver::reply(QTcpSocket* socket, const QJsonObject& body, int status)
+{
+    const QByteArray json = QJsonDocument(body).toJson(QJsonDocument::Compact);
+    QByteArray response = "HTTP/1.1 " + QByteArray::number(status) + ' ' + statusText(status)
+        + "\r\nContent-Type: application/json\r\nContent-Length: " + QByteArray::number(json.size()) + "\r\n\r\n";
+    socket->write(response + json);
+}
+
+QJsonObject MockHomeserver::login(const Request& request)
+{
+    if (request.method == "GET")
+    {
+        return QJsonObject { { "flows", QJsonArray { QJsonObject { { "type", "m.login.password" } } } } };
+    }
+
+    // Any password will do; the user id is taken from the request
+    const QJsonObject body = QJsonDocument::fromJson(request.body).object();
+    QString user = body.value("identifier").toObject().value("user").toString();
+    if (user.isEmpty())
+    {
+        user = body.value("user").toString();
+    }
+    if (!user.isEmpty())
+    {
+        m_botId = user.startsWith('@') ? user : QStringLiteral("@%1:%2").arg(user, m_options.serverName);
+    }
+    return QJsonObject { { "user_id", m_botId },
+                         { "access_token", "mock-token" },
+                         { "device_id", "MOCK" },
+                         { "home_server", m_options.serverName } };
+}
+
+QJsonObject MockHomeserver::join(const QString& roomIdOrAlias)
+{
+    Room* room = findRoom(roomIdOrAlias);
+    if (!room)
+    {
+        return QJsonObject { { "errcode", "M_NOT_FOUND" }, { "error", "No such room" } };
+    }
+    if (room->botJoined < 0)
+    {
+        room->botJoined = m_pos + 1;
+        const QJsonObject content { { "membership", "join" }, { "displayname", "Bot" } };
+        QJsonObject member = makeEvent(QStringLiteral("m.room.member"), m_botId, content);
+        member.insert("state_key", m_botId);
+        append(*room, member);
+    }
+    return QJsonObject { { "room_id", room->id } };
+}
+
+QJsonObject MockHomeserver::send(const QString& roomId, const QString& txnId, const QJsonObject& content)
+{
+    Room* room = findRoom(roomId);
+    if (!room)
+    {
+        return QJsonObject { { "errcode", "M_NOT_FOUND" }, { "error", "No such room" } };
+    }
+    m_stats.sent++;
+
+    QJsonObject event = makeEvent(QStringLiteral("m.room.message"), m_botId, content);
+    // So that the bot recognizes its own message when it comes back
+    event.insert("unsigned", QJsonObject { { "transaction_id", txnId } });
+    const QString eventId = event.value("event_id").toString();
+    append(*room, event);
+
+    if (m_sent)
+    {
+        m_sent(int(room - m_rooms.data()), content.value("body").toString());
+    }
+    return QJsonObject { { "event_id", eventId } };
+}
+
+QJsonObject MockHomeserver::messages(const QString& roomId, const Request& request)
+{
+    Room* room = findRoom(roomId);
+    if (!room)
+    {
+        return QJsonObject { { "errcode", "M_NOT_FOUND" }, { "error", "No such room" } };
+    }
+
+    const int size = int(room->timeline.size());
+    const int from = qBound(0, parseIndex(request.query.value(QStringLiteral("from")), size), size);
+    const int limit = qBound(1, request.query.value(QStringLiteral("limit"), QStringLiteral("10")).toInt(), 1000);
+    const bool backwards = request.query.value(QStringLiteral("dir"), QStringLiteral("b")) == QStringLiteral("b");
+
+    QJsonArray chunk;
+    int end = from;
+    if (backwards)
+    {
+        // Newest first, from the event before the token
+        for (end = from; end > 0 && from - end < limit; --end)
+        {
+            chunk.append(room->timeline[size_t(end - 1)].json);
+        }
+    }
+    else
+    {
+        for (end = from; end < size && end - from < limit; ++end)
+        {
+            chunk.append(room->timeline[size_t(end)].json);
+        }
+    }
+    return QJsonObject { { "start", indexToken(size_t(from)) },
+                         { "end", indexToken(size_t(end)) },
+                         { "chunk", chunk } };
+}
+
+QJsonObject MockHomeserver::joinedMembers(const QString& roomId)
+{
+    Room* room = findRoom(roomId);
+    if (!room)
+    {
+        return QJsonObject { { "errcode", "M_NOT_FOUND" }, { "error", "No such room" } };
+    }
+    QJsonObject joined;
+    for (const auto& e : room->state)
+    {
+        const QJsonObject content = e.value("content").toObject();
+        if (e.value("type").toString() == QStringLiteral("m.room.member")
+            && content.value("membership").toString() == QStringLiteral("join"))
+        {
+            joined.insert(e.value("state_key").toString(),
+                          QJsonObject { { "display_name", content.value("displayname") } });
+        }
+    }
+    return QJsonObject { { "joined", joined } };
+}
+
+QJsonObject MockHomeserver::sync(qint64 since)
+{
+    QJsonObject joinedRooms;
+    for (const auto& room : m_rooms)
+    {
+        if (room.botJoined < 0)
+        {
+            continue;
+        }
+
+        QJsonArray state;
+        QJsonArray timeline;
+        size_t first = 0;
+        bool limited = false;
+        if (since < room.botJoined)
+        {
+            // New to the bot: all of the state, and the most recent events
+            for (const auto& e : room.state)
+            {
+                state.append(e);
+            }
+            first = room.timeline.size() > INITIAL_TIMELINE ? room.timeline.size() - INITIAL_TIMELINE : 0;
+            limited = first > 0;
+        }
+        else
+        {
+            auto it = std::upper_bound(room.timeline.begin(),
+                                       room.timeline.end(),
+                                       since,
+                                       [](qint64 pos, const Event& e) { return pos < e.pos; });
+            first = size_t(it - room.timeline.begin());
+        }
+        if (first >= room.timeline.size() && state.isEmpty())
+        {
+            continue;
+        }
+        for (size_t i = first; i < room.timeline.size(); ++i)
+        {
+            timeline.append(room.timeline[i].json);
+        }
+        m_stats.delivered += quint64(timeline.count());
+
+        joinedRooms.insert(
+            room.id,
+            QJsonObject {
+                { "state", QJsonObject { { "events", state } } },
+                { "timeline",
+                  QJsonObject { { "events", timeline }, { "limited", limited }, { "prev_batch", indexToken(first) } } },
+                { "ephemeral", QJsonObject { { "events", QJsonArray() } } },
+                { "account_data", QJsonObject { { "events", QJsonArray() } } } });
+    }
+
+    return QJsonObject { { "next_batch", QStringLiteral("s%1").arg(m_pos) },
+                         { "rooms", QJsonObject { { "join", joinedRooms } } },
+                         { "presence", QJsonObject { { "events", QJsonArray() } } },
+                         { "account_data", QJsonObject { { "events", QJsonArray() } } } };
+}
+
+void MockHomeserver::wakeSyncs(bool timeoutsOnly)
+{
+    const qint64 t = now();
+    for (auto it = m_pendingSyncs.begin(); it != m_pendingSyncs.end();)
+    {
+        if (!it->socket)
+        {
+            it = m_pendingSyncs.erase(it);
+        }
+        else if (it->deadline <= t || (!timeoutsOnly && it->since < m_pos))
+        {
+            reply(it->socket, sync(it->since));
+            it = m_pendingSyncs.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+}  // namespace QuatBot
@@ -0,0 +1,147 @@
+/*
+ *  SPDX-License-Identifier: BSD-2-Clause
+ *  SPDX-License-File: LICENSE
+ *
+ * Copyright 2019 Adriaan de Groot <groot@kde.org>
+ */
+
+#ifndef QUATBOT_MOCKSERVER_H
+#define QUATBOT_MOCKSERVER_H
+
+#include <QHash>
+#include <QJsonObject>
+#include <QList>
+#include <QObject>
+#include <QPointer>
+#include <QString>
+#include <QTimer>
+#include <QUrl>
+
+#include <functional>
+#include <vector>
+
+class QTcpServer;
+class QTcpSocket;
+
+namespace QuatBot
+{
+/** @brief A stand-in Matrix homeserver, for load tests
+ *
+ * This speaks just enough of the client-server API for quatbot and
+ * qb-dumper: login, join, (long-polling) sync, sending messages,
+ * /messages and /joined_members. Anything else gets an empty
+ * JSON object. There is only one user that logs in (the bot); the
+ * other members of the rooms only exist as events.
+ *
+ * Rooms are created up-front, with members and (optionally) some
+ * history, and have alias `#load<n>:<server name>`. Messages from
+ * members are added with inject().
+ */
+class MockHomeserver : public QObject
+{
+public:
+    struct Options
+    {
+        int rooms = 10;
+        int members = 100;
+        int history = 0;  ///< events in each room before the bot arrives
+        QString serverName = QStringLiteral("mock.local");
+    };
+
+    /// @brief Called for each message the bot sends, with the room index and message body
+    using SentCallback = std::function<void(int, const QString&)>;
+
+    explicit MockHomeserver(const Options& options, QObject* parent = nullptr);
+    virtual ~MockHomeserver() override;
+
+    /// @brief Starts serving on localhost, port @p port (0 picks a free one)
+    bool listen(quint16 port);
+    /// @brief Base URL of the server, for Connection::setHomeserver()
+    QUrl url() const;
+
+    int roomCount() const { return int(m_rooms.size()); }
+    int memberCount() const { return m_options.members; }
+    /// @brief Number of rooms the bot has joined
+    int joinedCount() const;
+    QString roomAlias(int room) const;
+    QString memberId(int member) const;
+
+    /// @brief Adds a message from @p member to @p room
+    void inject(int room, int member, const QString& body);
+    void setSentCallback(SentCallback callback) { m_sent = std::move(callback); }
+
+    struct Stats
+    {
+        quint64 requests = 0;
+        quint64 syncs = 0;
+        quint64 injected = 0;  ///< messages added with inject()
+        quint64 delivered = 0;  ///< events sent to the bot in sync responses
+        quint64 sent = 0;  ///< messages sent by the bot
+    };
+    const Stats& stats() const { return m_stats; }
+
+private:
+    struct Event
+    {
+        qint64 pos;  ///< stream position, 0 for history
+        QJsonObject json;
+    };
+    struct Room
+    {
+        QString id;
+        QString alias;
+        std::vector<QJsonObject> state;
+        std::vector<Event> timeline;
+        qint64 botJoined = -1;  ///< stream position where the bot joined, -1 if it hasn't
+    };
+    struct Request
+    {
+        QByteArray method;
+        QString path;  ///< without the query, percent-decoded per segment
+        QHash<QString, QString> query;
+        QByteArray body;
+    };
+    struct PendingSync
+    {
+        QPointer<QTcpSocket> socket;
+        qint64 since;
+        qint64 deadline;  ///< msecs since epoch
+    };
+
+    void newConnection();
+    /// @brief Parses and handles complete requests that have arrived on @p socket
+    void readRequests(QTcpSocket* socket);
+    void handle(QTcpSocket* socket, const Request& request);
+    void reply(QTcpSocket* socket, const QJsonObject& body, int status = 200);
+
+    QJsonObject login(const Request& request);
+    QJsonObject join(const QString& roomIdOrAlias);
+    QJsonObject send(const QString& roomId, const QString& txnId, const QJsonObject& content);
+    QJsonObject messages(const QString& roomId, const Request& request);
+    QJsonObject joinedMembers(const QString& roomId);
+    QJsonObject sync(qint64 since);
+
+    /// @brief Answers the long-polling syncs that have something new, or have timed out
+    void wakeSyncs(bool timeoutsOnly = false);
+    /// @brief Adds event @p json to the timeline of @p room (and the state, if it is a state event)
+    void append(Room& room, QJsonObject json);
+    QJsonObject makeEvent(const QString& type, const QString& sender, const QJsonObject& content);
+    Room* findRoom(const QString& roomIdOrAlias);
+
+    Options m_options;
+    QTcpServer* m_server;
+    std::vector<Room> m_rooms;
+    QHash<QTcpSocket*, QByteArray> m_buffers;
+    QList<PendingSync> m_pendingSyncs;
+    QTimer m_syncTimer;
+    SentCallback m_sent;
+    Stats m_stats;
+
+    QString m_botId;
+    qint64 m_pos = 0;  ///< last stream position handed out
+    qint64 m_eventCount = 0;
+    bool m_wakeScheduled = false;
+};
+
+}  // namespace QuatBot
+#endif
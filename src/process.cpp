@@ -0,0 +1,133 @@
+/*
+ *  SPDX-License-Identifier: BSD-2-Clause
+ *  SPDX-License-File: LICENSE
+ *
+ * Copyright 2019 Adriaan de Groot <groot@kde.org>
+ */
+
+#include "process.h"
+
+#include "lagmonitor.h"
+#include "timerwheel.h"
+
+#include <QDebug>
+#include <QProcess>
+
+#include <memory>
+
+namespace QuatBot
+{
+/// Requests that may wait for a free process slot
+static constexpr const int MAX_PENDING = 16;
+
+ProcessRunner::ProcessRunner()
+    : QObject()
+{
+}
+
+ProcessRunner* ProcessRunner::instance()
+{
+    // The processes report to the thread that started them
+    static thread_local ProcessRunner* runner = new ProcessRunner;
+    return runner;
+}
+
+void ProcessRunner::setMaximumProcesses(int max)
+{
+    m_maxRunning = qMax(1, max);
+    while (m_running < m_maxRunning && !m_pending.isEmpty())
+    {
+        start(m_pending.dequeue());
+    }
+}
+
+bool ProcessRunner::run(const QString& executable,
+                        const QStringList& args,
+                        const QString& failure,
+                        Callback done,
+                        int timeout)
+{
+    Job job { executable, args, failure, done, timeout };
+    if (m_running < m_maxRunning)
+    {
+        start(job);
+        return true;
+    }
+    if (m_pending.count() < MAX_PENDING)
+    {
+        m_pending.enqueue(job);
+        return true;
+    }
+    qWarning() << "Too many processes waiting, not running" << executable;
+    return false;
+}
+
+void ProcessRunner::start(const Job& job)
+{
+    m_running++;
+
+    auto* p = new QProcess(this);
+
+    // Both finished() and errorOccurred() may fire for one process,
+    // only the first one reports back.
+    auto reported = std::make_shared<bool>(false);
+    auto timeout = std::make_shared<TimerWheel::Id>(0);
+    auto report = [this, p, timeout, reported, done = job.done](const QString& result)
+    {
+        if (*reported)
+        {
+            return;
+        }
+        *reported = true;
+        TimerWheel::instance()->cancel(*timeout);
+        LagMonitor::Activity activity(QStringLiteral("process"), p->program());
+        done(result);
+        processDone(p);
+    };
+
+    connect(p,
+            QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished),
+            this,
+            [p, report, failure = job.failure](int exitCode, QProcess::ExitStatus status)
+            {
+                if ((status == QProcess::NormalExit) && (exitCode == 0))
+                {
+                    report(QString::fromLatin1(p->readAllStandardOutput()));
+                }
+                else
+                {
+                    report(failure);
+                }
+            });
+    connect(p,
+            &QProcess::errorOccurred,
+            this,
+            [report, failure = job.failure](QProcess::ProcessError e)
+            {
+                // Other errors are followed by finished()
+                if (e == QProcess::FailedToStart)
+                {
+                    report(failure);
+                }
+            });
+
+    p->start(job.executable, job.args, QIODevice::ReadOnly);
+    *timeout = TimerWheel::instance()->schedule(job.timeout,
+                                                [p]()
+                                                {
+                                                    qWarning() << "Process" << p->program() << "timed out.";
+                                                    p->kill();
+                                                });
+}
+
+void ProcessRunner::processDone(QProcess* p)
+{
+    p->deleteLater();
+    m_running--;
+    if (m_running < m_maxRunning && !m_pending.isEmpty())
+    {
+        start(m_pending.dequeue());
+    }
+}
+
+}  // namespace QuatBot
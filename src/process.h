@@ -0,0 +1,79 @@
+/*
+ *  SPDX-License-Identifier: BSD-2-Clause
+ *  SPDX-License-File: LICENSE
+ *
+ * Copyright 2019 Adriaan de Groot <groot@kde.org>
+ */
+
+#ifndef QUATBOT_PROCESS_H
+#define QUATBOT_PROCESS_H
+
+#include <QObject>
+#include <QQueue>
+#include <QString>
+#include <QStringList>
+
+#include <functional>
+
+class QProcess;
+
+namespace QuatBot
+{
+/** @brief Runs external programs without blocking the event loop
+ *
+ * There is one runner per thread (see instance()), shared by all
+ * the rooms that run in that thread. It runs at most maximumProcesses()
+ * programs at a time; further requests wait in a (short) queue.
+ * When a program exits, its output is passed to the callback,
+ * which is called from the event loop like any other slot.
+ */
+class ProcessRunner : public QObject
+{
+public:
+    /// @brief Called with the output of the program, or the failure message
+    using Callback = std::function<void(const QString&)>;
+
+    static ProcessRunner* instance();
+
+    /** @brief Start @p executable with @p args
+     *
+     * When the program exits normally with exit-code 0, @p done is
+     * called with its standard output; otherwise @p done is called
+     * with @p failure. Programs that run longer than @p timeout
+     * milliseconds are killed (and count as failed).
+     *
+     * Returns false if there is no room in the queue; then @p done
+     * is not called at all.
+     */
+    bool run(const QString& executable,
+             const QStringList& args,
+             const QString& failure,
+             Callback done,
+             int timeout = 5000);
+
+    int maximumProcesses() const { return m_maxRunning; }
+    void setMaximumProcesses(int max);
+
+private:
+    ProcessRunner();
+
+    struct Job
+    {
+        QString executable;
+        QStringList args;
+        QString failure;
+        Callback done;
+        int timeout;
+    };
+
+    void start(const Job& job);
+    /// @brief Cleans up @p p and starts the next queued job, if any
+    void processDone(QProcess* p);
+
+    QQueue<Job> m_pending;
+    int m_running = 0;
+    int m_maxRunning = 4;
+};
+
+}  // namespace QuatBot
+#endif
@@ -11,7 +11,7 @@
 #include <QDebug>
 #include <QNetworkReply>
 #include <QObject>
-#include <QTimer>
+#include <QSemaphore>
 
 #include <connection.h>
 #include <networkaccessmanager.h>
@@ -25,8 +25,14 @@
 #include "coffee.h"
 #endif
 #include "command.h"
+#include "envelope.h"
+#include "lagmonitor.h"
 #include "logger.h"
 #include "meeting.h"
+#include "metrics.h"
+#include "timerwheel.h"
+#include "trace.h"
+#include "workerpool.h"
 
 namespace QuatBot
 {
@@ -44,45 +50,27 @@ QStringList splitUserName(const QString& s)
     return l;
 }
 
-/** @brief Pair of Matrix-Id and split-up displayname.
- *
- * This is used in matching names to Matrix-Ids: a command can name
- * a user, either by Matrix-Id or by nickname. Since nicknames may
- * be more than one word, we need to be able to match, say
- * `@adridg:matirx.org` with the nickname *adridg the bot*.
- *
- * To do that, we'll sort nicknames in the room by length,
- * longest first, so that *adridg the bot* and *adridg* are
- * treated separately (and using the long nickname won't match
- * with the short one first).
+/** @brief Sort split-up displaynames, longest first, then alphabetical.
  */
-struct DisplayName
+static bool longestFirst(const QStringList& a, const QStringList& b)
 {
-    QString id;
-    QStringList displayName;
-};
-
-/** @brief Sort displaynames, longest first, then alphabetical.
- */
-bool operator<(const DisplayName& a, const DisplayName& b)
-{
-    if (a.displayName.count() > b.displayName.count())
+    if (a.count() > b.count())
     {
         return true;
     }
-    if (a.displayName.count() < b.displayName.count())
+    if (a.count() < b.count())
     {
         return false;
     }
 
     // Equal length
-    for (int i = 0; i < a.displayName.count(); ++i)
+    for (int i = 0; i < a.count(); ++i)
     {
-        if (a.displayName[i] < b.displayName[i])
+        if (a[i] < b[i])
         {
             return true;
         }
-        if (a.displayName[i] > b.displayName[i])
+        if (a[i] > b[i])
         {
             return false;
         }
@@ -90,20 +78,45 @@ bool operator<(const DisplayName& a, const DisplayName& b)
     return false;
 }
 
+void Bot::collectMembers(QVector<Member>& members, QStringList& ids) const
+{
+    QUATBOT_TRACE("Bot::updateMembers");
+    members.clear();
+    ids.clear();
+    const auto users = m_room->users();
+    members.reserve(users.count());
+    ids.reserve(users.count());
+    for (const auto& u : users)
+    {
+        const QString name = u->displayname(m_room);
+        members.append({ u->id(), name, splitUserName(name) });
+        ids << u->id();
+    }
+    std::sort(members.begin(),
+              members.end(),
+              [](const Member& a, const Member& b) { return longestFirst(a.displayNameParts, b.displayNameParts); });
+}
+
+void Bot::updateMembers()
+{
+    if (m_worker || !m_membersChanged || !m_room)
+    {
+        return;
+    }
+    collectMembers(m_members, m_memberIds);
+    m_membersChanged = false;
+}
+
 QStringList Bot::userLookup(const QStringList& users)
 {
+    QUATBOT_TRACE("Bot::userLookup");
     QStringList ids;
 
     if (!m_room)
         return ids;
 
-    QList<DisplayName> idToDisplayName;
-    idToDisplayName.reserve(m_room->users().count());
-    for (const auto& u : m_room->users())
-    {
-        idToDisplayName.append({ u->id(), splitUserName(u->displayname(m_room)) });
-    }
-    std::sort(idToDisplayName.begin(), idToDisplayName.end());
+    updateMembers();
+    ids.reserve(users.count());
 
     int i = 0;
     while (i < users.count())
@@ -121,8 +134,9 @@ QStringList Bot::userLookup(const QStringList& users)
         else
         {
             bool found = false;
-            for (const auto& [matrixId, userParts] : idToDisplayName)
+            for (const auto& m : m_members)
             {
+                const auto& userParts = m.displayNameParts;
                 found = userParts.count() > 0;  // initialize to false if the for-loop would be skipped
                 for (int j = 0; (j < userParts.count()) && ((i + j) < users.count()); ++j)
                 {
@@ -134,7 +148,7 @@ QStringList Bot::userLookup(const QStringList& users)
                 }
                 if (found)
                 {
-                    ids << matrixId;
+                    ids << m.id;
                     i += userParts.count() - 1;
                     break;
                 }
@@ -152,6 +166,7 @@ QStringList Bot::userLookup(const QStringList& users)
 
 QString Bot::userLookup(const QString& userName)
 {
+    QUATBOT_TRACE("Bot::userLookup");
     if (!m_room)
         return QString();
 
@@ -162,10 +177,11 @@ QString Bot::userLookup(const QString& userName)
     if (n.startsWith('@') && n.contains(':'))
         return n;
 
-    for (const auto& u : m_room->users())
+    updateMembers();
+    for (const auto& m : m_members)
     {
-        if (n == u->displayname(m_room))
-            return u->id();
+        if (n == m.displayName)
+            return m.id;
     }
 
     return QString();
@@ -173,29 +189,65 @@ QString Bot::userLookup(const QString& userName)
 
 QStringList Bot::userIds()
 {
-    QStringList l;
     if (!m_room)
-        return l;
+        return QStringList();
 
-    m_room->setDisplayed(true);
-    for (const auto& u : m_room->users())
+    if (!m_worker)
     {
-        l << u->id();
+        m_room->setDisplayed(true);
     }
-    return l;
+    updateMembers();
+    return m_memberIds;
 }
 
 QString Bot::botUser() const
 {
-    return m_conn.userId();
+    return m_botUser;
 }
 
 
 static int instance_count = 0;
+static bool standalone = true;
 
 static void bailOut(int timeout = 0)
 {
-    QTimer::singleShot(timeout, qApp, &QCoreApplication::quit);
+    if (standalone)
+    {
+        TimerWheel::singleShot(timeout, qApp, []() { QCoreApplication::quit(); });
+    }
+}
+
+void Bot::setStandalone(bool b)
+{
+    standalone = b;
+}
+
+void Bot::giveUp()
+{
+    if (standalone)
+    {
+        bailOut();
+    }
+    else
+    {
+        deleteLater();
+    }
+}
+
+void Bot::detach()
+{
+    m_leaveRoom = false;
+    deleteLater();
+}
+
+/// @brief Calls @p drain in the thread of @p context, unless a call is pending already
+template<typename F>
+static void schedule(std::atomic<bool>& scheduled, QObject* context, F drain)
+{
+    if (!scheduled.exchange(true))
+    {
+        QMetaObject::invokeMethod(context, drain, Qt::QueuedConnection);
+    }
 }
 
 
@@ -203,12 +255,25 @@ Bot::Bot(QMatrixClient::Connection& conn, const QString& roomName, const QString
     : QObject()
     , m_conn(conn)
     , m_roomName(roomName)
+    , m_botUser(conn.userId())
 {
     instance_count++;
+    setupMetrics();
+    if (auto* pool = WorkerPool::instance())
+    {
+        m_worker = new QObject;
+        m_worker->moveToThread(pool->assign());
+    }
+    if (auto* stage = ObserverStage::thread())
+    {
+        m_observer = new QObject;
+        m_observer->moveToThread(stage);
+    }
+
     if (conn.homeserver().isEmpty() || !conn.homeserver().isValid())
     {
         qWarning() << "Connection is invalid.";
-        bailOut();
+        giveUp();
         return;
     }
 
@@ -216,7 +281,7 @@ Bot::Bot(QMatrixClient::Connection& conn, const QString& roomName, const QString
     if (!joinRoom)
     {
         qWarning() << "Can't get a join-room job.";
-        bailOut();
+        giveUp();
         return;
     }
 
@@ -225,20 +290,27 @@ Bot::Bot(QMatrixClient::Connection& conn, const QString& roomName, const QString
             [this]()
             {
                 qWarning() << "Joining room" << this->m_roomName << "failed.";
-                bailOut();
+                giveUp();
             });
     connect(joinRoom,
             &QMatrixClient::BaseJob::success,
             [this, joinRoom]()
             {
-                setupWatchers();
-
                 qDebug() << "Joined room" << this->m_roomName << "successfully.";
                 m_room = m_conn.room(joinRoom->roomId(), QMatrixClient::JoinState::Join);
+                if (m_worker)
+                {
+                    // Queued before any messages can be, so the watchers are there for them
+                    QMetaObject::invokeMethod(m_worker, [this]() { setupWatchers(); }, Qt::QueuedConnection);
+                }
+                else
+                {
+                    setupWatchers();
+                }
                 if (!m_room)
                 {
                     qDebug() << ".. pending invite, giving up already.";
-                    bailOut();
+                    giveUp();
                 }
                 else
                 {
@@ -246,9 +318,9 @@ Bot::Bot(QMatrixClient::Connection& conn, const QString& roomName, const QString
                     qDebug() << "Room version" << m_room->version();
                     m_room->setDisplayed(true);  // Force non-lazy load
                     // Some rooms never generate a baseStateLoaded signal, so just wait 10sec
-                    QTimer::singleShot(10000, this, &Bot::baseStateLoaded);
+                    TimerWheel::singleShot(10000, this, [this]() { baseStateLoaded(); });
                     connect(m_room, &QMatrixClient::Room::baseStateLoaded, this, &Bot::baseStateLoaded);
-                    connect(m_room, &QMatrixClient::Room::addedMessages, this, &Bot::addedMessages);
+                    connectRoom();
                 }
             });
 
@@ -259,13 +331,57 @@ Bot::Bot(QMatrixClient::Connection& conn, const QString& roomName, const QString
     }
 }
 
+Bot::Bot(QMatrixClient::Connection& conn, QMatrixClient::Room* room, const QStringList& ops)
+    : QObject()
+    , m_room(room)
+    , m_conn(conn)
+    , m_roomName(room->id())
+    , m_botUser(conn.userId())
+    , m_newlyConnected(false)
+    , m_offline(true)
+{
+    instance_count++;
+    setupMetrics();
+    setupWatchers();
+    connectRoom();
+
+    setOps(conn.userId(), true);
+    for (const auto& u : ops)
+    {
+        setOps(u, true);
+    }
+}
+
 Bot::~Bot()
 {
-    if (m_room)
+    if (m_room && !m_offline && m_leaveRoom)
     {
         m_room->leaveRoom();
     }
-    qDeleteAll(m_watchers);
+    if (m_worker)
+    {
+        // The watchers go in their own thread; after this, nothing runs there for this bot.
+        // If the pool has stopped already, they are leaked along with the thread.
+        QObject* worker = m_worker;
+        if (worker->thread()->isRunning())
+        {
+            QMetaObject::invokeMethod(
+                worker,
+                [this, worker]()
+                {
+                    stopObserving();
+                    qDeleteAll(m_watchers);
+                    m_watchers.clear();
+                    delete worker;
+                },
+                Qt::BlockingQueuedConnection);
+        }
+    }
+    else
+    {
+        stopObserving();
+        qDeleteAll(m_watchers);
+    }
 
     instance_count--;
     if (instance_count < 1)
@@ -274,6 +390,51 @@ Bot::~Bot()
     }
 }
 
+void Bot::setupMetrics()
+{
+    auto* metrics = MetricsRegistry::instance();
+    const MetricsRegistry::Labels room { { QStringLiteral("room"), m_roomName } };
+    m_messagesMetric = metrics->counter(QStringLiteral("quatbot_messages_total"), "Messages received.", room);
+    m_sentMetric = metrics->counter(QStringLiteral("quatbot_messages_sent_total"), "Messages sent.", room);
+    m_unknownMetric = metrics->counter(
+        QStringLiteral("quatbot_commands_unknown_total"), "Commands not handled by any watcher.", room);
+    m_dispatchMetric = metrics->histogram(
+        QStringLiteral("quatbot_dispatch_seconds"), "Time to handle one message, including commands.", room);
+    m_queueMetric
+        = metrics->gauge(QStringLiteral("quatbot_outbound_queue_depth"), "Lines waiting for the next flush.", room);
+    m_pendingMetric = metrics->gauge(
+        QStringLiteral("quatbot_pending_events"), "Events sent to the server but not yet confirmed.", room);
+    m_timelineMetric
+        = metrics->gauge(QStringLiteral("quatbot_timeline_events"), "Events in the room timeline in memory.", room);
+}
+
+void Bot::connectRoom()
+{
+    connect(m_room, &QMatrixClient::Room::addedMessages, this, &Bot::addedMessages);
+    // Anything that changes who is in the room, or what they are called
+    const auto membersChanged = [this]()
+    {
+        if (m_worker && !m_membersChanged)
+        {
+            // After the rest of this sync, so that messages in it can take the members along
+            QMetaObject::invokeMethod(this, [this]() { publishMembers(); }, Qt::QueuedConnection);
+        }
+        m_membersChanged = true;
+    };
+    connect(m_room, &QMatrixClient::Room::userAdded, this, membersChanged);
+    connect(m_room, &QMatrixClient::Room::userRemoved, this, membersChanged);
+    connect(m_room, &QMatrixClient::Room::memberRenamed, this, membersChanged);
+    connect(m_room, &QMatrixClient::Room::memberListChanged, this, membersChanged);
+    connect(m_room,
+            &QMatrixClient::Room::messageSent,
+            this,
+            [this](const QString& txnId, const QString&) { m_latency.sent(txnId); });
+    connect(m_room,
+            &QMatrixClient::Room::pendingEventAboutToMerge,
+            this,
+            [this](QMatrixClient::RoomEvent* e, int) { m_latency.echoed(e->transactionId()); });
+}
+
 void Bot::baseStateLoaded()
 {
     if (m_newlyConnected)
@@ -281,6 +442,8 @@ void Bot::baseStateLoaded()
         m_newlyConnected = false;
         qDebug() << "Room base state loaded"
                  << "id=" << m_room->id() << "name=" << m_room->displayName() << "topic=" << m_room->topic();
+        // The worker has no members yet, and there may be no messages for a while
+        publishMembers();
     }
 }
 
@@ -298,6 +461,21 @@ private:
     Bot* m_b;
 };
 
+/// @brief RAII helper to track the latency of one command; declare it before the Flusher
+class LatencyScope
+{
+public:
+    LatencyScope(LatencyTracker& tracker, const QString& command, qint64 origin, qint64 arrival)
+        : m_tracker(tracker)
+    {
+        m_tracker.begin(command, origin, arrival);
+    }
+    ~LatencyScope() { m_tracker.finish(); }
+
+private:
+    LatencyTracker& m_tracker;
+};
+
 void Bot::addedMessages(int from, int to)
 {
     if (m_newlyConnected)
@@ -307,6 +485,10 @@ void Bot::addedMessages(int from, int to)
         return;
     }
 
+    QUATBOT_TRACE("Bot::addedMessages");
+    const qint64 arrival = QDateTime::currentMSecsSinceEpoch();
+    LagMonitor::Activity activity(m_roomName, QString("%1 messages").arg(to - from + 1));
+    Inbound inbound;  // for the worker thread, if any
     bool first = true;
     const auto& timeline = m_room->messageEvents();
     for (int it = from; it <= to; ++it)
@@ -314,63 +496,247 @@ void Bot::addedMessages(int from, int to)
         const QMatrixClient::RoomMessageEvent* event = timeline[it].viewAs<QMatrixClient::RoomMessageEvent>();
         if (event)
         {
+            // Decoded once, for all the watchers
+            const MessageEnvelope envelope(event);
             if (first)
             {
                 qDebug() << "Room messages" << from << '-' << to << event->originTimestamp().toString() << "arrived"
                          << QDateTime::currentDateTimeUtc().toString();
                 first = false;
             }
-            for (const auto& w : m_watchers)
+            if (m_worker)
             {
-                w->handleMessage(event);
+                inbound.messages.push_back(envelope.detached());
             }
+            else
+            {
+                dispatch(envelope, arrival);
+            }
+        }
+    }
+    if (!inbound.messages.empty())
+    {
+        inbound.arrival = arrival;
+        if (m_membersChanged)
+        {
+            collectMembers(inbound.members, inbound.memberIds);
+            inbound.membersChanged = true;
+            m_membersChanged = false;
+        }
+        m_inbox.push(std::move(inbound));
+        schedule(m_inboxScheduled, m_worker, [this]() { drainInbox(); });
+    }
+    else
+    {
+        // A join, leave or rename without messages still has to reach the worker
+        publishMembers();
+    }
+    if (!m_offline)
+    {
+        m_room->markMessagesAsRead(timeline[to]->id());
+    }
+    m_timelineMetric->set(timeline.size());
+    m_pendingMetric->set(m_room->pendingEvents().size());
+}
+
+void Bot::publishMembers()
+{
+    if (!m_worker || !m_membersChanged || !m_room)
+    {
+        return;
+    }
+    Inbound inbound;
+    inbound.arrival = QDateTime::currentMSecsSinceEpoch();
+    collectMembers(inbound.members, inbound.memberIds);
+    inbound.membersChanged = true;
+    m_membersChanged = false;
+    m_inbox.push(std::move(inbound));
+    schedule(m_inboxScheduled, m_worker, [this]() { drainInbox(); });
+}
 
-            CommandArgs cmd(event);
-            if (cmd.isValid())
+void Bot::dispatch(const MessageEnvelope& envelope, qint64 arrival)
+{
+    QUATBOT_TRACE_DETAIL("Bot::dispatch", envelope.id());
+    HistogramTimer dispatchTimer(m_dispatchMetric);
+    m_messagesMetric->add();
+    for (int i = 0; i < m_watchers.count(); ++i)
+    {
+        QUATBOT_TRACE_DETAIL("Watcher::handleMessage", m_watchers[i]->moduleName());
+        LagMonitor::Activity activity(m_watchers[i]->moduleName(), QString(), envelope.id());
+        m_watchers[i]->handleMessage(envelope);
+        m_watcherMetrics[i].messages->add();
+    }
+    if (!m_observers.isEmpty())
+    {
+        observe(
+            [this, e = envelope.detached()]()
             {
-                Flusher f(this);
-                bool handled = false;
-                for (const auto& w : m_watchers)
+                for (const auto& w : m_observers)
                 {
-                    if (w->moduleName() == cmd.command)
-                    {
-                        cmd.pop();
-                        w->handleCommand(cmd);
-                        handled = true;
-                        break;
-                    }
+                    QUATBOT_TRACE_DETAIL("Watcher::observe", w->moduleName());
+                    LagMonitor::Activity activity(w->moduleName(), QStringLiteral("observe"), e.id());
+                    w->observe(e);
                 }
+            });
+    }
 
-                if (handled)
-                {
-                    continue;
-                }
+    if (!envelope.isCommand())
+    {
+        return;
+    }
+    CommandArgs cmd(envelope);
+    if (cmd.isValid())
+    {
+        LatencyScope latency(m_latency, cmd.command, envelope.timestamp(), arrival);
+        Flusher f(this);
+        bool handled = false;
+        for (int i = 0; i < m_watchers.count(); ++i)
+        {
+            if (m_watchers[i]->moduleName() == cmd.command)
+            {
+                cmd.pop();
+                runCommand(i, cmd);
+                handled = true;
+                break;
+            }
+        }
+
+        if (handled)
+        {
+            return;
+        }
 
-                if (m_ambiguousCommands.contains(cmd.command))
+        if (m_ambiguousCommands.contains(cmd.command))
+        {
+            m_latency.discard();
+            message(QString("'%1' is ambiguous. Please use a module command.").arg(cmd.command));
+        }
+        else
+        {
+            for (int i = 0; i < m_watchers.count(); ++i)
+            {
+                if (m_watchers[i]->moduleCommands().contains(cmd.command))
                 {
-                    message(QString("'%1' is ambiguous. Please use a module command.").arg(cmd.command));
+                    runCommand(i, cmd);
+                    handled = true;
+                    break;
                 }
-                else
-                {
-                    for (const auto& w : m_watchers)
-                    {
-                        if (w->moduleCommands().contains(cmd.command))
-                        {
-                            w->handleCommand(cmd);
-                            handled = true;
-                            break;
-                        }
-                    }
+            }
 
-                    if (!handled)
-                    {
-                        message(QString("I don't understand '%1'.").arg(cmd.command));
-                    }
-                }
+            if (!handled)
+            {
+                m_unknownMetric->add();
+                m_latency.discard();
+                message(QString("I don't understand '%1'.").arg(cmd.command));
             }
         }
     }
-    m_room->markMessagesAsRead(timeline[to]->id());
+}
+
+void Bot::drainInbox()
+{
+    // Cleared first: anything pushed from here on schedules another drain
+    m_inboxScheduled.store(false);
+    Inbound inbound;
+    while (m_inbox.pop(inbound))
+    {
+        if (inbound.membersChanged)
+        {
+            m_members = std::move(inbound.members);
+            m_memberIds = std::move(inbound.memberIds);
+        }
+        LagMonitor::Activity activity(m_roomName, QString("%1 messages").arg(inbound.messages.size()));
+        for (const auto& envelope : inbound.messages)
+        {
+            dispatch(envelope, inbound.arrival);
+        }
+    }
+}
+
+void Bot::observe(std::function<void()> f)
+{
+    if (!m_observer)
+    {
+        f();
+        return;
+    }
+    m_observed.push(std::move(f));
+    schedule(m_observedScheduled, m_observer, [this]() { drainObserved(); });
+}
+
+void Bot::observeAndWait(std::function<void()> f)
+{
+    if (!m_observer)
+    {
+        f();
+        return;
+    }
+    QSemaphore done;
+    observe(
+        [&f, &done]()
+        {
+            f();
+            done.release();
+        });
+    done.acquire();
+}
+
+void Bot::drainObserved()
+{
+    m_observedScheduled.store(false);
+    std::function<void()> f;
+    while (m_observed.pop(f))
+    {
+        f();
+    }
+}
+
+void Bot::stopObserving()
+{
+    if (!m_observer)
+    {
+        return;
+    }
+    // Whatever is queued still runs, then nothing more for this bot
+    QObject* observer = m_observer;
+    m_observer = nullptr;
+    if (observer->thread()->isRunning())
+    {
+        QMetaObject::invokeMethod(
+            observer,
+            [this, observer]()
+            {
+                drainObserved();
+                delete observer;
+            },
+            Qt::BlockingQueuedConnection);
+    }
+}
+
+void Bot::drainOutbox()
+{
+    m_outboxScheduled.store(false);
+    Outbound outbound;
+    while (m_outbox.pop(outbound))
+    {
+        const QString txnId = m_room->postPlainText(outbound.text);
+        if (outbound.timed)
+        {
+            m_latency.track(txnId, outbound.timing);
+        }
+        m_sentMetric->add();
+    }
+    m_pendingMetric->set(m_room->pendingEvents().size());
+}
+
+void Bot::runCommand(int index, const CommandArgs& cmd)
+{
+    QUATBOT_TRACE_DETAIL("Watcher::handleCommand", m_watchers[index]->moduleName());
+    LagMonitor::Activity activity(m_watchers[index]->moduleName(), cmd.command, cmd.id);
+    const auto& metrics = m_watcherMetrics[index];
+    HistogramTimer commandTimer(metrics.latency);
+    metrics.commands->add();
+    m_watchers[index]->handleCommand(cmd);
 }
 
 bool Bot::setOps(const QString& user, bool op)
@@ -380,19 +746,19 @@ bool Bot::setOps(const QString& user, bool op)
         // Doesn't look like a matrix ID to me
         return false;
     }
+    const UserId id(user);
     if (op)
     {
-        m_operators.insert(user);
+        m_operators.insert(id);
         return true;
     }
     else if (m_operators.count() > 1)
     {
         // Can't deop the bot itself
-        if (user == m_conn.userId())
+        if (id == UserId(m_botUser))
             return false;
-        if (m_operators.contains(user))
+        if (m_operators.remove(id))
         {
-            m_operators.remove(user);
             return true;
         }
         return false;  // Wasn't removed
@@ -401,9 +767,9 @@ bool Bot::setOps(const QString& user, bool op)
         return false;  // Can't remove last op
 }
 
-bool Bot::checkOps(const QString& user, Silent s)
+bool Bot::checkOps(UserId user, Silent s)
 {
-    return !user.isEmpty() && m_operators.contains(user);
+    return !user.isNull() && m_operators.contains(user);
 }
 
 bool Bot::checkOps(const QuatBot::CommandArgs& cmd, Silent s)
@@ -423,7 +789,22 @@ void Bot::message(const QStringList& l)
 {
     if (!m_room)
         return;
-    message(l.join(' '));
+    if (!m_replyParts.isEmpty())
+    {
+        // A watcher replied from handleMessage(), while the buffer is in use
+        message(l.join(' '));
+        return;
+    }
+
+    // Joined in a buffer that keeps its capacity, instead of in a new string
+    for (int i = 0; i < l.count(); ++i)
+    {
+        if (i > 0)
+            m_replyParts.append(' ');
+        m_replyParts.append(l[i]);
+    }
+    message(m_replyParts);
+    m_replyParts.resize(0);
 }
 
 void Bot::message(const QString& s)
@@ -432,17 +813,49 @@ void Bot::message(const QString& s)
         return;
     if (s.isEmpty())
         return;
-    m_accumulatedMessages.append(s);
+    if (m_replyCount++ > 0)
+        m_reply.append('\n');
+    m_reply.append(s);
+    m_queueMetric->set(m_replyCount);
     for (const auto& p : m_watchers)
         p->handleMessage(s);
+    if (!m_observers.isEmpty())
+    {
+        observe(
+            [this, s]()
+            {
+                for (const auto& w : m_observers)
+                    w->observe(s);
+            });
+    }
 }
 
 void Bot::message(Bot::Flush)
 {
-    if (!m_accumulatedMessages.isEmpty())
+    if (m_replyCount > 0)
     {
-        m_room->postPlainText(m_accumulatedMessages.join('\n'));
-        m_accumulatedMessages.clear();
+        QUATBOT_TRACE("Bot::flush");
+        // The room keeps what is posted, so it gets a copy of exactly
+        // the right size; m_reply stays unshared, and keeps its capacity.
+        QString text(m_reply.constData(), m_reply.size());
+        if (m_worker)
+        {
+            // The room belongs to the main thread, which posts it
+            Outbound outbound;
+            outbound.text = std::move(text);
+            outbound.timed = m_latency.handOver(outbound.timing);
+            m_outbox.push(std::move(outbound));
+            schedule(m_outboxScheduled, this, [this]() { drainOutbox(); });
+        }
+        else
+        {
+            m_latency.enqueued(m_room->postPlainText(text));
+            m_sentMetric->add();
+            m_pendingMetric->set(m_room->pendingEvents().size());
+        }
+        m_reply.resize(0);
+        m_replyCount = 0;
+        m_queueMetric->set(0);
     }
 }
 
@@ -482,6 +895,28 @@ void Bot::setupWatchers()
     m_watchers.append(new Coffee(this));
 #endif
 
+    for (const auto& w : m_watchers)
+    {
+        if (w->isObserver())
+        {
+            m_observers.append(w);
+        }
+    }
+
+    auto* metrics = MetricsRegistry::instance();
+    m_watcherMetrics.reserve(m_watchers.count());
+    for (const auto& w : m_watchers)
+    {
+        // BasicCommands has no name
+        const QString name = w->moduleName().isEmpty() ? QStringLiteral("basic") : w->moduleName();
+        const MetricsRegistry::Labels labels { { QStringLiteral("room"), m_roomName },
+                                               { QStringLiteral("watcher"), name } };
+        m_watcherMetrics.append(WatcherMetrics {
+            metrics->counter(QStringLiteral("quatbot_watcher_messages_total"), "Messages seen by a watcher.", labels),
+            metrics->counter(QStringLiteral("quatbot_watcher_commands_total"), "Commands run by a watcher.", labels),
+            metrics->histogram(QStringLiteral("quatbot_command_seconds"), "Time to run one command.", labels) });
+    }
+
     QSet<QString> commands;
     for (const auto& w : m_watchers)
     {
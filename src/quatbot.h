@@ -8,11 +8,20 @@
 #ifndef QUATBOT_QUATBOT_H
 #define QUATBOT_QUATBOT_H
 
+#include "envelope.h"
+#include "latency.h"
+#include "spscqueue.h"
+#include "userid.h"
+
 #include <QObject>
 #include <QSet>
 #include <QString>
 #include <QVector>
 
+#include <atomic>
+#include <functional>
+#include <vector>
+
 namespace Quotient
 {
 class Connection;
@@ -22,6 +31,9 @@ class Room;
 namespace QuatBot
 {
 struct CommandArgs;
+class Counter;
+class Gauge;
+class Histogram;
 class Watcher;
 
 /** @brief Top-level class for the QuatBot
@@ -42,6 +54,16 @@ class Watcher;
  * such as adding more operators, switching on logging, and
  * running meetings (the full scope depends on the modules
  * (Watcher instances) that run in the bot).
+ *
+ * If a WorkerPool is running when the bot is created, the watchers
+ * run in one of its threads; the bot itself, and the room, stay in
+ * the main thread. Messages (and the member list, when it changed)
+ * are handed to the watchers through a lock-free queue, and replies
+ * come back the same way; see context().
+ *
+ * If the ObserverStage is running, the bot hands each message (and
+ * each line it sends) to the stage as well, for the watchers that
+ * observe(); this is another lock-free queue, per bot.
  */
 class Bot : public QObject
 {
@@ -55,15 +77,38 @@ public:
      * set in @p conn is also always an operator.
      */
     explicit Bot(Quotient::Connection& conn, const QString& roomName, const QStringList& ops = QStringList());
+    /** @brief Create a bot for an existing @p room, without joining it
+     *
+     * This is for running the bot offline (benchmarks and replays):
+     * @p room is used as-is and handles messages right away. The bot
+     * does not send read markers, and does not leave the room when it
+     * is destroyed.
+     */
+    Bot(Quotient::Connection& conn, Quotient::Room* room, const QStringList& ops = QStringList());
     virtual ~Bot() override;
 
+    /** @brief Does the application go along with the bots? (default true)
+     *
+     * A standalone bot quits the application if it can't join its
+     * room, and when the last bot is gone. In a shard worker (see
+     * ShardWorker) or an Account, bots come and go, and the process
+     * stays; a bot that can't join its room deletes itself.
+     */
+    static void setStandalone(bool standalone);
+    /** @brief Stops following the room, without leaving it
+     *
+     * The bot is deleted later. The account stays in the room, e.g.
+     * because another process follows it now.
+     */
+    void detach();
+
     /// @brief Tag-class used in checkOps() overrides.
     struct Silent
     {
     };
 
     /// @brief is the @p user an operator of the bot? No message.
-    bool checkOps(const QString& user, Silent s);
+    bool checkOps(UserId user, Silent s);
     /// @brief is the @p cmd issued by an operator? No message.
     bool checkOps(const CommandArgs& cmd, Silent s);
     /** @brief is the @p cmd issued by an operator?
@@ -134,11 +179,42 @@ public:
     Watcher* getWatcher(const QString& name);
     QStringList watcherNames() const;
 
+    /** @brief The object that lives in the thread the watchers run in
+     *
+     * This is the bot itself, unless the bot runs in a WorkerPool thread.
+     * Use it as the context of callbacks into the watchers (timers,
+     * processes), so that they run in the right thread, and not at all
+     * once the watchers are gone.
+     */
+    QObject* context() { return m_worker ? m_worker : this; }
+
+    /** @brief Runs @p f with the observers, after what they have been given so far
+     *
+     * Without an ObserverStage, @p f runs right away. Commands that
+     * change what an observer does (e.g. ~log on) use this, so that
+     * the change applies from the next message on.
+     */
+    void observe(std::function<void()> f);
+    /// @brief Like observe(), but waits for @p f to be done; for commands that report on observers
+    void observeAndWait(std::function<void()> f);
+
 protected:
     /// @brief Called once the room is loaded for the first time.
     void baseStateLoaded();
     /// @brief Messages delivered by libqmatrixclient
     void addedMessages(int from, int to);
+    /// @brief Hands one message to the watchers, and runs the command in it, if any
+    void dispatch(const MessageEnvelope& envelope, qint64 arrival);
+    /// @brief Dispatches the messages that addedMessages() queued; in the worker thread
+    void drainInbox();
+    /// @brief Posts the replies that message(Flush) queued; in the main thread
+    void drainOutbox();
+    /// @brief Runs what observe() queued; in the observer stage
+    void drainObserved();
+    /// @brief Waits for the observer stage to be done with this bot, for good
+    void stopObserving();
+    /// @brief The room can't be joined: quits if standalone, otherwise the bot goes away
+    void giveUp();
 
     /** @brief Changes operator status of @p user to @p op
      * 
@@ -150,18 +226,113 @@ protected:
 
     /// @brief Instantiate the watchers for this bot
     void setupWatchers();
+    /// @brief Look up the metrics for this bot's room
+    void setupMetrics();
+    /// @brief Connect to the signals of m_room that the bot handles
+    void connectRoom();
+    /// @brief Runs the command @p cmd in the watcher with the given @p index
+    void runCommand(int index, const CommandArgs& cmd);
+
+    /** @brief A member of the room, as userLookup() matches them
+     *
+     * A command can name a user, either by Matrix-Id or by nickname.
+     * Since nicknames may be more than one word, we need to be able to
+     * match, say `@adridg:matirx.org` with the nickname *adridg the bot*.
+     */
+    struct Member
+    {
+        QString id;
+        QString displayName;
+        QStringList displayNameParts;
+    };
+    /** @brief Rebuilds m_members and m_memberIds, if the members of the room changed
+     *
+     * Members are sorted by nickname length, longest first, so that
+     * *adridg the bot* and *adridg* are treated separately (and using
+     * the long nickname won't match with the short one first).
+     *
+     * In a worker thread this does nothing: the main thread rebuilds
+     * the list and sends it along with the next messages, or on its
+     * own if no messages come with the change (see publishMembers()).
+     */
+    void updateMembers();
+    /// @brief Reads the members of the room into @p members and @p ids, see updateMembers()
+    void collectMembers(QVector<Member>& members, QStringList& ids) const;
+    /// @brief Sends changed members to the worker thread, if no messages took them along already
+    void publishMembers();
 
 private:
     Quotient::Room* m_room = nullptr;
     Quotient::Connection& m_conn;
 
     QVector<Watcher*> m_watchers;
-    QSet<QString> m_operators;
+
+    /// @brief Metrics for one watcher, same index as in m_watchers
+    struct WatcherMetrics
+    {
+        Counter* messages;
+        Counter* commands;
+        Histogram* latency;
+    };
+    QVector<WatcherMetrics> m_watcherMetrics;
+    Counter* m_messagesMetric = nullptr;
+    Counter* m_sentMetric = nullptr;
+    Counter* m_unknownMetric = nullptr;
+    Histogram* m_dispatchMetric = nullptr;
+    Gauge* m_queueMetric = nullptr;
+    Gauge* m_pendingMetric = nullptr;
+    Gauge* m_timelineMetric = nullptr;
+
+    QSet<UserId> m_operators;
     QSet<QString> m_ambiguousCommands;
 
-    QStringList m_accumulatedMessages;
+    // Cache of the members of the room, see updateMembers()
+    QVector<Member> m_members;
+    QStringList m_memberIds;
+    bool m_membersChanged = true;
+
+    // Messages waiting for message(Flush), one per line. The buffers
+    // are kept, so that replies don't allocate once they have grown.
+    QString m_reply;
+    int m_replyCount = 0;
+    QString m_replyParts;  ///< for joining message(QStringList)
+    LatencyTracker m_latency;
     QString m_roomName;
+    QString m_botUser;
+
+    // Running in a WorkerPool thread: the watchers live with m_worker.
+    // Each queue has one producer thread and one consumer thread, and
+    // a flag so that only one drain is pending in the consumer at a time.
+    struct Inbound
+    {
+        std::vector<MessageEnvelope> messages;  ///< detached
+        qint64 arrival = 0;
+        bool membersChanged = false;  ///< if true, replaces the worker's members
+        QVector<Member> members;
+        QStringList memberIds;
+    };
+    struct Outbound
+    {
+        QString text;
+        bool timed = false;  ///< the first reply to a command, with its timing
+        LatencyTracker::Timing timing;
+    };
+    QObject* m_worker = nullptr;
+    SpscQueue<Inbound> m_inbox;
+    SpscQueue<Outbound> m_outbox;
+    std::atomic<bool> m_inboxScheduled { false };
+    std::atomic<bool> m_outboxScheduled { false };
+
+    // With an ObserverStage, the observers run with m_observer. The
+    // queue's producer is the thread the watchers run in.
+    QVector<Watcher*> m_observers;  ///< watchers that observe()
+    QObject* m_observer = nullptr;
+    SpscQueue<std::function<void()>> m_observed;
+    std::atomic<bool> m_observedScheduled { false };
+
     bool m_newlyConnected = true;
+    bool m_offline = false;  ///< not joined, see the second constructor
+    bool m_leaveRoom = true;  ///< when destroyed, see detach()
 };
 }  // namespace QuatBot
 
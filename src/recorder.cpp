@@ -0,0 +1,113 @@
+/*
+ *  SPDX-License-Identifier: BSD-2-Clause
+ *  SPDX-License-File: LICENSE
+ *
+ * Copyright 2019 Adriaan de Groot <groot@kde.org>
+ */
+
+#include "recorder.h"
+
+#include <QDebug>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include <connection.h>
+#include <room.h>
+#include <user.h>
+
+namespace QuatBot
+{
+static QJsonArray toJson(QMatrixClient::RoomEventsRange events)
+{
+    QJsonArray a;
+    for (const auto& e : events)
+    {
+        a.append(e->fullJson());
+    }
+    return a;
+}
+
+SyncRecorder::SyncRecorder(QMatrixClient::Connection& conn, const QString& fileName)
+    : QObject()
+    , m_conn(conn)
+    , m_file(fileName)
+{
+    if (!m_file.open(QFile::WriteOnly | QFile::Truncate))
+    {
+        qWarning() << "Can't record to" << fileName << m_file.errorString();
+        return;
+    }
+    m_clock.start();
+    connect(&conn, &QMatrixClient::Connection::newRoom, this, &SyncRecorder::addRoom);
+}
+
+SyncRecorder::~SyncRecorder()
+{
+    m_file.close();
+}
+
+void SyncRecorder::addRoom(QMatrixClient::Room* room)
+{
+    m_rooms.insert(room);
+    connect(room, &QObject::destroyed, this, [this, room]() { m_rooms.remove(room); });
+    connect(room,
+            &QMatrixClient::Room::aboutToAddNewMessages,
+            this,
+            [this, room](QMatrixClient::RoomEventsRange events)
+            {
+                // The state from the same sync has been applied by now
+                if (m_rooms.contains(room))
+                {
+                    writeMembers(room);
+                }
+                write(QStringLiteral("timeline"), room->id(), toJson(events));
+            });
+    connect(room,
+            &QMatrixClient::Room::aboutToAddHistoricalMessages,
+            this,
+            [this, room](QMatrixClient::RoomEventsRange events)
+            { write(QStringLiteral("history"), room->id(), toJson(events)); });
+}
+
+void SyncRecorder::writeMembers(QMatrixClient::Room* room)
+{
+    // Only once per room; the member events in the timeline take it from there
+    m_rooms.remove(room);
+
+    QJsonArray members;
+    for (const auto* u : room->users())
+    {
+        members.append(QJsonObject {
+            { "type", "m.room.member" },
+            { "event_id", QStringLiteral("$recorded-member-%1").arg(members.count()) },
+            { "sender", u->id() },
+            { "state_key", u->id() },
+            { "origin_server_ts", 0 },
+            { "content", QJsonObject { { "membership", "join" }, { "displayname", u->displayname(room) } } } });
+    }
+    write(QStringLiteral("state"), room->id(), members);
+}
+
+void SyncRecorder::write(const QString& kind, const QString& roomId, const QJsonArray& events)
+{
+    if (!m_file.isOpen())
+    {
+        return;
+    }
+    if (!m_headerWritten)
+    {
+        // The user id is only known once the connection has logged in
+        m_headerWritten = true;
+        m_file.write(QJsonDocument(QJsonObject { { "kind", "header" }, { "user", m_conn.userId() } })
+                         .toJson(QJsonDocument::Compact));
+        m_file.write("\n");
+    }
+    const QJsonObject record {
+        { "kind", kind }, { "t", m_clock.elapsed() }, { "room", roomId }, { "events", events }
+    };
+    m_file.write(QJsonDocument(record).toJson(QJsonDocument::Compact));
+    m_file.write("\n");
+    m_file.flush();
+}
+
+}  // namespace QuatBot
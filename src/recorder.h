@@ -0,0 +1,63 @@
+/*
+ *  SPDX-License-Identifier: BSD-2-Clause
+ *  SPDX-License-File: LICENSE
+ *
+ * Copyright 2019 Adriaan de Groot <groot@kde.org>
+ */
+
+#ifndef QUATBOT_RECORDER_H
+#define QUATBOT_RECORDER_H
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QObject>
+#include <QSet>
+#include <QString>
+
+namespace Quotient
+{
+class Connection;
+class Room;
+}  // namespace Quotient
+
+namespace QuatBot
+{
+/** @brief Records the events that a connection receives, for qb-replay
+ *
+ * Every room of the connection is followed from the moment it appears.
+ * The file has one JSON object per line:
+ *  - a header, `{"kind":"header","user":...}`, with the user id of the
+ *    connection (messages from that user are the bot's own replies),
+ *  - `{"kind":"state","room":...,"events":[...]}` with the members of
+ *    a room, written before its first timeline batch,
+ *  - `{"kind":"timeline",...}` for each batch of new events from sync,
+ *  - `{"kind":"history",...}` for each batch of older events, from
+ *    `/messages`, in the order the server sent them (newest first).
+ *
+ * Each record also has `"t"`, milliseconds since recording started.
+ * Events are stored as the JSON the server sent.
+ */
+class SyncRecorder : public QObject
+{
+public:
+    SyncRecorder(Quotient::Connection& conn, const QString& fileName);
+    virtual ~SyncRecorder() override;
+
+    bool isOpen() const { return m_file.isOpen(); }
+
+private:
+    void addRoom(Quotient::Room* room);
+    void writeMembers(Quotient::Room* room);
+    void write(const QString& kind, const QString& roomId, const QJsonArray& events);
+
+    Quotient::Connection& m_conn;
+    QFile m_file;
+    QElapsedTimer m_clock;
+    QSet<Quotient::Room*> m_rooms;  ///< rooms whose members have not been written yet
+    bool m_headerWritten = false;
+};
+
+}  // namespace QuatBot
+
+#endif
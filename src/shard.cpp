@@ -0,0 +1,75 @@
+/*
+ *  SPDX-License-Identifier: BSD-2-Clause
+ *  SPDX-License-File: LICENSE
+ *
+ * Copyright 2019 Adriaan de Groot <groot@kde.org>
+ */
+
+#include "shard.h"
+
+#include <QCryptographicHash>
+
+namespace QuatBot
+{
+quint32 ShardRing::hash(const QString& s)
+{
+    const QByteArray digest = QCryptographicHash::hash(s.toUtf8(), QCryptographicHash::Md5);
+    const auto* d = reinterpret_cast<const uchar*>(digest.constData());
+    return (quint32(d[0]) << 24) | (quint32(d[1]) << 16) | (quint32(d[2]) << 8) | quint32(d[3]);
+}
+
+void ShardRing::addWorker(int worker)
+{
+    if (m_workers.insert(worker).second)
+    {
+        addPoints(worker);
+    }
+}
+
+void ShardRing::addPoints(int worker)
+{
+    for (int i = 0; i < POINTS; ++i)
+    {
+        // On a collision the lower-numbered worker keeps the point, whatever the order of adding
+        const quint32 point = hash(QStringLiteral("worker-%1-%2").arg(worker).arg(i));
+        auto it = m_points.find(point);
+        if (it == m_points.end())
+        {
+            m_points.emplace(point, worker);
+        }
+        else if (worker < it->second)
+        {
+            it->second = worker;
+        }
+    }
+}
+
+void ShardRing::removeWorker(int worker)
+{
+    if (m_workers.erase(worker) == 0)
+    {
+        return;
+    }
+    // A point it won from another worker goes back to that one, so start over
+    m_points.clear();
+    for (int w : m_workers)
+    {
+        addPoints(w);
+    }
+}
+
+int ShardRing::workerFor(const QString& room) const
+{
+    if (m_points.empty())
+    {
+        return -1;
+    }
+    auto it = m_points.lower_bound(hash(room));
+    if (it == m_points.end())
+    {
+        it = m_points.begin();  // around the ring
+    }
+    return it->second;
+}
+
+}  // namespace QuatBot
@@ -0,0 +1,55 @@
+/*
+ *  SPDX-License-Identifier: BSD-2-Clause
+ *  SPDX-License-File: LICENSE
+ *
+ * Copyright 2019 Adriaan de Groot <groot@kde.org>
+ */
+
+#ifndef QUATBOT_SHARD_H
+#define QUATBOT_SHARD_H
+
+#include <QString>
+
+#include <map>
+#include <set>
+
+namespace QuatBot
+{
+/** @brief Consistent hashing of rooms onto worker processes
+ *
+ * Each worker has a number of points on a ring of 32-bit hashes; a
+ * room belongs to the worker of the first point at or after the
+ * room's own hash. Adding or removing a worker only moves the rooms
+ * next to its points, about 1/n of them, and the rest stay put.
+ *
+ * The hashes are the same in every process and every run (unlike
+ * qHash()), so all processes agree on where a room goes. Where a
+ * room goes depends only on which workers are in the ring, not on
+ * the order they were added or removed in.
+ */
+class ShardRing
+{
+public:
+    /// Points per worker; more points spread the rooms more evenly
+    static constexpr const int POINTS = 64;
+
+    void addWorker(int worker);
+    void removeWorker(int worker);
+    bool isEmpty() const { return m_points.empty(); }
+
+    /// @brief The worker for @p room, or -1 if there are no workers
+    int workerFor(const QString& room) const;
+
+private:
+    static quint32 hash(const QString& s);
+
+    /// @brief Adds the points of @p worker, without touching m_workers
+    void addPoints(int worker);
+
+    std::set<int> m_workers;
+    std::map<quint32, int> m_points;
+};
+
+}  // namespace QuatBot
+
+#endif
@@ -0,0 +1,87 @@
+/*
+ *  SPDX-License-Identifier: BSD-2-Clause
+ *  SPDX-License-File: LICENSE
+ *
+ * Copyright 2019 Adriaan de Groot <groot@kde.org>
+ */
+
+#ifndef QUATBOT_SPSCQUEUE_H
+#define QUATBOT_SPSCQUEUE_H
+
+#include <atomic>
+#include <utility>
+
+namespace QuatBot
+{
+/** @brief A lock-free queue for one producer thread and one consumer thread
+ *
+ * The queue is a linked list that always holds one node that has
+ * been consumed already; the producer only touches the last node,
+ * the consumer only the first, so they never wait for each other.
+ * The queue is unbounded: push() never fails, and allocates a node.
+ *
+ * Exactly one thread may call push(), and exactly one (other) thread
+ * may call pop(). Neither of them may be running when the queue is
+ * destroyed.
+ */
+template<typename T>
+class SpscQueue
+{
+public:
+    SpscQueue()
+        : m_first(new Node)
+        , m_last(m_first)
+    {
+    }
+    ~SpscQueue()
+    {
+        while (m_first)
+        {
+            Node* next = m_first->next.load(std::memory_order_relaxed);
+            delete m_first;
+            m_first = next;
+        }
+    }
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    /// @brief Adds @p value at the end; producer only
+    void push(T value)
+    {
+        Node* n = new Node;
+        n->value = std::move(value);
+        m_last->next.store(n, std::memory_order_release);
+        m_last = n;
+    }
+
+    /// @brief Takes the first value into @p value; returns false if the queue is empty. Consumer only.
+    bool pop(T& value)
+    {
+        Node* next = m_first->next.load(std::memory_order_acquire);
+        if (!next)
+        {
+            return false;
+        }
+        value = std::move(next->value);
+        next->value = T();  // next is the consumed node now, don't keep the value alive
+        delete m_first;
+        m_first = next;
+        return true;
+    }
+
+private:
+    struct Node
+    {
+        std::atomic<Node*> next { nullptr };
+        T value;
+    };
+
+    // On separate cache lines, since different threads write them
+    alignas(64) Node* m_first;  ///< consumed already; the values start after it
+    alignas(64) Node* m_last;
+};
+
+}  // namespace QuatBot
+
+#endif
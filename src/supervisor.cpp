@@ -0,0 +1,547 @@
+/*
+ *  SPDX-License-Identifier: BSD-2-Clause
+ *  SPDX-License-File: LICENSE
+ *
+ * Copyright 2019 Adriaan de Groot <groot@kde.org>
+ */
+
+#include "supervisor.h"
+
+#include "metrics.h"
+#include "quatbot.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QProcessEnvironment>
+
+#include <algorithm>
+
+namespace
+{
+// Workers report, and the supervisor broadcasts, this often
+static constexpr const int STATUS_INTERVAL = 10000;
+// Restart delays for a crashing worker, doubling in between
+static constexpr const int MIN_RESTART_DELAY = 1000;
+static constexpr const int MAX_RESTART_DELAY = 60000;
+
+struct ClusterStatus
+{
+    QMutex mutex;
+    QString text;
+};
+
+static ClusterStatus& clusterStatus()
+{
+    static ClusterStatus* s = new ClusterStatus;
+    return *s;
+}
+
+static void writeLine(QLocalSocket* socket, const QString& line)
+{
+    socket->write(line.toUtf8());
+    socket->write("\n", 1);
+}
+}  // namespace
+
+namespace QuatBot
+{
+Supervisor::Supervisor(const QStringList& arguments, const QStringList& rooms, int workers, const QString& password)
+    : QObject()
+    , m_arguments(arguments)
+    , m_rooms(rooms)
+    , m_password(password)
+    , m_workers(qMax(1, workers))
+    , m_active(m_workers.count())
+    , m_server(new QLocalServer(this))
+    , m_statusTimer([this]() { broadcastStatus(); })
+{
+    connect(m_server, &QLocalServer::newConnection, this, &Supervisor::newChannel);
+}
+
+Supervisor::~Supervisor()
+{
+    stop();
+}
+
+bool Supervisor::start()
+{
+    const QString name = QStringLiteral("quatbot-supervisor-%1").arg(QCoreApplication::applicationPid());
+    QLocalServer::removeServer(name);
+    if (!m_server->listen(name))
+    {
+        qWarning() << "Can't listen for workers on" << name << m_server->errorString();
+        return false;
+    }
+    m_arguments << QStringLiteral("--supervisor") << m_server->fullServerName();
+
+    qDebug() << "Spreading" << m_rooms.count() << "rooms over" << m_workers.count() << "workers, control socket"
+             << m_server->fullServerName();
+    for (int i = 0; i < m_workers.count(); ++i)
+    {
+        startWorker(i);
+    }
+    m_statusTimer.start(STATUS_INTERVAL);
+    return true;
+}
+
+void Supervisor::stop()
+{
+    m_stopping = true;
+    m_statusTimer.stop();
+    for (auto& w : m_workers)
+    {
+        if (w.channel)
+        {
+            // The worker quits when the channel closes
+            w.channel->disconnectFromServer();
+        }
+        if (w.process && (w.process->state() != QProcess::NotRunning) && !w.process->waitForFinished(5000))
+        {
+            w.process->kill();
+            w.process->waitForFinished(1000);
+        }
+    }
+}
+
+void Supervisor::resize(int workers)
+{
+    workers = qMax(1, workers);
+    if (m_stopping || (workers == m_active))
+    {
+        return;
+    }
+    qDebug() << "Going from" << m_active << "to" << workers << "workers.";
+    const int before = m_active;
+    m_active = workers;
+    if (m_workers.count() < workers)
+    {
+        m_workers.resize(workers);
+    }
+    for (int i = before; i < workers; ++i)
+    {
+        auto& w = m_workers[i];
+        w.retired = false;
+        // One that is still leaving is started again once it has finished
+        if (!w.leaving && !w.restartPending && (!w.process || w.process->state() == QProcess::NotRunning))
+        {
+            startWorker(i);
+        }
+    }
+    for (int i = workers; i < before; ++i)
+    {
+        auto& w = m_workers[i];
+        if (!w.process || (w.process->state() == QProcess::NotRunning))
+        {
+            continue;  // a pending restart won't happen, see startWorker()
+        }
+        w.leaving = true;
+        QLocalSocket* channel = w.channel;
+        if (channel)
+        {
+            // Leave first, so that a room is never followed twice
+            for (const auto& room : w.rooms)
+            {
+                send(i, QStringLiteral("leave ") + room);
+            }
+            workerDown(i);
+            // The worker quits when the channel closes, once the leaves are written
+            channel->disconnectFromServer();
+        }
+        else
+        {
+            w.process->terminate();
+        }
+    }
+}
+
+void Supervisor::startWorker(int index)
+{
+    auto& w = m_workers[index];
+    w.restartPending = false;
+    if (m_stopping || (index >= m_active))
+    {
+        return;
+    }
+    if (!w.process)
+    {
+        w.process = new QProcess(this);
+        w.process->setProcessChannelMode(QProcess::ForwardedChannels);
+        QProcessEnvironment environment = QProcessEnvironment::systemEnvironment();
+        environment.insert(QStringLiteral("QUATBOT_PASSWORD"), m_password);
+        w.process->setProcessEnvironment(environment);
+        connect(w.process,
+                QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished),
+                this,
+                [this, index](int exitCode, QProcess::ExitStatus exitStatus)
+                { workerFinished(index, exitCode, exitStatus); });
+        connect(w.process,
+                &QProcess::errorOccurred,
+                this,
+                [this, index](QProcess::ProcessError e)
+                {
+                    // Other errors are followed by finished()
+                    if (e == QProcess::FailedToStart)
+                    {
+                        qWarning() << "Worker" << index << "did not start:" << m_workers[index].process->errorString();
+                        workerFinished(index, 1, QProcess::CrashExit);
+                    }
+                });
+    }
+    w.process->start(QCoreApplication::applicationFilePath(),
+                     m_arguments + QStringList { QStringLiteral("--shard"), QString::number(index) });
+}
+
+void Supervisor::workerFinished(int index, int exitCode, QProcess::ExitStatus exitStatus)
+{
+    auto& w = m_workers[index];
+    workerDown(index);
+    if (m_stopping || w.restartPending)
+    {
+        return;
+    }
+    if (w.leaving)
+    {
+        w.leaving = false;
+        if (index < m_active)
+        {
+            startWorker(index);  // wanted again in the meantime
+        }
+        return;
+    }
+    if ((exitStatus == QProcess::NormalExit) && (exitCode == 0))
+    {
+        qWarning() << "Worker" << index << "has quit; its rooms stay with the others.";
+        w.retired = true;
+        const auto active = m_workers.cbegin() + m_active;
+        if (std::all_of(m_workers.cbegin(), active, [](const Worker& other) { return other.retired; }))
+        {
+            qWarning() << "No workers left.";
+            QCoreApplication::quit();
+        }
+        return;
+    }
+
+    w.restartDelay = qBound(MIN_RESTART_DELAY, w.restartDelay * 2, MAX_RESTART_DELAY);
+    qWarning() << "Worker" << index << "failed, restarting it in" << w.restartDelay << "ms.";
+    w.restartPending = true;
+    TimerWheel::singleShot(w.restartDelay, this, [this, index]() { startWorker(index); });
+}
+
+void Supervisor::workerDown(int index)
+{
+    auto& w = m_workers[index];
+    if (!w.channel)
+    {
+        return;
+    }
+    w.channel->deleteLater();
+    w.channel = nullptr;
+    w.rooms.clear();
+    w.joined = 0;
+    m_ring.removeWorker(index);
+    rebalance();
+}
+
+void Supervisor::newChannel()
+{
+    while (QLocalSocket* channel = m_server->nextPendingConnection())
+    {
+        channel->setParent(this);
+        connect(channel, &QLocalSocket::readyRead, this, [this, channel]() { readChannel(channel); });
+        connect(channel,
+                &QLocalSocket::disconnected,
+                this,
+                [this, channel]()
+                {
+                    for (int i = 0; i < m_workers.count(); ++i)
+                    {
+                        if (m_workers[i].channel == channel)
+                        {
+                            workerDown(i);
+                            return;
+                        }
+                    }
+                    channel->deleteLater();  // never said hello
+                });
+    }
+}
+
+void Supervisor::readChannel(QLocalSocket* channel)
+{
+    while (channel->canReadLine())
+    {
+        const QString line = QString::fromUtf8(channel->readLine()).trimmed();
+        const QString word = line.section(' ', 0, 0);
+        if (word == QStringLiteral("hello"))
+        {
+            bool ok = false;
+            const int index = line.section(' ', 1, 1).toInt(&ok);
+            if (!ok || index < 0 || index >= m_active || m_workers[index].channel)
+            {
+                qWarning() << "Unexpected worker" << line;
+                channel->disconnectFromServer();
+                return;
+            }
+            qDebug() << "Worker" << index << "is up.";
+            m_workers[index].channel = channel;
+            m_ring.addWorker(index);
+            rebalance();
+        }
+        else if (word == QStringLiteral("status"))
+        {
+            for (auto& w : m_workers)
+            {
+                if (w.channel == channel)
+                {
+                    w.joined = line.section(' ', 1, 1).toInt();
+                    w.messages = line.section(' ', 2, 2).toULongLong();
+                    w.restartDelay = 0;  // it's doing fine
+                }
+            }
+        }
+        else if (word == QStringLiteral("workers"))
+        {
+            bool ok = false;
+            const int workers = line.section(' ', 1, 1).toInt(&ok);
+            if (ok && workers > 0)
+            {
+                resize(workers);
+            }
+            else
+            {
+                qWarning() << "Bad number of workers" << line;
+            }
+        }
+        else
+        {
+            qWarning() << "Unknown message from worker" << line;
+        }
+    }
+}
+
+void Supervisor::rebalance()
+{
+    if (m_stopping)
+    {
+        return;
+    }
+    QVector<QSet<QString>> wanted(m_workers.count());
+    for (const auto& room : m_rooms)
+    {
+        const int index = m_ring.workerFor(room);
+        if (index >= 0)
+        {
+            wanted[index].insert(room);
+        }
+    }
+
+    // Leave first, so that a room is never followed twice
+    for (int i = 0; i < m_workers.count(); ++i)
+    {
+        auto& w = m_workers[i];
+        for (const auto& room : QSet<QString>(w.rooms).subtract(wanted[i]))
+        {
+            send(i, QStringLiteral("leave ") + room);
+            w.rooms.remove(room);
+        }
+    }
+    for (int i = 0; i < m_workers.count(); ++i)
+    {
+        auto& w = m_workers[i];
+        for (const auto& room : QSet<QString>(wanted[i]).subtract(w.rooms))
+        {
+            send(i, QStringLiteral("join ") + room);
+            w.rooms.insert(room);
+        }
+    }
+}
+
+void Supervisor::send(int index, const QString& line)
+{
+    if (auto* channel = m_workers[index].channel)
+    {
+        writeLine(channel, line);
+    }
+}
+
+void Supervisor::broadcastStatus()
+{
+    const QString line = QStringLiteral("cluster ") + summary();
+    for (int i = 0; i < m_workers.count(); ++i)
+    {
+        send(i, line);
+    }
+}
+
+QString Supervisor::summary() const
+{
+    int up = 0;
+    int joined = 0;
+    quint64 messages = 0;
+    QStringList down;
+    for (int i = 0; i < m_active; ++i)
+    {
+        const auto& w = m_workers[i];
+        if (w.channel)
+        {
+            up++;
+            joined += w.joined;
+            messages += w.messages;
+        }
+        else
+        {
+            down << QString::number(i);
+        }
+    }
+    QString s = QString("(shards) %1 of %2 workers up, following %3 of %4 rooms, %5 messages.")
+                    .arg(up)
+                    .arg(m_active)
+                    .arg(joined)
+                    .arg(m_rooms.count())
+                    .arg(messages);
+    if (!down.isEmpty())
+    {
+        s += QStringLiteral(" Down: ") + down.join(QStringLiteral(", ")) + '.';
+    }
+    return s;
+}
+
+ShardWorker::ShardWorker(int index, Quotient::Connection& conn, const QStringList& ops)
+    : QObject()
+    , m_index(index)
+    , m_conn(conn)
+    , m_ops(ops)
+    , m_channel(new QLocalSocket(this))
+    , m_statusTimer([this]() { reportStatus(); })
+{
+    Bot::setStandalone(false);
+    connect(m_channel, &QLocalSocket::readyRead, this, &ShardWorker::readChannel);
+    connect(m_channel,
+            &QLocalSocket::disconnected,
+            this,
+            []()
+            {
+                qWarning() << "The supervisor has gone away.";
+                QCoreApplication::quit();
+            });
+}
+
+ShardWorker::~ShardWorker() {}
+
+bool ShardWorker::attach(const QString& name)
+{
+    m_channel->connectToServer(name);
+    if (!m_channel->waitForConnected(5000))
+    {
+        qWarning() << "Can't reach the supervisor at" << name << m_channel->errorString();
+        return false;
+    }
+    writeLine(m_channel, QStringLiteral("hello %1").arg(m_index));
+    m_statusTimer.start(STATUS_INTERVAL);
+    return true;
+}
+
+void ShardWorker::connected()
+{
+    m_connected = true;
+    for (const auto& room : m_pending)
+    {
+        join(room);
+    }
+    m_pending.clear();
+}
+
+QString ShardWorker::clusterStatus()
+{
+    auto& s = ::clusterStatus();
+    QMutexLocker lock(&s.mutex);
+    return s.text;
+}
+
+void ShardWorker::readChannel()
+{
+    while (m_channel->canReadLine())
+    {
+        command(QString::fromUtf8(m_channel->readLine()).trimmed());
+    }
+}
+
+void ShardWorker::command(const QString& line)
+{
+    const QString word = line.section(' ', 0, 0);
+    const QString rest = line.section(' ', 1);
+    if (word == QStringLiteral("join"))
+    {
+        join(rest);
+    }
+    else if (word == QStringLiteral("leave"))
+    {
+        leave(rest);
+    }
+    else if (word == QStringLiteral("cluster"))
+    {
+        auto& s = ::clusterStatus();
+        QMutexLocker lock(&s.mutex);
+        s.text = rest;
+    }
+    else
+    {
+        qWarning() << "Unknown message from the supervisor" << line;
+    }
+}
+
+void ShardWorker::join(const QString& room)
+{
+    if (!m_connected)
+    {
+        m_pending << room;
+        return;
+    }
+    if (m_bots.value(room))
+    {
+        return;
+    }
+    qDebug() << "Worker" << m_index << "follows" << room;
+    m_bots.insert(room, new Bot(m_conn, room, m_ops));
+}
+
+void ShardWorker::leave(const QString& room)
+{
+    m_pending.removeAll(room);
+    QPointer<Bot> bot = m_bots.take(room);
+    if (bot)
+    {
+        qDebug() << "Worker" << m_index << "hands over" << room;
+        bot->detach();
+    }
+}
+
+void ShardWorker::reportStatus()
+{
+    int rooms = 0;
+    quint64 messages = 0;
+    auto* metrics = MetricsRegistry::instance();
+    for (auto it = m_bots.begin(); it != m_bots.end();)
+    {
+        if (!it.value())
+        {
+            // Someone told it to ~quit
+            it = m_bots.erase(it);
+            continue;
+        }
+        rooms++;
+        messages += metrics
+                        ->counter(QStringLiteral("quatbot_messages_total"),
+                                  "Messages received.",
+                                  { { QStringLiteral("room"), it.key() } })
+                        ->value();
+        ++it;
+    }
+    writeLine(m_channel, QStringLiteral("status %1 %2").arg(rooms).arg(messages));
+}
+
+}  // namespace QuatBot
@@ -0,0 +1,160 @@
+/*
+ *  SPDX-License-Identifier: BSD-2-Clause
+ *  SPDX-License-File: LICENSE
+ *
+ * Copyright 2019 Adriaan de Groot <groot@kde.org>
+ */
+
+#ifndef QUATBOT_SUPERVISOR_H
+#define QUATBOT_SUPERVISOR_H
+
+#include "shard.h"
+#include "timerwheel.h"
+
+#include <QHash>
+#include <QObject>
+#include <QPointer>
+#include <QProcess>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+class QLocalServer;
+class QLocalSocket;
+
+namespace Quotient
+{
+class Connection;
+}  // namespace Quotient
+
+namespace QuatBot
+{
+class Bot;
+
+/** @brief Spreads the rooms over worker processes
+ *
+ * The supervisor starts the workers (this same program, with the
+ * arguments given, plus `--shard <i>`) and does not connect to Matrix
+ * itself. Each worker logs in with a device of its own, and follows
+ * the rooms that the supervisor hands it; rooms are assigned with a
+ * ShardRing over the workers that are up.
+ *
+ * Workers talk to the supervisor over a local socket, one line per
+ * message:
+ *  - `hello <i>` (worker): worker *i* is ready for rooms,
+ *  - `join <room>`, `leave <room>` (supervisor): follow, or stop
+ *    following, a room,
+ *  - `status <rooms> <messages>` (worker): every few seconds,
+ *  - `cluster <text>` (supervisor): the status of all the workers,
+ *    for `~status`,
+ *  - `workers <n>` (anyone): change the number of workers, see resize().
+ *
+ * When a worker goes away, its rooms move to the others; a worker
+ * that crashed is restarted after a while, and when it says hello
+ * again the rooms that hash to it move back. A worker that exits
+ * normally (e.g. it could not log in) is not restarted; once no
+ * worker is left, the supervisor quits.
+ */
+class Supervisor : public QObject
+{
+public:
+    /** @brief Supervises @p workers workers for @p rooms
+     *
+     * Workers are started with @p arguments; @p password is passed
+     * to them in the environment, not on the command-line.
+     */
+    Supervisor(const QStringList& arguments, const QStringList& rooms, int workers, const QString& password);
+    virtual ~Supervisor() override;
+
+    /// @brief Starts listening, and starts the workers; false if there is no socket
+    bool start();
+    /// @brief Stops the workers
+    void stop();
+    /** @brief Runs @p workers workers from now on
+     *
+     * New workers are started, and get their share of the rooms once
+     * they say hello. Workers beyond the new count hand their rooms to
+     * the others and are stopped.
+     */
+    void resize(int workers);
+
+private:
+    struct Worker
+    {
+        QProcess* process = nullptr;
+        QLocalSocket* channel = nullptr;  ///< once it said hello
+        QSet<QString> rooms;  ///< handed to this worker
+        int restartDelay = 0;  ///< milliseconds, grows while it keeps crashing
+        bool restartPending = false;
+        bool retired = false;  ///< exited normally, not restarted
+        bool leaving = false;  ///< stopped by resize(), not restarted
+        int joined = 0;  ///< rooms it follows, as last reported
+        quint64 messages = 0;
+    };
+
+    void startWorker(int index);
+    void workerFinished(int index, int exitCode, QProcess::ExitStatus exitStatus);
+    /// @brief Worker @p index can't be given rooms any more
+    void workerDown(int index);
+    void newChannel();
+    void readChannel(QLocalSocket* channel);
+    /// @brief Hands out the rooms again, after the workers changed
+    void rebalance();
+    void send(int index, const QString& line);
+    /// @brief Sends the status of all workers to all workers
+    void broadcastStatus();
+    QString summary() const;
+
+    QStringList m_arguments;
+    QStringList m_rooms;
+    QString m_password;
+    QVector<Worker> m_workers;  ///< the first m_active are wanted
+    int m_active;
+    ShardRing m_ring;
+    QLocalServer* m_server;
+    WheelTimer m_statusTimer;
+    bool m_stopping = false;
+};
+
+/** @brief The worker side of the Supervisor
+ *
+ * Follows the rooms that the supervisor hands out, with one Bot
+ * each, and reports back. Rooms that move to another worker are
+ * detached (see Bot::detach()), so the account stays in the room.
+ * When the supervisor goes away, the worker quits.
+ */
+class ShardWorker : public QObject
+{
+public:
+    ShardWorker(int index, Quotient::Connection& conn, const QStringList& ops);
+    virtual ~ShardWorker() override;
+
+    /// @brief Connects to the supervisor named @p name; false if that fails
+    bool attach(const QString& name);
+    /// @brief The connection is ready: follow the rooms handed out so far
+    void connected();
+
+    /// @brief The last status of all the workers, from the supervisor; any thread
+    static QString clusterStatus();
+
+private:
+    void readChannel();
+    void command(const QString& line);
+    void join(const QString& room);
+    void leave(const QString& room);
+    void reportStatus();
+
+    int m_index;
+    Quotient::Connection& m_conn;
+    QStringList m_ops;
+    QLocalSocket* m_channel;
+    bool m_connected = false;
+    QStringList m_pending;  ///< rooms to join once connected
+    QHash<QString, QPointer<Bot>> m_bots;
+    WheelTimer m_statusTimer;
+};
+
+}  // namespace QuatBot
+
+#endif
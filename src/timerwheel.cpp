@@ -0,0 +1,244 @@
+/*
+ *  SPDX-License-Identifier: BSD-2-Clause
+ *  SPDX-License-File: LICENSE
+ *
+ * Copyright 2019 Adriaan de Groot <groot@kde.org>
+ */
+
+#include "timerwheel.h"
+
+#include "clock.h"
+#include "lagmonitor.h"
+
+#include <QPointer>
+
+namespace
+{
+// Level 0 has 256 slots, the others 64
+static constexpr const int LEVEL0_BITS = 8;
+static constexpr const int LEVEL_BITS = 6;
+static constexpr const quint64 LEVEL0_MASK = (1 << LEVEL0_BITS) - 1;
+static constexpr const quint64 LEVEL_MASK = (1 << LEVEL_BITS) - 1;
+
+/// @brief Number of bits of the tick that select a slot in levels below @p level
+constexpr int shift(int level)
+{
+    return level == 0 ? 0 : LEVEL0_BITS + (level - 1) * LEVEL_BITS;
+}
+}  // namespace
+
+namespace QuatBot
+{
+TimerWheel::TimerWheel()
+    : QObject()
+{
+    m_wheel[0].resize(1 << LEVEL0_BITS);
+    for (int level = 1; level < 4; ++level)
+    {
+        m_wheel[level].resize(1 << LEVEL_BITS);
+    }
+    m_timer.setSingleShot(true);
+    connect(&m_timer, &QTimer::timeout, this, &TimerWheel::tick);
+}
+
+TimerWheel* TimerWheel::instance()
+{
+    // Lives as long as the thread's event loop might need it
+    static thread_local TimerWheel* wheel = new TimerWheel;
+    return wheel;
+}
+
+quint64 TimerWheel::currentTick() const
+{
+    return quint64(Clock::instance()->elapsed()) / TICK;
+}
+
+TimerWheel::Id TimerWheel::schedule(qint64 msec, Callback callback)
+{
+    if (m_callbacks.empty())
+    {
+        // Nothing was scheduled, so there is no need to run all the ticks
+        // since the wheel went idle: jump to the current one.
+        m_now = currentTick();
+    }
+
+    // Round up, and always at least the next tick
+    const qint64 elapsed = Clock::instance()->elapsed();
+    const quint64 ticks = quint64(qMax<qint64>(msec, 0) + elapsed - qint64(m_now * TICK) + TICK - 1) / TICK;
+    const Id id = m_nextId++;
+    m_callbacks.emplace(id, std::move(callback));
+    place(Entry { id, m_now + qMax<quint64>(ticks, 1) });
+    arm();
+    return id;
+}
+
+void TimerWheel::cancel(Id id)
+{
+    // The entry stays in its slot, and is skipped when the slot comes up
+    m_callbacks.erase(id);
+    if (m_callbacks.empty())
+    {
+        m_timer.stop();
+    }
+}
+
+void TimerWheel::place(const Entry& e)
+{
+    constexpr quint64 maxDelta = (quint64(1) << shift(4)) - 1;
+    const quint64 delta = qMin(e.expiry - m_now, maxDelta);
+    const quint64 expiry = m_now + delta;
+
+    for (int level = 0; level < 3; ++level)
+    {
+        if (delta < (quint64(1) << shift(level + 1)))
+        {
+            const quint64 mask = level == 0 ? LEVEL0_MASK : LEVEL_MASK;
+            m_wheel[level][(expiry >> shift(level)) & mask].push_back(Entry { e.id, expiry });
+            return;
+        }
+    }
+    m_wheel[3][(expiry >> shift(3)) & LEVEL_MASK].push_back(Entry { e.id, expiry });
+}
+
+void TimerWheel::advance()
+{
+    ++m_now;
+
+    // When a lower level wraps around, the next slot of the level
+    // above is spread out over the lower levels.
+    for (int level = 1; level < 4; ++level)
+    {
+        if ((m_now & ((quint64(1) << shift(level)) - 1)) != 0)
+        {
+            break;
+        }
+        Slot cascade;
+        cascade.swap(m_wheel[level][(m_now >> shift(level)) & LEVEL_MASK]);
+        for (const auto& e : cascade)
+        {
+            if (m_callbacks.count(e.id))
+            {
+                place(e);
+            }
+        }
+    }
+
+    Slot due;
+    due.swap(m_wheel[0][m_now & LEVEL0_MASK]);
+    for (const auto& e : due)
+    {
+        auto it = m_callbacks.find(e.id);
+        if (it != m_callbacks.end())
+        {
+            // Take it out first: the callback may schedule or cancel timers
+            Callback callback = std::move(it->second);
+            m_callbacks.erase(it);
+            LagMonitor::Activity activity(QStringLiteral("timer"), QString());
+            callback();
+        }
+    }
+}
+
+quint64 TimerWheel::nextTick() const
+{
+    // Level 0 wrapping around is when entries from higher levels may come down
+    const quint64 wrap = (m_now | LEVEL0_MASK) + 1;
+    for (quint64 t = m_now + 1; t < wrap; ++t)
+    {
+        if (!m_wheel[0][t & LEVEL0_MASK].empty())
+        {
+            return t;
+        }
+    }
+    return wrap;
+}
+
+qint64 TimerWheel::nextDue() const
+{
+    return m_callbacks.empty() ? -1 : qint64(nextTick() * TICK);
+}
+
+void TimerWheel::arm()
+{
+    if (m_callbacks.empty() || Clock::instance()->isVirtual())
+    {
+        m_timer.stop();
+        return;
+    }
+
+    const qint64 wait = nextDue() - Clock::instance()->elapsed();
+    m_timer.start(int(qMax<qint64>(wait, 0)));
+}
+
+void TimerWheel::tick()
+{
+    const quint64 target = currentTick();
+    while (m_now < target && !m_callbacks.empty())
+    {
+        advance();
+    }
+    if (m_callbacks.empty())
+    {
+        m_now = target;
+    }
+    arm();
+}
+
+void TimerWheel::singleShot(int msec, QObject* context, Callback callback)
+{
+    QPointer<QObject> guard(context);
+    instance()->schedule(msec,
+                         [guard, callback]()
+                         {
+                             if (guard)
+                             {
+                                 callback();
+                             }
+                         });
+}
+
+
+WheelTimer::WheelTimer(TimerWheel::Callback callback)
+    : m_callback(std::move(callback))
+{
+}
+
+WheelTimer::~WheelTimer()
+{
+    stop();
+}
+
+void WheelTimer::start(int msec)
+{
+    m_interval = msec;
+    start();
+}
+
+void WheelTimer::start()
+{
+    stop();
+    m_id = TimerWheel::instance()->schedule(m_interval, [this]() { fire(); });
+}
+
+void WheelTimer::stop()
+{
+    if (m_id)
+    {
+        TimerWheel::instance()->cancel(m_id);
+        m_id = 0;
+    }
+}
+
+void WheelTimer::fire()
+{
+    m_id = 0;
+    if (!m_singleShot)
+    {
+        start();
+    }
+    // Copy, since the callback may well destroy this timer
+    auto callback = m_callback;
+    callback();
+}
+
+}  // namespace QuatBot
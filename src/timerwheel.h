@@ -0,0 +1,128 @@
+/*
+ *  SPDX-License-Identifier: BSD-2-Clause
+ *  SPDX-License-File: LICENSE
+ *
+ * Copyright 2019 Adriaan de Groot <groot@kde.org>
+ */
+
+#ifndef QUATBOT_TIMERWHEEL_H
+#define QUATBOT_TIMERWHEEL_H
+
+#include <QObject>
+#include <QTimer>
+
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+namespace QuatBot
+{
+/** @brief One timer for all the timers of all the bots
+ *
+ * Bots have lots of timers (reminders, refills, fallbacks) and most
+ * of them are idle most of the time. Instead of a QTimer each,
+ * they register a callback with the wheel (see WheelTimer for a
+ * QTimer-like interface). The wheel has a single QTimer, which
+ * only wakes up when something is (nearly) due.
+ *
+ * Timers are coalesced into ticks of TICK milliseconds. Timers
+ * live in a hierarchical wheel, so scheduling and cancelling are
+ * both O(1). The wheel is not thread-safe: each thread has its own
+ * (see instance()), and timers fire in the thread that scheduled them.
+ *
+ * Time comes from Clock::instance(). With a virtual clock there is
+ * no QTimer: VirtualClock::advance() calls tick() as timers come due.
+ */
+class TimerWheel : public QObject
+{
+public:
+    using Callback = std::function<void()>;
+    using Id = quint64;  ///< 0 is never a valid Id
+
+    /// Resolution of the wheel, in milliseconds
+    static constexpr const int TICK = 100;
+
+    /// @brief The wheel of the calling thread, which needs an event loop
+    static TimerWheel* instance();
+
+    /// @brief Calls @p callback once, after @p msec milliseconds; returns an Id for cancel()
+    Id schedule(qint64 msec, Callback callback);
+    /// @brief Cancels the timer @p id; does nothing if it has already fired
+    void cancel(Id id);
+
+    /// @brief Like QTimer::singleShot(), but nothing is called if @p context is gone
+    static void singleShot(int msec, QObject* context, Callback callback);
+
+    /// @brief Clock time (in the clock's elapsed() milliseconds) the wheel next needs to run, or -1 if idle
+    qint64 nextDue() const;
+    /// @brief Runs everything that is due by now; called by the QTimer or VirtualClock::advance()
+    void tick();
+
+private:
+    TimerWheel();
+
+    struct Entry
+    {
+        Id id;
+        quint64 expiry;  // in ticks
+    };
+    using Slot = std::vector<Entry>;
+
+    /// @brief The tick it is now, according to the clock
+    quint64 currentTick() const;
+    /// @brief The next tick that has entries, or where level 0 wraps
+    quint64 nextTick() const;
+    /// @brief Puts @p e in the right slot, based on how far away it is
+    void place(const Entry& e);
+    /// @brief Moves one tick forward, running everything that is due
+    void advance();
+    /// @brief Starts the QTimer for the next tick that has something to do
+    void arm();
+
+    QTimer m_timer;
+    quint64 m_now = 0;  // last tick that was run
+    Id m_nextId = 1;
+
+    // Level 0 has a slot per tick, each next level has slots that
+    // are 256, 256*64, 256*64*64 ticks wide.
+    std::vector<Slot> m_wheel[4];
+    // Timers that have not fired or been cancelled yet
+    std::unordered_map<Id, Callback> m_callbacks;
+};
+
+/** @brief A QTimer-like timer that lives in the TimerWheel
+ *
+ * Instead of connecting to a timeout() signal, pass the callback
+ * to the constructor. Destroying the timer stops it.
+ */
+class WheelTimer
+{
+public:
+    explicit WheelTimer(TimerWheel::Callback callback);
+    ~WheelTimer();
+
+    WheelTimer(const WheelTimer&) = delete;
+    WheelTimer& operator=(const WheelTimer&) = delete;
+
+    void setSingleShot(bool singleShot) { m_singleShot = singleShot; }
+    void setInterval(int msec) { m_interval = msec; }
+    int interval() const { return m_interval; }
+
+    /// @brief (Re)starts the timer with interval @p msec
+    void start(int msec);
+    /// @brief (Re)starts the timer with the previous interval
+    void start();
+    void stop();
+    bool isActive() const { return m_id != 0; }
+
+private:
+    void fire();
+
+    TimerWheel::Callback m_callback;
+    TimerWheel::Id m_id = 0;
+    int m_interval = 0;
+    bool m_singleShot = false;
+};
+
+}  // namespace QuatBot
+#endif
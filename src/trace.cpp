@@ -0,0 +1,221 @@
+/*
+ *  SPDX-License-Identifier: BSD-2-Clause
+ *  SPDX-License-File: LICENSE
+ *
+ * Copyright 2019 Adriaan de Groot <groot@kde.org>
+ */
+
+#include "trace.h"
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+
+#include <memory>
+#include <vector>
+
+namespace
+{
+struct Span
+{
+    const char* name = nullptr;
+    QString detail;
+    qint64 start = 0;
+    qint64 end = 0;
+};
+
+/** @brief The spans of one thread
+ *
+ * Only the owning thread writes, but dump() reads from another
+ * thread, so the ring has a mutex. It is (nearly) never contended.
+ */
+struct Ring
+{
+    QMutex mutex;
+    std::vector<Span> spans;
+    quint64 next = 0;  // total number of spans recorded
+    int tid = 0;
+    QString threadName;
+    bool inUse = false;  // protected by the mutex in Rings
+};
+
+struct Rings
+{
+    QMutex mutex;
+    // Rings are never freed; when a thread exits its ring is re-used
+    // by the next new thread (e.g. in the thread pool).
+    std::vector<std::unique_ptr<Ring>> rings;
+};
+
+static Rings& rings()
+{
+    static Rings* r = new Rings;
+    return *r;
+}
+
+static QElapsedTimer& clock()
+{
+    static QElapsedTimer* c = []()
+    {
+        auto* timer = new QElapsedTimer;
+        timer->start();
+        return timer;
+    }();
+    return *c;
+}
+
+/// @brief Hands the ring back when the thread exits
+struct RingHandle
+{
+    Ring* ring = nullptr;
+
+    ~RingHandle()
+    {
+        if (ring)
+        {
+            QMutexLocker lock(&rings().mutex);
+            ring->inUse = false;
+        }
+    }
+};
+
+static Ring* threadRing()
+{
+    thread_local RingHandle handle;
+    if (!handle.ring)
+    {
+        auto& all = rings();
+        QMutexLocker lock(&all.mutex);
+        for (const auto& r : all.rings)
+        {
+            if (!r->inUse)
+            {
+                handle.ring = r.get();
+                break;
+            }
+        }
+        if (!handle.ring)
+        {
+            auto r = std::make_unique<Ring>();
+            r->spans.resize(QuatBot::Trace::RING_SIZE);
+            r->tid = int(all.rings.size()) + 1;
+            handle.ring = r.get();
+            all.rings.push_back(std::move(r));
+        }
+        handle.ring->inUse = true;
+        handle.ring->threadName = QThread::currentThread()->objectName();
+        if (handle.ring->threadName.isEmpty())
+        {
+            handle.ring->threadName = handle.ring->tid == 1 ? QStringLiteral("main")
+                                                            : QStringLiteral("thread %1").arg(handle.ring->tid);
+        }
+    }
+    return handle.ring;
+}
+
+/// @brief Appends @p s to @p out as a JSON string, with quotes
+static void appendString(QByteArray& out, const QString& s)
+{
+    // QJsonDocument does the escaping
+    const QByteArray quoted = QJsonDocument(QJsonObject { { QStringLiteral("s"), s } }).toJson(QJsonDocument::Compact);
+    // {"s":"..."}
+    out += quoted.mid(5, quoted.length() - 6);
+}
+}  // namespace
+
+namespace QuatBot
+{
+std::atomic<bool> Trace::s_enabled { false };
+
+void Trace::setEnabled(bool enabled)
+{
+    if (enabled)
+    {
+        (void)clock();
+        (void)threadRing();
+    }
+    s_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+qint64 Trace::now()
+{
+    return clock().nsecsElapsed();
+}
+
+void Trace::record(const char* name, const QString& detail, qint64 start, qint64 end)
+{
+    Ring* ring = threadRing();
+    QMutexLocker lock(&ring->mutex);
+    Span& s = ring->spans[ring->next % RING_SIZE];
+    s.name = name;
+    s.detail = detail;
+    s.start = start;
+    s.end = end;
+    ring->next++;
+}
+
+QString Trace::dump()
+{
+    const qint64 pid = QCoreApplication::applicationPid();
+    QByteArray out("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    auto separator = [&]()
+    {
+        if (!first)
+        {
+            out += ",\n";
+        }
+        first = false;
+    };
+
+    auto& all = rings();
+    QMutexLocker lock(&all.mutex);
+    for (const auto& ring : all.rings)
+    {
+        QMutexLocker ringLock(&ring->mutex);
+
+        separator();
+        out += "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":" + QByteArray::number(pid)
+            + ",\"tid\":" + QByteArray::number(ring->tid) + ",\"args\":{\"name\":";
+        appendString(out, ring->threadName);
+        out += "}}";
+
+        const quint64 count = qMin<quint64>(ring->next, RING_SIZE);
+        for (quint64 i = ring->next - count; i < ring->next; ++i)
+        {
+            const Span& s = ring->spans[i % RING_SIZE];
+            separator();
+            // Timestamps are in microseconds
+            out += "{\"ph\":\"X\",\"cat\":\"quatbot\",\"name\":\"" + QByteArray(s.name)
+                + "\",\"pid\":" + QByteArray::number(pid) + ",\"tid\":" + QByteArray::number(ring->tid)
+                + ",\"ts\":" + QByteArray::number(double(s.start) / 1000.0, 'f', 3)
+                + ",\"dur\":" + QByteArray::number(double(s.end - s.start) / 1000.0, 'f', 3);
+            if (!s.detail.isEmpty())
+            {
+                out += ",\"args\":{\"detail\":";
+                appendString(out, s.detail);
+                out += '}';
+            }
+            out += '}';
+        }
+    }
+    out += "\n]}\n";
+
+    QFile f(QStringLiteral("/tmp/quatbot-trace-%1.json")
+                .arg(QDateTime::currentDateTimeUtc().toString(QStringLiteral("yyyyMMdd-hhmmss"))));
+    if (!f.open(QFile::WriteOnly) || f.write(out) != out.size())
+    {
+        qWarning() << "Could not write trace" << f.fileName();
+        return QString();
+    }
+    return f.fileName();
+}
+
+}  // namespace QuatBot
@@ -0,0 +1,98 @@
+/*
+ *  SPDX-License-Identifier: BSD-2-Clause
+ *  SPDX-License-File: LICENSE
+ *
+ * Copyright 2019 Adriaan de Groot <groot@kde.org>
+ */
+
+#ifndef QUATBOT_TRACE_H
+#define QUATBOT_TRACE_H
+
+#include <QString>
+
+#include <atomic>
+
+/** @file Scoped trace spans, exported as Chrome trace-event JSON
+ *
+ * Put QUATBOT_TRACE("Class::method") at the top of a scope to record
+ * how long the scope takes; QUATBOT_TRACE_DETAIL("name", detail) also
+ * records a string (e.g. an event id or watcher name) with the span.
+ * Spans go into a ring buffer per thread, which keeps the last
+ * Trace::RING_SIZE spans. Trace::dump() writes all of them to a file
+ * that can be loaded into chrome://tracing or ui.perfetto.dev.
+ *
+ * When tracing is switched off at runtime, a span costs one atomic load.
+ * When the build option TRACING is off, the macros expand to nothing.
+ */
+
+namespace QuatBot
+{
+class Trace
+{
+public:
+    /// @brief Spans kept per thread; older ones are overwritten
+    static constexpr const int RING_SIZE = 16384;
+
+    static bool isEnabled() { return s_enabled.load(std::memory_order_relaxed); }
+    static void setEnabled(bool enabled);
+
+    /** @brief Writes all recorded spans as trace-event JSON
+     *
+     * Returns the name of the file written (in /tmp), or an empty
+     * string if it could not be written.
+     */
+    static QString dump();
+
+    /// @brief Time since tracing started, in nanoseconds
+    static qint64 now();
+    /// @brief Records a span on the current thread
+    static void record(const char* name, const QString& detail, qint64 start, qint64 end);
+
+private:
+    static std::atomic<bool> s_enabled;
+};
+
+/// @brief Records a span for its own lifetime, if tracing is enabled
+class TraceScope
+{
+public:
+    explicit TraceScope(const char* name, const QString& detail = QString())
+        : m_name(name)
+        , m_start(Trace::isEnabled() ? Trace::now() : -1)
+    {
+        if (m_start >= 0)
+        {
+            m_detail = detail;
+        }
+    }
+    ~TraceScope()
+    {
+        if (m_start >= 0)
+        {
+            Trace::record(m_name, m_detail, m_start, Trace::now());
+        }
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* m_name;
+    QString m_detail;
+    qint64 m_start;
+};
+
+}  // namespace QuatBot
+
+#ifdef ENABLE_TRACING
+#define QUATBOT_TRACE_JOIN2(a, b) a##b
+#define QUATBOT_TRACE_JOIN(a, b) QUATBOT_TRACE_JOIN2(a, b)
+#define QUATBOT_TRACE(name) QuatBot::TraceScope QUATBOT_TRACE_JOIN(quatbot_trace_, __LINE__)(name)
+#define QUATBOT_TRACE_DETAIL(name, detail) \
+    QuatBot::TraceScope QUATBOT_TRACE_JOIN(quatbot_trace_, __LINE__)(name, detail)
+#else
+#define QUATBOT_TRACE(name)
+#define QUATBOT_TRACE_DETAIL(name, detail)
+#endif
+
+#endif
@@ -0,0 +1,101 @@
+/*
+ *  SPDX-License-Identifier: BSD-2-Clause
+ *  SPDX-License-File: LICENSE
+ *
+ * Copyright 2019 Adriaan de Groot <groot@kde.org>
+ */
+
+#include "userid.h"
+
+#include <QDebug>
+#include <QMutex>
+#include <QMutexLocker>
+
+#include <atomic>
+
+namespace
+{
+// The strings are kept in chunks that never move, so that reading
+// them needs no lock; 4096 chunks of 4096 ids is plenty.
+static constexpr const int CHUNK_BITS = 12;
+static constexpr const quint32 CHUNK_SIZE = 1 << CHUNK_BITS;
+static constexpr const quint32 CHUNK_MASK = CHUNK_SIZE - 1;
+static constexpr const quint32 MAX_CHUNKS = 4096;
+
+struct InternTable
+{
+    QMutex mutex;
+    QHash<QString, quint32> handles;
+    std::atomic<QString*> chunks[MAX_CHUNKS] {};
+    quint32 next = 1;  // 0 is the null id
+
+    static InternTable& instance()
+    {
+        static InternTable* table = new InternTable;
+        return *table;
+    }
+};
+}  // namespace
+
+namespace QuatBot
+{
+UserId::UserId(const QString& id)
+{
+    if (id.isEmpty())
+    {
+        return;
+    }
+
+    auto& table = InternTable::instance();
+    QMutexLocker lock(&table.mutex);
+    const auto it = table.handles.constFind(id);
+    if (it != table.handles.constEnd())
+    {
+        m_handle = it.value();
+        return;
+    }
+
+    const quint32 handle = table.next;
+    const quint32 chunk = handle >> CHUNK_BITS;
+    if (chunk >= MAX_CHUNKS)
+    {
+        static bool warned = false;
+        if (!warned)
+        {
+            qWarning() << "Too many user ids, not interning" << id;
+            warned = true;
+        }
+        return;
+    }
+    QString* strings = table.chunks[chunk].load(std::memory_order_relaxed);
+    if (!strings)
+    {
+        strings = new QString[CHUNK_SIZE];
+        table.chunks[chunk].store(strings, std::memory_order_release);
+    }
+    strings[handle & CHUNK_MASK] = id;
+    table.handles.insert(id, handle);
+    table.next++;
+    m_handle = handle;
+}
+
+UserId UserId::lookup(const QString& id)
+{
+    auto& table = InternTable::instance();
+    QMutexLocker lock(&table.mutex);
+    return UserId(table.handles.value(id, 0));
+}
+
+const QString& UserId::toString() const
+{
+    static const QString none;
+    if (!m_handle)
+    {
+        return none;
+    }
+    // Whoever has the handle got it after the string was stored
+    const QString* strings = InternTable::instance().chunks[m_handle >> CHUNK_BITS].load(std::memory_order_acquire);
+    return strings[m_handle & CHUNK_MASK];
+}
+
+}  // namespace QuatBot
@@ -0,0 +1,76 @@
+/*
+ *  SPDX-License-Identifier: BSD-2-Clause
+ *  SPDX-License-File: LICENSE
+ *
+ * Copyright 2019 Adriaan de Groot <groot@kde.org>
+ */
+
+#ifndef QUATBOT_USERID_H
+#define QUATBOT_USERID_H
+
+#include <QHash>
+#include <QString>
+
+#include <functional>
+
+namespace QuatBot
+{
+/** @brief A Matrix user id, interned
+ *
+ * The same user ids turn up everywhere: as the sender of each
+ * message and command, in the operators of each room, in meetings
+ * and in the coffee stats. A UserId is a small handle into one
+ * process-wide table of ids, so it is cheap to copy, compare
+ * and hash; toString() gives the id back.
+ *
+ * Ids are never removed from the table. Interning takes a lock,
+ * looking up the string of a handle does not, so a UserId may be
+ * passed to (and printed from) other threads.
+ */
+class UserId
+{
+public:
+    /// @brief The null id, which is also what an empty string interns to
+    UserId() = default;
+    /// @brief The handle for @p id, adding it to the table if needed
+    explicit UserId(const QString& id);
+
+    /// @brief The handle for @p id if it has been interned already, a null id otherwise
+    static UserId lookup(const QString& id);
+
+    bool isNull() const { return m_handle == 0; }
+    quint32 handle() const { return m_handle; }
+    /// @brief The Matrix id (empty for the null id)
+    const QString& toString() const;
+
+    bool operator==(UserId other) const { return m_handle == other.m_handle; }
+    bool operator!=(UserId other) const { return m_handle != other.m_handle; }
+    /// @brief Order of interning, not alphabetical; compare toString() for that
+    bool operator<(UserId other) const { return m_handle < other.m_handle; }
+
+private:
+    explicit UserId(quint32 handle)
+        : m_handle(handle)
+    {
+    }
+
+    quint32 m_handle = 0;
+};
+
+inline uint qHash(UserId u, uint seed = 0)
+{
+    return ::qHash(u.handle(), seed);
+}
+
+}  // namespace QuatBot
+
+namespace std
+{
+template<>
+struct hash<QuatBot::UserId>
+{
+    size_t operator()(QuatBot::UserId u) const { return u.handle(); }
+};
+}  // namespace std
+
+#endif
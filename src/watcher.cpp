@@ -7,31 +7,35 @@
 
 #include "watcher.h"
 
+#include "envelope.h"
+#include "trace.h"
+
 #include <room.h>
 
 namespace QuatBot
 {
 static constexpr const QChar COMMAND_PREFIX('~');  // 0x1575); // ᕵ Nunavik Hi
 
-static QString munge(const QString& s)
+static QString munge(const QStringRef& s)
 {
-    return s.trimmed();
+    return s.trimmed().toString();
 }
 
-CommandArgs::CommandArgs(QString s)
+CommandArgs::CommandArgs(const QString& s)
 {
+    QUATBOT_TRACE("CommandArgs::CommandArgs");
     if (isCommand(s))
     {
-        QStringList parts = s.remove(0, 1).split(' ');
-        QStringList r;
+        // References into s, so the message itself is not copied
+        const QVector<QStringRef> parts = s.midRef(1).split(' ');
+        args.reserve(parts.count() - 1);
         // Skipping over the first, that's the command
         for (int i = 1; i < parts.count(); ++i)
         {
-            r << munge(parts[i]);
+            args << munge(parts[i]);
         }
 
         command = munge(parts[0]);
-        args = r;
     }
 }
 
@@ -39,7 +43,14 @@ CommandArgs::CommandArgs(const QMatrixClient::RoomMessageEvent* e)
     : CommandArgs(e->plainBody())
 {
     id = e->id();
-    user = e->senderId();
+    user = UserId(e->senderId());
+}
+
+CommandArgs::CommandArgs(const MessageEnvelope& e)
+    : CommandArgs(e.body())
+{
+    id = e.id();
+    user = e.sender();
 }
 
 
@@ -83,4 +94,18 @@ QString Watcher::displayCommand(const QString& s)
 
 void Watcher::handleMessage(const QString&) {}
 
+void Watcher::handleMessage(const MessageEnvelope& e)
+{
+    if (e.event())
+    {
+        handleMessage(e.event());
+    }
+}
+
+void Watcher::handleMessage(const QMatrixClient::RoomMessageEvent*) {}
+
+void Watcher::observe(const MessageEnvelope&) {}
+
+void Watcher::observe(const QString&) {}
+
 }  // namespace QuatBot
@@ -9,6 +9,7 @@
 #define QUATBOT_WATCHER_H
 
 #include "quatbot.h"
+#include "userid.h"
 
 #include <QString>
 #include <QStringList>
@@ -21,6 +22,8 @@ class RoomMessageEvent;
 
 namespace QuatBot
 {
+class MessageEnvelope;
+
 /** @brief A command, with 0 or more arguments.
  * 
  * Commands have a **primary** command, and zero or more arguments.
@@ -39,7 +42,7 @@ struct CommandArgs
      * If the string does not start with COMMAND_PREFIX, creates
      * an invalid command.
      */
-    explicit CommandArgs(QString);  // Copied because it's modified in the method
+    explicit CommandArgs(const QString&);
     /** @brief Build a command list from an event.
      * 
      * This kind of command carries the id and user information from
@@ -47,6 +50,8 @@ struct CommandArgs
      * COMMAND_PREFIX, an invalid command is created.
      */
     explicit CommandArgs(const Quotient::RoomMessageEvent*);
+    /// @brief Build a command list from the message in @p e, like the one above
+    explicit CommandArgs(const MessageEnvelope& e);
 
     /// @brief Checks @p s for COMMAND_PREFIX
     static bool isCommand(const QString& s);
@@ -70,7 +75,7 @@ struct CommandArgs
     bool pop();
 
     QString id;  ///< event Id, if available.
-    QString user;  ///< user Id, if available. Used for access-control (ops)
+    UserId user;  ///< user Id, if available. Used for access-control (ops)
     QString command;
     QStringList args;
 };
@@ -119,8 +124,20 @@ public:
      * The default implementation does nothing.
      */
     virtual void handleMessage(const QString&);
-    /// @brief Handle message from the Matrix server
-    virtual void handleMessage(const Quotient::RoomMessageEvent*) = 0;
+    /** @brief Handle message from the Matrix server
+     *
+     * This is what the Bot calls, with the same envelope for every
+     * watcher. The default implementation calls the overload that
+     * takes the event itself, if the envelope still has it (with a
+     * WorkerPool, the watchers get detached envelopes).
+     */
+    virtual void handleMessage(const MessageEnvelope&);
+    /** @brief Handle message from the Matrix server, as the event
+     *
+     * Prefer overriding the MessageEnvelope overload, which does not
+     * decode the event again. The default implementation does nothing.
+     */
+    virtual void handleMessage(const Quotient::RoomMessageEvent*);
     /** @brief Called **after** handleMessage() for those containing a command.
      * 
      * If the watcher has a name (e.g. "log") then it responds to commands
@@ -131,6 +148,27 @@ public:
      */
     virtual void handleCommand(const CommandArgs&) = 0;
 
+    /** @brief Does this watcher observe() messages?
+     *
+     * Checked once, when the bot sets up its watchers. Observers get
+     * every message twice: handleMessage() on the bot's fast path, and
+     * observe() later on.
+     */
+    virtual bool isObserver() const { return false; }
+    /** @brief Observe a message from the Matrix server, off the fast path
+     *
+     * Work that commands do not need right away, like writing a log,
+     * goes here rather than in handleMessage(). With an ObserverStage,
+     * the bot calls this from the stage's thread, in order, for every
+     * message and every line the bot sends (see the overload); state
+     * that observe() uses belongs to that thread, and commands reach
+     * it through Bot::observe() or Bot::observeAndWait(). Do not send
+     * messages from here. The default implementation does nothing.
+     */
+    virtual void observe(const MessageEnvelope&);
+    /// @brief Observe a line sent by the bot, in the same order; see the other overload
+    virtual void observe(const QString&);
+
 protected:
     /// @brief human-readable version of the-command-for @p s with command-prefix
     QString displayCommand(const QString& s);
@@ -0,0 +1,101 @@
+/*
+ *  SPDX-License-Identifier: BSD-2-Clause
+ *  SPDX-License-File: LICENSE
+ *
+ * Copyright 2019 Adriaan de Groot <groot@kde.org>
+ */
+
+#include "workerpool.h"
+
+#include <QDebug>
+#include <QThread>
+
+namespace QuatBot
+{
+static WorkerPool* pool = nullptr;
+
+WorkerPool* WorkerPool::instance()
+{
+    return pool;
+}
+
+void WorkerPool::start(int threads)
+{
+    if (pool)
+    {
+        qWarning() << "The worker pool has been started already.";
+        return;
+    }
+    pool = new WorkerPool(qMax(1, threads));
+}
+
+void WorkerPool::stop()
+{
+    delete pool;
+    pool = nullptr;
+}
+
+WorkerPool::WorkerPool(int threads)
+{
+    m_threads.reserve(threads);
+    for (int i = 0; i < threads; ++i)
+    {
+        auto* thread = new QThread;
+        thread->setObjectName(QStringLiteral("quatbot-worker-%1").arg(i));
+        thread->start();
+        m_threads.append(thread);
+    }
+    qDebug() << "Running the bots on" << threads << "worker threads.";
+}
+
+WorkerPool::~WorkerPool()
+{
+    for (auto* thread : m_threads)
+    {
+        thread->quit();
+    }
+    for (auto* thread : m_threads)
+    {
+        thread->wait();
+        delete thread;
+    }
+}
+
+QThread* WorkerPool::assign()
+{
+    QThread* thread = m_threads[m_next];
+    m_next = (m_next + 1) % m_threads.count();
+    return thread;
+}
+
+static QThread* observerThread = nullptr;
+
+QThread* ObserverStage::thread()
+{
+    return observerThread;
+}
+
+void ObserverStage::start()
+{
+    if (observerThread)
+    {
+        qWarning() << "The observer stage has been started already.";
+        return;
+    }
+    observerThread = new QThread;
+    observerThread->setObjectName(QStringLiteral("quatbot-observers"));
+    observerThread->start();
+}
+
+void ObserverStage::stop()
+{
+    if (observerThread)
+    {
+        observerThread->quit();
+        observerThread->wait();
+        delete observerThread;
+        observerThread = nullptr;
+    }
+}
+
+}  // namespace QuatBot
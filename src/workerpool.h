@@ -0,0 +1,73 @@
+/*
+ *  SPDX-License-Identifier: BSD-2-Clause
+ *  SPDX-License-File: LICENSE
+ *
+ * Copyright 2019 Adriaan de Groot <groot@kde.org>
+ */
+
+#ifndef QUATBOT_WORKERPOOL_H
+#define QUATBOT_WORKERPOOL_H
+
+#include <QVector>
+
+class QThread;
+
+namespace QuatBot
+{
+/** @brief Threads on which the bots run their watchers
+ *
+ * Without a pool (the default) every bot handles its messages on
+ * the main thread. Once the pool is started, each new Bot is pinned
+ * to one of its threads (round-robin): the bot's watchers are created,
+ * run and destroyed there, so a busy room only holds up the rooms
+ * that share its thread. The connection and the rooms stay on the
+ * main thread; see Bot for how messages and replies are handed over.
+ *
+ * Each thread has its own event loop, and so its own TimerWheel
+ * and ProcessRunner.
+ */
+class WorkerPool
+{
+public:
+    /// @brief The pool, or nullptr if bots run on the main thread
+    static WorkerPool* instance();
+    /// @brief Starts a pool of @p threads threads; call it once, before creating any bots
+    static void start(int threads);
+    /// @brief Stops the threads; bots still pinned to them will never run again
+    static void stop();
+
+    /// @brief The thread for a new bot: the next one in turn
+    QThread* assign();
+
+    int threadCount() const { return m_threads.count(); }
+
+private:
+    explicit WorkerPool(int threads);
+    ~WorkerPool();
+
+    QVector<QThread*> m_threads;
+    int m_next = 0;
+};
+
+/** @brief The thread on which the bots' observers run
+ *
+ * Watchers that only observe messages (see Watcher::observe())
+ * do not need to hold up the commands. Once the stage is started,
+ * each new Bot hands its messages, in order, to this thread for its
+ * observers; without it, the observers run right after the other
+ * watchers have handled the message. One thread serves all bots.
+ */
+class ObserverStage
+{
+public:
+    /// @brief The stage's thread, or nullptr if it is not running
+    static QThread* thread();
+    /// @brief Starts the stage; call it before creating any bots
+    static void start();
+    /// @brief Stops the thread; bots that use it will not observe anything any more
+    static void stop();
+};
+
+}  // namespace QuatBot
+
+#endif